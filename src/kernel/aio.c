@@ -0,0 +1,154 @@
+/**
+ * @file
+ * Asynchronous file reads and writes
+ *
+ * A request is handed to the file's driver if it can start the transfer
+ * without waiting. Otherwise it goes on a queue for a worker task, which
+ * does it with the ordinary synchronous read or write, so the submitter
+ * can get on with something else meanwhile.
+ *
+ * Completion is reported through the request's callback, by posting it to
+ * a completion queue, and by waking tasks in @ref aio_wait. Callbacks may
+ * run in interrupt context if the driver completes from an interrupt.
+ */
+#include "aio.h"
+
+#include <cpu_interrupt.h>
+
+#include <drivers/log.h>
+
+#include <core/compiler.h>
+#include <core/errno.h>
+
+static LIST_HEAD(aio_pending);                        ///< Waiting for worker
+static struct waitq aio_workq = WAITQ_INIT(aio_workq); ///< Idle worker
+static struct waitq aio_doneq = WAITQ_INIT(aio_doneq); ///< In aio_wait
+static struct task *aio_worker;
+
+/**
+ * Report a request as done
+ *
+ * The submitter may free the request as soon as it sees it completed, so
+ * the callback runs first, and the rest happens with interrupts disabled so
+ * that no waiter can run before we are done touching the request. Setting
+ * @ref file_aio.complete is the last store to it.
+ */
+static void aio_complete(struct file_aio *io, ssize_t res)
+{
+    io->res = res;
+    if (io->done) io->done(io);
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    if (io->cq) {
+        list_add_tail(&io->link, &io->cq->done);
+        waitq_wake_all(&io->cq->wq);
+    }
+    waitq_wake_all(&aio_doneq);
+    io->complete = 1;
+    intr_setenabled(intrs_enabled);
+}
+
+/** Do a request synchronously, in the calling task */
+static void aio_do(struct file_aio *io)
+{
+    ssize_t res;
+    if (io->op == AIO_READ)
+        res = file_pread(io->file, io->buf, io->count, io->off);
+    else res = file_pwrite(io->file, io->buf, io->count, io->off);
+    aio_complete(io, res);
+}
+
+static void aio_worker_main(void *arg)
+{
+    UNUSED(arg);
+    for (;;) {
+        intr_setenabled(0);
+        while (list_empty(&aio_pending)) waitq_wait(&aio_workq);
+        struct file_aio *io =
+                list_shift_entry(&aio_pending, struct file_aio, link);
+        intr_setenabled(1);
+
+        aio_do(io);
+    }
+}
+
+/**
+ * Start an asynchronous read or write
+ *
+ * Fill in the request's op, file, buffer, count and offset, plus a callback
+ * or completion queue if wanted. The request must stay in place until it
+ * completes.
+ *
+ * @returns 0 if the request was started, or a negative error code if not,
+ * in which case it will not complete.
+ */
+int aio_submit(struct file_aio *io)
+{
+    struct file *f = io->file;
+    if (!f || !f->f_op) return -EBADF;
+    if (io->op != AIO_READ && io->op != AIO_WRITE) return -EINVAL;
+
+    io->complete    = 0;
+    io->res         = 0;
+    io->complete_fn = aio_complete;
+
+    if (f->f_op->aio_submit) {
+        int res = f->f_op->aio_submit(f, io);
+        if (res != -ENOTSUP) return res;
+    }
+
+    /* Without a worker, there is nothing to overlap with. */
+    if (!aio_worker) {
+        aio_do(io);
+        return 0;
+    }
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    list_add_tail(&io->link, &aio_pending);
+    waitq_wake_all(&aio_workq);
+    intr_setenabled(intrs_enabled);
+    return 0;
+}
+
+/** Block until a submitted request is complete */
+void aio_wait(struct file_aio *io)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    while (!io->complete) waitq_wait(&aio_doneq);
+    intr_setenabled(intrs_enabled);
+}
+
+void aio_cq_init(struct aio_cq *cq)
+{
+    INIT_LIST_HEAD(&cq->done);
+    waitq_init(&cq->wq);
+}
+
+/**
+ * Take the next completed request off a completion queue
+ *
+ * @param nohang    Return NULL instead of blocking if none has completed
+ */
+struct file_aio *aio_cq_get(struct aio_cq *cq, int nohang)
+{
+    struct file_aio *io = NULL;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    while (list_empty(&cq->done) && !nohang) waitq_wait(&cq->wq);
+    if (!list_empty(&cq->done))
+        io = list_shift_entry(&cq->done, struct file_aio, link);
+    intr_setenabled(intrs_enabled);
+    return io;
+}
+
+int init_aio(void)
+{
+    aio_worker = task_create("aio", aio_worker_main, NULL, 1);
+    int res    = aio_worker ? 0 : -ENOMEM;
+    log_result(res, "create async I/O worker task\n");
+    return res;
+}
@@ -0,0 +1,23 @@
+#ifndef KERNEL_AIO_H
+#define KERNEL_AIO_H
+
+#include "sched.h"
+
+#include <drivers/vfs.h>
+
+#include <core/list.h>
+
+/** Completed requests, in the order they completed */
+struct aio_cq {
+    struct list_head done; ///< Completed requests not yet taken
+    struct waitq     wq;   ///< Tasks waiting for a completion
+};
+
+int  init_aio(void);
+int  aio_submit(struct file_aio *io);
+void aio_wait(struct file_aio *io);
+
+void             aio_cq_init(struct aio_cq *cq);
+struct file_aio *aio_cq_get(struct aio_cq *cq, int nohang);
+
+#endif /* KERNEL_AIO_H */
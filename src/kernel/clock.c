@@ -0,0 +1,96 @@
+/**
+ * @file
+ * Monotonic clock based on the CPU's Time-Stamp Counter (TSC)
+ *
+ * At boot, the TSC frequency is measured against the PIT. From then on,
+ * reading the time is an RDTSC instruction plus a fixed-point multiply and
+ * shift, with the parameters kept in the shared @ref clockpage so that
+ * processes can do the same conversion without a syscall.
+ */
+#include "clock.h"
+
+#include <cpu.h>
+#include <cpu_timer.h>
+#include <sys/clockpage.h>
+
+#include <drivers/log.h>
+
+#include <core/errno.h>
+#include <core/inttypes.h>
+#include <core/string.h>
+
+/**
+ * The clock page
+ *
+ * Processes currently run in the kernel's identity-mapped address space, so
+ * the page is visible to every process at the same fixed address.
+ */
+static struct clockpage *const clockpage = (void *) CLOCKPAGE_ADDR;
+
+/**
+ * Pick a multiplier and shift for converting cycles to nanoseconds
+ *
+ * We want `ns = (cycles * mult) >> shift`, with `mult` as large as possible
+ * for precision, but still fitting in 32 bits.
+ */
+static void calc_mult_shift(uint64_t hz, uint32_t *mult, uint32_t *shift)
+{
+    uint32_t sft;
+    uint64_t tmp = 0;
+    for (sft = 32; sft > 0; sft--) {
+        tmp = ((uint64_t) NSEC_PER_SEC << sft) / hz;
+        if (tmp <= UINT32_MAX) break;
+    }
+    *mult  = tmp;
+    *shift = sft;
+}
+
+int init_clock(void)
+{
+    int res;
+
+    memset(clockpage, 0, sizeof(*clockpage));
+
+    uint64_t tsc_hz = x86_tsc_calibrate();
+    res             = tsc_hz ? 0 : -ENOTSUP;
+    log_result(res, "calibrate TSC clocksource\n");
+    if (res < 0) return res;
+
+    uint32_t mult, shift;
+    calc_mult_shift(tsc_hz, &mult, &shift);
+
+    clockpage->seq++;
+    asm volatile("" ::: "memory");
+    clockpage->mult     = mult;
+    clockpage->shift    = shift;
+    clockpage->tsc_base = rdtsc();
+    clockpage->ns_base  = 0;
+    clockpage->valid    = 1;
+    asm volatile("" ::: "memory");
+    clockpage->seq++;
+
+    pr_info("clock page at %p: mult=%" PRIu32 " shift=%" PRIu32 "\n",
+            clockpage, mult, shift);
+    return 0;
+}
+
+/** Nanoseconds since boot, or 0 if there is no usable clock */
+uint64_t clock_ns(void)
+{
+    uint64_t ns;
+    if (!clockpage_read_ns(clockpage, &ns)) return 0;
+    return ns;
+}
+
+/** CPU cycles from the Time-Stamp Counter, or 0 if there is no usable clock */
+uint64_t clock_cycles(void) { return clockpage->valid ? rdtsc() : 0; }
+
+int clock_gettime(clockid_t clk, struct timespec *ts)
+{
+    uint64_t ns;
+    if (!ts) return -EFAULT;
+    if (clk != CLOCK_MONOTONIC) return -EINVAL;
+    if (!clockpage_read_ns(clockpage, &ns)) return -ENOTSUP;
+    *ts = ns_to_timespec(ns);
+    return 0;
+}
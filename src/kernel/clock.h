@@ -0,0 +1,13 @@
+#ifndef KERNEL_CLOCK_H
+#define KERNEL_CLOCK_H
+
+#include <core/time.h>
+
+#include <stdint.h>
+
+int      init_clock(void);
+uint64_t clock_ns(void);
+uint64_t clock_cycles(void);
+int      clock_gettime(clockid_t clk, struct timespec *ts);
+
+#endif /* KERNEL_CLOCK_H */
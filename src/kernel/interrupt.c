@@ -1,15 +1,77 @@
+#include "interrupt.h"
+
 #include "kernel.h"
 #include "process.h"
+#include "sched.h"
+#include "timer.h"
 
 #include <cpu_interrupt.h>
+#include <cpu_pic.h>
 
 #include <drivers/log.h>
+#include <drivers/sysfs.h>
+
+/**
+ * Device IRQ count and the tasks waiting for it to change
+ *
+ * Drivers are still polled, but instead of spinning, a task that finds no
+ * data can sleep here until the next device interrupt and then poll again.
+ */
+static volatile unsigned irq_events;
+static struct waitq      irq_waitq = WAITQ_INIT(irq_waitq);
+
+/** @name Counters, in /sys/irq */
+///@{
+static unsigned irq_timer_ticks;
+static unsigned irq_exceptions;
+static unsigned irq_page_faults;
+///@}
+
+/** Number of device interrupts so far; pass to @ref irq_wait */
+unsigned irq_count(void) { return irq_events; }
+
+/**
+ * Sleep until a device interrupt arrives after @p since was read
+ *
+ * Read @ref irq_count before polling a device. If the poll comes up empty,
+ * pass the count here. If an interrupt already arrived in between, this
+ * returns right away so the new data is not missed.
+ */
+void irq_wait(unsigned since)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    if (irq_events == since) waitq_wait(&irq_waitq);
+    intr_setenabled(intrs_enabled);
+}
+
+static void handle_irq(unsigned irq)
+{
+    /* Acknowledge first, since handling may switch to another task. */
+    pic_eoi(irq);
+
+    if (irq == IRQ_TIMER) {
+        irq_timer_ticks++;
+        timer_irq();
+    } else {
+        irq_events++;
+        waitq_wake_all(&irq_waitq);
+    }
+
+    sched_preempt();
+}
 
 static void handle_exception(ivec_t ivec, struct intrdata *idata)
 {
     const int dbgsz = 256;
     char      dbgbuf[dbgsz];
 
+    irq_exceptions++;
+    if (ivec == IVEC_PF) {
+        irq_page_faults++;
+        if (current_process) current_process->acct.majflt++;
+    }
+
     pr_error(
             "process %d (%s): unhandled exception " FMT_IVEC " (%s) %s\n",
             current_process ? current_process->pid : 0,
@@ -28,4 +90,20 @@ void interrupt_dispatch(ivec_t ivec, struct intrdata *idata)
     pr_debug("interrupt %d (%s)\n", ivec, ivec_name(ivec));
 
     if (ivec_isexception(ivec)) return handle_exception(ivec, idata);
+    if (ivec_isirq(ivec)) return handle_irq(ivec - IVEC_IRQ0);
+}
+
+int init_interrupts(void)
+{
+    SYSFS_COUNTER("irq", "device", irq_events);
+    SYSFS_COUNTER("irq", "timer", irq_timer_ticks);
+    SYSFS_COUNTER("irq", "exceptions", irq_exceptions);
+    SYSFS_COUNTER("irq", "page_faults", irq_page_faults);
+
+    pic_init(IVEC_IRQ0);
+    pic_unmask(IRQ_TIMER);
+    pic_unmask(IRQ_COM1);
+    pic_unmask(IRQ_COM2);
+    intr_setenabled(1);
+    return 0;
 }
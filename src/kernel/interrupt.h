@@ -0,0 +1,9 @@
+#ifndef KERNEL_INTERRUPT_H
+#define KERNEL_INTERRUPT_H
+
+int      init_interrupts(void);
+int      init_syscalls(void);
+unsigned irq_count(void);
+void     irq_wait(unsigned since);
+
+#endif /* KERNEL_INTERRUPT_H */
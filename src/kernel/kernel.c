@@ -1,6 +1,11 @@
 #include "kernel.h"
 
+#include "aio.h"
+#include "clock.h"
+#include "interrupt.h"
 #include "kshell.h"
+#include "procfs.h"
+#include "sched.h"
 
 #include <boot.h>
 #include <cpu.h>
@@ -41,12 +46,24 @@ static int mount_initrd(void)
     log_result(res, "get initrd info provided by bootloader\n");
     if (res < 0) return res;
 
-    unsigned rd_minor = res = ramdisk_create(
-            boot_info.initrd_addr, boot_info.initrd_size, "initrd"
-    );
+    /* A compressed image gets a device that decompresses blocks as they
+     * are read. Others are used in place. */
+    void  *addr = boot_info.initrd_addr;
+    size_t size = boot_info.initrd_size;
+    dev_t  rd_dev;
+    if (lz4disk_probe(addr, size)) {
+        res    = lz4disk_create(addr, size, "initrd");
+        rd_dev = MAKEDEV(MAJ_LZ4DISK, res);
+    } else {
+        res    = ramdisk_create(addr, size, "initrd");
+        rd_dev = MAKEDEV(MAJ_RAMDISK, res);
+    }
     if (res < 0) return res;
 
-    res = fs_mountdev(MAKEDEV(MAJ_RAMDISK, rd_minor), FS_CPIO, "/");
+    /* Images with many files are better as ext2; smaller ones are CPIO. */
+    enum fs_types fstype = ext2_probe(rd_dev) > 0 ? FS_EXT2 : FS_CPIO;
+
+    res = fs_mountdev(rd_dev, fstype, "/");
     if (res < 0) return res;
 
     return 0;
@@ -62,13 +79,32 @@ int kernel_main(void)
     init_log();
     read_boot_info(&boot_info);
 
+    /* Start the clock early so that later stages can be timed. */
+    init_clock();
+
+    /* Take over interrupts and start scheduling, so that the CPU can halt
+     * when there is nothing to do instead of spinning. */
+    init_cpu();
+    init_sched();
+    init_interrupts();
+    init_syscalls();
+    init_aio();
+
     /* Init more essential drivers. */
     init_driver_ramdisk();
+    init_driver_lz4disk();
     init_driver_tty();
     init_driver_cpiofs();
+    init_driver_ext2fs();
+    init_driver_tmpfs();
+    init_driver_sysfs();
+    init_driver_procfs();
 
-    /* Mount init ramdisk. */
+    /* Mount init ramdisk, with scratch space and kernel views on top. */
     mount_initrd();
+    fs_mountdev(0, FS_TMP, "/tmp");
+    fs_mountdev(0, FS_SYS, "/sys");
+    fs_mountdev(0, FS_PROC, "/proc");
 
     /* Start shell. */
     kshell_init_run();
@@ -1,8 +1,12 @@
 #include "kshell.h"
 
+#include "interrupt.h"
 #include "kernel.h"
+#include "pipe.h"
 #include "process.h"
 
+#include <cpu_interrupt.h>
+
 #include <drivers/devices.h>
 #include <drivers/fileformat/ascii.h>
 #include <drivers/log.h>
@@ -11,9 +15,11 @@
 #include <core/compiler.h>
 #include <core/ctype.h>
 #include <core/errno.h>
+#include <core/inttypes.h>
 #include <core/list.h>
 #include <core/macros.h>
 #include <core/sprintf.h>
+#include <core/stdlib.h>
 #include <core/string.h>
 
 #include <stdarg.h>
@@ -44,9 +50,16 @@ static const char        *BIN_PATHS[] = {"/sbin", "/bin"};
             ##__VA_ARGS__ \
     )
 
+/** Argument that @ref sh_break_cmdline emits for each pipe symbol */
+static char sh_pipe_token[] = "|";
+
 /**
  * Breaks a command line into separate arguments
  *
+ * A `|` always ends the current argument and becomes an argument of its
+ * own, pointing to @ref sh_pipe_token, so that `a|b` and `a | b` parse the
+ * same way.
+ *
  * N.B. This is a destructive operation. Whitespace in the command line
  * parameter will be replaced with nulls to break it into separate argument
  * strings. If you want to preserve the original command line, you should make
@@ -70,6 +83,14 @@ static int sh_break_cmdline(char *cmdline, char *argv[], size_t argn)
          * string into separate argument strings. */
         if (isspace(ch)) *cmdline = '\0', inword = false;
 
+        /* Likewise for pipes, but also record them as separate arguments. */
+        if (ch == '|') {
+            *cmdline = '\0', inword = false;
+            if (argc < argn) argv[argc++] = sh_pipe_token;
+            else return -E2BIG;
+            continue;
+        }
+
         if (isgraph(ch)) {
             /* If we encounter the start of a new word,
              * record it in the argv array. */
@@ -84,12 +105,40 @@ static int sh_break_cmdline(char *cmdline, char *argv[], size_t argn)
     return argc;
 }
 
+/** One command of a pipeline */
+struct sh_cmd {
+    int    argc;
+    char **argv;
+};
+
+/**
+ * Split parsed arguments into the commands of a pipeline
+ *
+ * @returns the number of commands, -EINVAL if a command is empty, or -E2BIG
+ *          if there are more than @p cmdn commands.
+ */
+static int
+sh_split_pipeline(int argc, char *argv[], struct sh_cmd cmds[], int cmdn)
+{
+    int ncmds = 0, start = 0;
+    for (int i = 0; i <= argc; i++) {
+        if (i < argc && argv[i] != sh_pipe_token) continue;
+        if (i == start) return -EINVAL;
+        if (ncmds == cmdn) return -E2BIG;
+        cmds[ncmds].argc   = i - start;
+        cmds[ncmds++].argv = &argv[start];
+        start              = i + 1;
+    }
+    return ncmds;
+}
+
 static const char *ftype_marker(enum dirtype dtype)
 {
     switch (dtype) {
     case DT_CHR: return "*";
     case DT_DIR: return "/";
     case DT_REG: return "";
+    case DT_FIFO: return "|";
     case DT_UNKNOWN: return "?";
     }
     return "?";
@@ -112,6 +161,137 @@ static int print_cmds(struct file *f, const struct shcmd cmds[])
 
 ///@}
 
+/** @name Job control */
+///@{
+
+/** Whether a job is running, or finished and not yet reported */
+static bool kshell_job_used(const struct kshell_job *job)
+{
+    return job->nlive || job->notify;
+}
+
+/** Find a free slot in the job table */
+static struct kshell_job *kshell_job_alloc(struct kshell *sh)
+{
+    for (int i = 0; i < KSH_JOBS_MAX; i++)
+        if (!kshell_job_used(&sh->jobs[i])) return &sh->jobs[i];
+    return NULL;
+}
+
+/** Remember a job's command line for listing */
+static void kshell_job_setcmd(struct kshell_job *job, int argc, char *argv[])
+{
+    char *pos = job->cmd, *end = job->cmd + KSH_JOBCMD_MAX;
+    for (int i = 0; i < argc; i++)
+        pos += snprintf(pos, BUFREM(pos, end), "%s%s", i ? " " : "", argv[i]);
+}
+
+static int kshell_job_no(struct kshell *sh, struct kshell_job *job)
+{
+    return job - sh->jobs + 1;
+}
+
+static struct kshell_job *kshell_job_find(struct kshell *sh, const char *spec)
+{
+    /* %N selects job number N. */
+    if (spec[0] == '%') {
+        int jobno = atoi(spec + 1);
+        if (jobno < 1 || KSH_JOBS_MAX < jobno) return NULL;
+        struct kshell_job *job = &sh->jobs[jobno - 1];
+        return kshell_job_used(job) ? job : NULL;
+    }
+
+    /* Otherwise, look for a job with the given PID. */
+    pid_t pid = atoi(spec);
+    for (int i = 0; i < KSH_JOBS_MAX && pid; i++) {
+        struct kshell_job *job = &sh->jobs[i];
+        if (kshell_job_used(job) && job->pid == pid) return job;
+        for (int j = 0; j < job->nprocs && job->nlive; j++)
+            if (job->pids[j] == pid) return job;
+    }
+    return NULL;
+}
+
+/** Wait for the processes of a foreground job and reap them */
+static void kshell_job_reap(struct kshell_job *job)
+{
+    for (int i = 0; i < job->nprocs; i++) {
+        if (!job->pids[i]) continue;
+
+        int status = 0;
+        int res    = process_wait(job->pids[i], &status, 0);
+        if (i == job->nprocs - 1) job->status = res < 0 ? res : status;
+        job->pids[i] = 0;
+        job->nlive--;
+    }
+}
+
+/**
+ * Take the exit status of a background process, as it exits
+ *
+ * Runs in the exiting process's task, with interrupts disabled, and the
+ * process is freed right after. So finished jobs hold no process slots,
+ * even while the shell is blocked reading a command.
+ */
+static void kshell_job_exited(struct process *p, void *arg)
+{
+    struct kshell_job *job = arg;
+    for (int i = 0; i < job->nprocs; i++) {
+        if (job->pids[i] != p->pid) continue;
+        if (i == job->nprocs - 1) job->status = p->exit_status;
+        job->pids[i] = 0;
+        if (!--job->nlive) job->notify = 1;
+    }
+}
+
+/** Remove a process that was never started from a job */
+static void kshell_job_drop(struct kshell_job *job, int i)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    if (job->pids[i]) {
+        job->pids[i] = 0;
+        job->nlive--;
+    }
+    intr_setenabled(intrs_enabled);
+}
+
+/** Report a background job if it has finished */
+static void kshell_job_report(struct kshell *sh, struct kshell_job *job)
+{
+    if (!job->notify) return;
+    file_printf(
+            sh->out, "[%d] %d Done (%d) %s\n", kshell_job_no(sh, job),
+            job->pid, job->status, job->cmd
+    );
+    job->notify = 0;
+}
+
+/** Report background jobs that finished since the last prompt */
+static void kshell_report_jobs(struct kshell *sh)
+{
+    for (int i = 0; i < KSH_JOBS_MAX; i++) kshell_job_report(sh, &sh->jobs[i]);
+}
+
+/** Have running jobs free themselves, since nobody will report them */
+static void kshell_detach_jobs(struct kshell *sh)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    for (int i = 0; i < KSH_JOBS_MAX; i++) {
+        struct kshell_job *job = &sh->jobs[i];
+        for (int j = 0; j < job->nprocs && job->nlive; j++) {
+            struct process *p = process_find(job->pids[j]);
+            if (!p) continue;
+            p->exit_fn  = NULL;
+            p->autoreap = 1;
+        }
+    }
+    intr_setenabled(intrs_enabled);
+}
+
+///@}
+
 /** @name Shell command functions */
 ///@{
 
@@ -199,12 +379,20 @@ static int cmd_ls(struct kshell *sh, int argc, char *argv[])
     if (res < 0) goto exit;
     dir_isopen = 1;
 
-    struct dirent de;
+    /* Read entries in batches, not one call per entry. */
+    _Alignas(struct dirent_rec) char buf[512];
     for (;;) {
-        res = file_readdir(&dir, &de);
+        ssize_t len = file_readdir_batch(&dir, buf, sizeof(buf));
+        res         = len;
         if (res < 0) goto exit;
         if (res == 0) break;
-        file_printf(sh->out, "%s%s\n", de.d_name, ftype_marker(de.d_type));
+
+        for (ssize_t off = 0; off < len;) {
+            struct dirent_rec *rec = (struct dirent_rec *) (buf + off);
+            file_printf(sh->out, "%s%s\n", rec->d_name,
+                        ftype_marker(rec->d_type));
+            off += rec->d_reclen;
+        }
     }
 
 exit:
@@ -233,6 +421,18 @@ static int cmd_stat(struct kshell *sh, int argc, char *argv[])
     return 0;
 }
 
+static int cmd_mkdir(struct kshell *sh, int argc, char *argv[])
+{
+    if (argc < 2) {
+        file_printf(sh->err, "usage: %s DIR\n", argv[0]);
+        return 1;
+    }
+
+    int res = file_create(sh->cwd, argv[1], DT_DIR);
+    reporterr(sh, res, "could not create %s\n", argv[1]);
+    return res;
+}
+
 static int cmd_xhead(struct kshell *sh, int argc, char *argv[])
 {
     int res, f_isopen = 0;
@@ -248,18 +448,23 @@ static int cmd_xhead(struct kshell *sh, int argc, char *argv[])
     if (res < 0) goto exit;
     f_isopen = 1;
 
-    const int rowbytes = 16;
-    const int rows     = 10;
-    loff_t    off      = 0;
-    for (int i = 0; i < rows; i++) {
-        /* Read one row worth of bytes. */
-        unsigned char rowbuf[rowbytes];
-        res = file_read(&f, rowbuf, rowbytes);
+    enum { rowbytes = 16, rows = 10 };
+
+    /* Read everything to be shown at once, not one row at a time. */
+    unsigned char buf[rows * rowbytes];
+    loff_t        len = 0;
+    while (len < (loff_t) sizeof(buf)) {
+        res = file_read(&f, buf + len, sizeof(buf) - len);
         if (res < 0) goto exit;
         if (res == 0) break;
+        len += res;
+    }
+
+    for (loff_t off = 0; off < len; off += rowbytes) {
+        unsigned char *rowbuf = buf + off;
+        res                   = MIN(len - off, rowbytes);
 
         file_printf(sh->out, "%.8lx:", off);
-        off += res;
 
         /* Print row bytes. */
         for (int j = 0; j < rowbytes; j++) {
@@ -286,6 +491,26 @@ exit:
     return res;
 }
 
+static int cmd_cat(struct kshell *sh, int argc, char *argv[])
+{
+    int res = 0;
+
+    for (int i = 1; i < argc; i++) {
+        struct file f;
+        res = file_open_path(&f, sh->cwd, argv[i]);
+        reporterr(sh, res, "could not open %s\n", argv[i]);
+        if (res < 0) return res;
+
+        /* The file goes straight to the output, not through our stack. */
+        ssize_t len = file_splice(sh->out, &f, SIZE_MAX, NULL);
+        res         = len < 0 ? len : 0;
+        reporterr(sh, res, "could not copy %s\n", argv[i]);
+        file_close(&f);
+        if (res < 0) return res;
+    }
+    return res;
+}
+
 #define GREY_ON_BLACK 0x07
 #define ED_SCREEN     2
 
@@ -304,6 +529,78 @@ static int cmd_reset(struct kshell *sh, int argc, char *argv[])
     return 0;
 }
 
+static int cmd_jobs(struct kshell *sh, int argc, char *argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    for (int i = 0; i < KSH_JOBS_MAX; i++) {
+        struct kshell_job *job = &sh->jobs[i];
+        if (!kshell_job_used(job)) continue;
+        file_printf(
+                sh->out, "[%d] %d %-7s %s\n", kshell_job_no(sh, job),
+                job->pid, job->nlive ? "Running" : "Done", job->cmd
+        );
+    }
+    return 0;
+}
+
+/**
+ * List processes and what they have cost so far, like /proc/PID/stat
+ *
+ * Times are in thousands of CPU cycles, RSS in pages, I/O in bytes.
+ */
+static int cmd_ps(struct kshell *sh, int argc, char *argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    file_printf(
+            sh->out, "%5s %5s S %10s %10s %8s %4s %8s %8s %s\n", "PID",
+            "PPID", "UTIME", "STIME", "SYSCALLS", "RSS", "RCHAR", "WCHAR",
+            "NAME"
+    );
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        struct process *p = process_slot(i);
+        if (!p) continue;
+        const struct process_acct *a = &p->acct;
+        file_printf(
+                sh->out,
+                "%5d %5d %c %10" PRIu64 " %10" PRIu64 " %8u %4u %8" PRIu64
+                " %8" PRIu64 " %s\n",
+                p->pid, p->ppid, process_state_char(p),
+                a->utime_cycles / 1000, a->stime_cycles / 1000, a->syscalls,
+                a->rss_pages, a->rchar, a->wchar, p->name
+        );
+    }
+    return 0;
+}
+
+/**
+ * Wait for background jobs to finish
+ *
+ * With no arguments, waits for all jobs. Otherwise waits for the given job,
+ * either by PID or as %N for job number N.
+ */
+static int cmd_wait(struct kshell *sh, int argc, char *argv[])
+{
+    struct kshell_job *target = NULL;
+    if (argc >= 2) {
+        target = kshell_job_find(sh, argv[1]);
+        if (!target) return -ECHILD;
+    }
+
+    /* The processes are reaped as they exit, so just wait for that. */
+    for (int i = 0; i < KSH_JOBS_MAX; i++) {
+        struct kshell_job *job = &sh->jobs[i];
+        if (!kshell_job_used(job) || (target && job != target)) continue;
+        for (int j = 0; j < job->nprocs; j++) {
+            pid_t pid = job->pids[j];
+            if (pid) process_wait(pid, NULL, 0);
+        }
+        kshell_job_report(sh, job);
+    }
+    return 0;
+}
+
 static int cmd_help(struct kshell *sh, int argc, char *argv[])
 {
     UNUSED(argc);
@@ -318,8 +615,13 @@ static const struct shcmd KSH_CMDS[] = {
         {"pwd", cmd_pwd},
         {"ls", cmd_ls},
         {"stat", cmd_stat},
+        {"mkdir", cmd_mkdir},
+        {"cat", cmd_cat},
         {"xhead", cmd_xhead},
         {"reset", cmd_reset},
+        {"jobs", cmd_jobs},
+        {"ps", cmd_ps},
+        {"wait", cmd_wait},
         {},
 };
 
@@ -368,11 +670,137 @@ int kshell_init_tty(struct kshell *sh, struct file *tty)
     return res;
 }
 
+/**
+ * Load and start the programs of a pipeline
+ *
+ * Each program's output goes to the next one's input through a pipe. The
+ * first reads from the shell's input, and the last writes to the shell's
+ * output. In the foreground, waits for the whole pipeline and returns the
+ * exit status of the last program. In the background, records it as a job
+ * and returns 0 right away.
+ */
+static int kshell_exec(
+        struct kshell *sh,
+        int            ncmds,
+        struct sh_cmd  cmds[],
+        const char    *bindirs[],
+        bool           background
+)
+{
+    int res = 0, nstarted = 0;
+
+    struct process   *procs[KSH_PIPELINE_MAX]       = {};
+    struct file       pipe_rd[KSH_PIPELINE_MAX - 1] = {};
+    struct file       pipe_wr[KSH_PIPELINE_MAX - 1] = {};
+    struct kshell_job fgjob                         = {};
+
+    struct kshell_job *job = background ? kshell_job_alloc(sh) : &fgjob;
+    res                    = job ? 0 : -EBUSY;
+    reporterr(sh, res, "job table full\n");
+    if (res < 0) return res;
+    *job = (struct kshell_job){};
+
+    /* Load every program before starting any, so that a typo does not leave
+     * half a pipeline running. */
+    for (int i = 0; i < ncmds; i++) {
+        struct process *p = process_alloc();
+        res               = p ? 0 : -EBUSY;
+        reporterr(sh, res, "no free process slots\n");
+        if (res < 0) goto exit;
+
+        res = process_load_path(p, bindirs[i], cmds[i].argv[0]);
+        reporterr(sh, res, "could not load %s\n", cmds[i].argv[0]);
+        if (res < 0) goto exit;
+        procs[i] = p;
+    }
+
+    /* Connect the programs. */
+    for (int i = 0; i < ncmds - 1; i++) {
+        res = pipe_open(&pipe_rd[i], &pipe_wr[i]);
+        reporterr(sh, res, "could not create pipe\n");
+        if (res < 0) goto exit;
+    }
+    for (int i = 0; i < ncmds; i++) {
+        struct file *in  = i > 0 ? &pipe_rd[i - 1] : sh->in;
+        struct file *out = i < ncmds - 1 ? &pipe_wr[i] : sh->out;
+        res              = process_set_fd(procs[i], 0, in);
+        if (res >= 0) res = process_set_fd(procs[i], 1, out);
+        if (res >= 0) res = process_set_fd(procs[i], 2, sh->err);
+        reporterr(sh, res, "could not set up files for %s\n", cmds[i].argv[0]);
+        if (res < 0) goto exit;
+    }
+
+    /* Fill in the job before starting anything, since a background process
+     * may exit, and be reaped, as soon as it starts. */
+    for (int i = 0; i < ncmds; i++) {
+        job->pids[i] = procs[i]->pid;
+        if (!background) continue;
+        procs[i]->exit_fn  = kshell_job_exited;
+        procs[i]->exit_arg = job;
+    }
+    job->pid    = procs[ncmds - 1]->pid;
+    job->nprocs = job->nlive = ncmds;
+
+    /* Start them. */
+    for (int i = 0; i < ncmds; i++) {
+        res = process_start(procs[i], cmds[i].argc, cmds[i].argv);
+        reporterr(sh, res, "could not start %s\n", cmds[i].argv[0]);
+        if (res < 0) goto exit;
+        procs[i] = NULL;
+        nstarted++;
+    }
+
+exit:
+    /* The processes hold their own references to the pipes. Dropping ours
+     * lets readers see end-of-file when their writer exits. */
+    for (int i = 0; i < ncmds - 1; i++) {
+        file_close(&pipe_rd[i]);
+        file_close(&pipe_wr[i]);
+    }
+    for (int i = 0; i < ncmds; i++) {
+        if (!procs[i]) continue;
+        if (i < job->nprocs) kshell_job_drop(job, i);
+        process_close(procs[i]);
+    }
+
+    /* Whatever was started is now a job. */
+    if (!nstarted) return res;
+    if (background) {
+        int lastcmd = ncmds - 1;
+        int argc    = cmds[lastcmd].argv + cmds[lastcmd].argc - cmds[0].argv;
+        kshell_job_setcmd(job, argc, cmds[0].argv);
+        file_printf(
+                sh->out, "[%d] %d\n", kshell_job_no(sh, job), job->pid
+        );
+        return res;
+    }
+
+    kshell_job_reap(job);
+    return res < 0 ? res : job->status;
+}
+
+/** Open a file for command output, creating it or emptying it */
+static int
+kshell_open_output(struct kshell *sh, const char *path, struct file *f)
+{
+    int res = file_create(sh->cwd, path, DT_REG);
+    if (res == -EEXIST) res = 0;
+    if (res >= 0) res = file_open_path(f, sh->cwd, path);
+    if (res < 0) return res;
+
+    res = file_truncate(f, 0);
+    if (res < 0) file_close(f);
+    return res;
+}
+
 int kshell_read_exec(struct kshell *sh)
 {
     int res;
 
     if (!sh->waiting_for_input) {
+        /* Report jobs that finished since the last prompt. */
+        kshell_report_jobs(sh);
+
         /* Show prompt. */
         file_printf(sh->out, "> ");
         sh->waiting_for_input = 1;
@@ -395,40 +823,89 @@ int kshell_read_exec(struct kshell *sh)
     if (argc < 0) return argc;
     if (argc == 0) return -EAGAIN;
 
-    /* Search for builtin command. */
+    /* A trailing "&" runs the command in the background. */
+    bool   background = false;
+    char  *lastarg    = argv[argc - 1];
+    size_t lastlen    = strlen(lastarg);
+    if (lastarg[lastlen - 1] == '&') {
+        background           = true;
+        lastarg[lastlen - 1] = '\0';
+        if (lastlen == 1) argc--;
+        if (argc == 0) return -EAGAIN;
+    }
+
+    /* A trailing "> FILE" sends the output to a file instead. */
+    const char *outpath = NULL;
+    if (argc >= 3 && strcmp(argv[argc - 2], ">") == 0) {
+        outpath = argv[argc - 1];
+        argc -= 2;
+    }
+
+    /* Split into pipeline. */
+    struct sh_cmd cmds[KSH_PIPELINE_MAX];
+    int           ncmds =
+            sh_split_pipeline(argc, argv, cmds, KSH_PIPELINE_MAX);
+    reporterr(sh, ncmds, "could not parse pipeline\n");
+    if (ncmds < 0) return -EAGAIN;
+
+    /* Redirect output for the duration of the command. */
+    struct file  outfile;
+    struct file *shout = sh->out;
+    if (outpath) {
+        res = kshell_open_output(sh, outpath, &outfile);
+        reporterr(sh, res, "could not open %s for output\n", outpath);
+        if (res < 0) return -EAGAIN;
+        sh->out = &outfile;
+    }
+
+    /* Search for builtin command. Builtins cannot be part of a pipeline. */
     shcmd_fn *cmd = kshell_search_builtins(KSH_CMDS, argv[0]);
-    if (cmd) {
+    if (cmd && ncmds == 1) {
+        res = background ? -EINVAL : 0;
+        reporterr(sh, res, "%s: builtins cannot run with &\n", argv[0]);
+        if (res < 0) goto exit;
         res = cmd(sh, argc, argv);
         reporterr(sh, res, "%s exited with code %d\n", argv[0], res);
-        return -EAGAIN;
+        goto exit;
     }
 
-    /* Search for executable. */
-    const char *bindir = kshell_search_bin(sh, argv[0]);
-    if (bindir) {
-        struct process *p = process_alloc();
-        res               = process_load_path(p, bindir, argv[0]);
-        reporterr(sh, res, "could not load %s\n", argv[0]);
-        res = process_start(p, argc, argv);
-        reporterr(sh, res, "%s exited with code %d\n", argv[0], res);
-        process_close(p);
-        return -EAGAIN;
+    /* Search for executables. */
+    const char *bindirs[KSH_PIPELINE_MAX];
+    for (int i = 0; i < ncmds; i++) {
+        bindirs[i] = kshell_search_bin(sh, cmds[i].argv[0]);
+        if (bindirs[i]) continue;
+
+        /* Not found. */
+        file_printf(
+                sh->err, SH_PREFIX "unknown or program: %s\n", cmds[i].argv[0]
+        );
+        print_cmds(sh->err, KSH_CMDS);
+        goto exit;
     }
 
-    /* Not found. */
-    file_printf(sh->err, SH_PREFIX "unknown or program: %s\n", argv[0]);
-    print_cmds(sh->err, KSH_CMDS);
+    res = kshell_exec(sh, ncmds, cmds, bindirs, background);
+    reporterr(sh, res, "%s exited with code %d\n", argv[0], res);
+
+exit:
+    /* Programs hold their own reference to the output file. */
+    if (outpath) {
+        file_close(&outfile);
+        sh->out = shout;
+    }
     return -EAGAIN;
 }
 
 int kshell_run(struct kshell *sh)
 {
-    for (;;) {
-        int res = kshell_read_exec(sh);
-        if (res == -EAGAIN) continue;
-        if (res < 0) return res;
-        if (res == 0) return 0; // End of file.
-    }
+    int res;
+    do {
+        unsigned irqs = irq_count();
+        res           = kshell_read_exec(sh);
+        if (res == -EAGAIN && sh->waiting_for_input) irq_wait(irqs);
+    } while (res == -EAGAIN || res > 0); // Stop at end of file or error.
+
+    kshell_detach_jobs(sh);
+    return res;
 }
 
 int kshell_init_run(void)
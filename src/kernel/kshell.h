@@ -3,10 +3,33 @@
 
 #include <drivers/vfs.h>
 
+#include <core/types.h>
+
+#define KSH_JOBS_MAX     8  ///< Max background jobs per shell
+#define KSH_JOBCMD_MAX   64 ///< Max length of a job's command text
+#define KSH_PIPELINE_MAX 4  ///< Max commands in a pipeline
+
+/**
+ * A pipeline of processes, possibly started in the background with "&"
+ *
+ * Background processes are reaped as they exit (see process.exit_fn), and
+ * the finished job is reported before the next prompt.
+ */
+struct kshell_job {
+    pid_t pids[KSH_PIPELINE_MAX]; ///< Process IDs, 0 once reaped
+    pid_t pid;                    ///< Shown for the job: the last process's
+    int   nprocs;                 ///< Processes in the pipeline
+    int   nlive;                  ///< Not yet reaped
+    int   notify;                 ///< Finished, not yet reported
+    int   status;                 ///< Exit status of the last process
+    char  cmd[KSH_JOBCMD_MAX];    ///< Command line, for listing
+};
+
 struct kshell {
-    struct file *in, *out, *err;
-    char         cwd[PATH_MAX];
-    int          waiting_for_input;
+    struct file      *in, *out, *err;
+    char              cwd[PATH_MAX];
+    int               waiting_for_input;
+    struct kshell_job jobs[KSH_JOBS_MAX];
 };
 
 int kshell_init_tty(struct kshell *sh, struct file *tty);
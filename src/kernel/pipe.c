@@ -0,0 +1,189 @@
+/**
+ * @file
+ * Pipes: one-page ring buffers between a writer and a reader
+ *
+ * The ring indexes run freely and are masked on access, so the fill level
+ * is always `head - tail`, and a full ring is not confused with an empty
+ * one. Data is copied straight between the caller's buffer and the ring,
+ * in at most two pieces when it wraps, with no staging buffer in between.
+ *
+ * Each end is a separate @ref file with its own operations. Ends may be
+ * shared with @ref file_dup, and the pipe stays open until every reference
+ * to both ends has been closed. Readers see end-of-file once the last
+ * writer is gone, and writers get -EPIPE once the last reader is gone.
+ */
+#include "pipe.h"
+
+#include "sched.h"
+
+#include <cpu_interrupt.h>
+#include <cpu_pagemap.h>
+
+#include <core/compiler.h>
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+
+#define PIPE_BUFSZ PAGESZ ///< Ring size; must be a power of two
+
+struct pipe {
+    char         buf[PIPE_BUFSZ]; ///< Ring storage, first for alignment
+    unsigned     head;            ///< Total bytes written
+    unsigned     tail;            ///< Total bytes read
+    int          readers;         ///< Open references to the read end
+    int          writers;         ///< Open references to the write end
+    struct waitq rwait;           ///< Readers waiting for data
+    struct waitq wwait;           ///< Writers waiting for space
+};
+
+static ATTR_ALIGNED(PAGESZ) struct pipe pipes[PIPE_MAX];
+
+static const struct file_operations pipe_rd_ops;
+static const struct file_operations pipe_wr_ops;
+
+static inline unsigned pipe_used(struct pipe *pp)
+{
+    return pp->head - pp->tail;
+}
+
+static ssize_t pipe_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    UNUSED(off);
+    struct pipe *pp = f->f_driver_data;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    /* Wait for data, unless all writers are gone. */
+    while (!pipe_used(pp) && pp->writers) waitq_wait(&pp->rwait);
+
+    size_t   n     = MIN(count, pipe_used(pp));
+    unsigned start = pp->tail & (PIPE_BUFSZ - 1);
+    size_t   first = MIN(n, PIPE_BUFSZ - start);
+    memcpy(dst, pp->buf + start, first);
+    memcpy((char *) dst + first, pp->buf, n - first);
+    pp->tail += n;
+
+    if (n) waitq_wake_all(&pp->wwait);
+    intr_setenabled(intrs_enabled);
+    return n;
+}
+
+static ssize_t
+pipe_write(struct file *f, const void *src, size_t count, loff_t *off)
+{
+    UNUSED(off);
+    struct pipe *pp   = f->f_driver_data;
+    size_t       done = 0;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    while (done < count) {
+        if (!pp->readers) break;
+        if (pipe_used(pp) == PIPE_BUFSZ) {
+            waitq_wait(&pp->wwait);
+            continue;
+        }
+
+        size_t   n     = MIN(count - done, PIPE_BUFSZ - pipe_used(pp));
+        unsigned start = pp->head & (PIPE_BUFSZ - 1);
+        size_t   first = MIN(n, PIPE_BUFSZ - start);
+        memcpy(pp->buf + start, (const char *) src + done, first);
+        memcpy(pp->buf, (const char *) src + done + first, n - first);
+        pp->head += n;
+        done += n;
+        waitq_wake_all(&pp->rwait);
+    }
+
+    intr_setenabled(intrs_enabled);
+    if (!done && count) return -EPIPE;
+    return done;
+}
+
+static int pipe_rd_dup(struct file *f)
+{
+    struct pipe *pp = f->f_driver_data;
+    pp->readers++;
+    return 0;
+}
+
+static int pipe_wr_dup(struct file *f)
+{
+    struct pipe *pp = f->f_driver_data;
+    pp->writers++;
+    return 0;
+}
+
+static int pipe_rd_release(struct file *f)
+{
+    struct pipe *pp = f->f_driver_data;
+    pp->readers--;
+    waitq_wake_all(&pp->wwait); // Writers may now get EPIPE.
+    f->f_op = NULL;
+    return 0;
+}
+
+static int pipe_wr_release(struct file *f)
+{
+    struct pipe *pp = f->f_driver_data;
+    pp->writers--;
+    waitq_wake_all(&pp->rwait); // Readers may now get EOF.
+    f->f_op = NULL;
+    return 0;
+}
+
+static int pipe_debugstr(char *descbuf, size_t n, struct file *f)
+{
+    struct pipe *pp = f->f_driver_data;
+    char         rw = f->f_op == &pipe_rd_ops ? 'r' : 'w';
+    return snprintf(descbuf, n, "pipe%d:%c", (int) (pp - pipes), rw);
+}
+
+static const struct file_operations pipe_rd_ops = {
+        .name     = "pipe",
+        .release  = pipe_rd_release,
+        .dup      = pipe_rd_dup,
+        .debugstr = pipe_debugstr,
+        .read     = pipe_read,
+};
+
+static const struct file_operations pipe_wr_ops = {
+        .name     = "pipe",
+        .release  = pipe_wr_release,
+        .dup      = pipe_wr_dup,
+        .debugstr = pipe_debugstr,
+        .write    = pipe_write,
+};
+
+/**
+ * Create a pipe
+ *
+ * @param rd    [output] Read end
+ * @param wr    [output] Write end
+ */
+int pipe_open(struct file *rd, struct file *wr)
+{
+    struct pipe *pp = NULL;
+    for (int i = 0; i < PIPE_MAX && !pp; i++)
+        if (!pipes[i].readers && !pipes[i].writers) pp = &pipes[i];
+    if (!pp) return -ENFILE;
+
+    pp->head    = pp->tail = 0;
+    pp->readers = pp->writers = 1;
+    waitq_init(&pp->rwait);
+    waitq_init(&pp->wwait);
+
+    *rd = (struct file){
+            .f_stat        = {.f_type = DT_FIFO},
+            .f_op          = &pipe_rd_ops,
+            .f_driver_data = pp,
+    };
+    *wr = (struct file){
+            .f_stat        = {.f_type = DT_FIFO},
+            .f_op          = &pipe_wr_ops,
+            .f_driver_data = pp,
+    };
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef KERNEL_PIPE_H
+#define KERNEL_PIPE_H
+
+#include <drivers/vfs.h>
+
+#define PIPE_MAX 8 ///< Max pipes open at once
+
+int pipe_open(struct file *rd, struct file *wr);
+
+#endif /* KERNEL_PIPE_H */
@@ -1,10 +1,15 @@
 #define LOG_LEVEL LOG_DEBUG
 
 #include "process.h"
+#include "aio.h"
+#include "clock.h"
 #include "kernel.h"
+#include "sched.h"
 
 #include <abi.h>
 #include <cpu.h>
+#include <cpu_interrupt.h>
+#include <cpu_pagemap.h>
 
 #include <drivers/fileformat/elf.h>
 #include <drivers/log.h>
@@ -17,14 +22,91 @@
 #include <core/sprintf.h>
 #include <core/string.h>
 
-#define PROCESS_MAX 8
+#define PROCESS_SEGS_MAX 8 ///< Max loadable segments in an executable
 static struct process pcb[PROCESS_MAX];
 static pid_t          next_pid = 1;
 
+/** Tasks waiting for some process to exit */
+static struct waitq exit_waitq = WAITQ_INIT(exit_waitq);
+
+/**
+ * Claim a free process slot and give it a new PID
+ *
+ * Any task may spawn, so the slot is claimed with interrupts disabled. It
+ * stays claimed until it is loaded and later freed, or until loading fails.
+ */
 struct process *process_alloc(void)
+{
+    struct process *p = NULL;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    for (int i = 0; i < PROCESS_MAX && !p; i++)
+        if (!pcb[i].pid) p = &pcb[i];
+    if (p) *p = (struct process){.pid = next_pid++};
+    intr_setenabled(intrs_enabled);
+    return p;
+}
+
+struct process *process_find(pid_t pid)
 {
     for (int i = 0; i < PROCESS_MAX; i++)
-        if (!pcb[i].pid) return &pcb[i];
+        if (pid && pcb[i].pid == pid) return &pcb[i];
+    return NULL;
+}
+
+/** The process in table slot i, or NULL if the slot is unused */
+struct process *process_slot(int i)
+{
+    if (i < 0 || PROCESS_MAX <= i || !pcb[i].pid) return NULL;
+    return &pcb[i];
+}
+
+/** One-letter state, as shown by ps */
+char process_state_char(const struct process *p)
+{
+    switch (p->state) {
+    case PROC_LOADED: return 'L';
+    case PROC_RUNNING: return 'R';
+    case PROC_ZOMBIE: return 'Z';
+    default: return '?';
+    }
+}
+
+/**
+ * Find the memory range that a process image will occupy
+ *
+ * There is no per-process address space yet, so every image is loaded at its
+ * link address. Two processes linked at the same address cannot both be
+ * resident, and loading one would overwrite the other while it runs.
+ */
+static int process_image_range(struct process *p, Elf32_Ehdr *ehdr)
+{
+    int res;
+
+    p->img_start = UINTPTR_MAX;
+    p->img_end   = 0;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        Elf32_Phdr phdr;
+        res = elf_read_phdr32(&p->execfile, ehdr, i, &phdr);
+        if (res < 0) return res;
+        if (phdr.p_type != PT_LOAD) continue;
+        p->img_start = MIN(p->img_start, phdr.p_vaddr);
+        p->img_end   = MAX(p->img_end, phdr.p_vaddr + phdr.p_memsz);
+    }
+    return 0;
+}
+
+/** Is another live process occupying memory that overlaps p's image? */
+static struct process *process_image_conflict(struct process *p)
+{
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        struct process *other = &pcb[i];
+        if (other == p || !other->pid || other->state == PROC_ZOMBIE)
+            continue;
+        if (p->img_start < other->img_end && other->img_start < p->img_end)
+            return other;
+    }
     return NULL;
 }
 
@@ -32,8 +114,9 @@ int process_load_path(struct process *p, const char *cwd, const char *path)
 {
     int res, file_isopen = 0;
 
-    /* Reset struct. */
-    *p = (struct process){.pid = next_pid++};
+    /* Reset struct, keeping the PID from process_alloc. */
+    pid_t pid = p->pid;
+    *p        = (struct process){.pid = pid};
     path_basename(p->name, DEBUGSTR_MAX, path);
 
     /* Open file. */
@@ -47,7 +130,20 @@ int process_load_path(struct process *p, const char *cwd, const char *path)
     if (res < 0) goto error;
     p->start_addr = ehdr.e_entry;
 
-    /* Load segments. */
+    /* Make sure we will not overwrite a running process. */
+    res = process_image_range(p, &ehdr);
+    if (res < 0) goto error;
+    struct process *conflict = process_image_conflict(p);
+    res                      = conflict ? -EBUSY : 0;
+    log_result(
+            res, "check that %s does not overlap %s\n", p->name,
+            conflict ? conflict->name : "running processes"
+    );
+    if (res < 0) goto error;
+
+    /* Find the segments to load. */
+    Elf32_Phdr segs[PROCESS_SEGS_MAX];
+    int        nsegs = 0;
     for (int i = 0; i < ehdr.e_phnum; i++) {
         Elf32_Phdr phdr;
         res = elf_read_phdr32(&p->execfile, &ehdr, i, &phdr);
@@ -61,52 +157,122 @@ int process_load_path(struct process *p, const char *cwd, const char *path)
             res = -EINVAL;
             goto error;
         }
+        if (nsegs == PROCESS_SEGS_MAX) {
+            res = -ENOEXEC;
+            goto error;
+        }
+        segs[nsegs++] = phdr;
+    }
 
-        /* cast the address to the ELF segment so the kernel can write bytes into it */
-        uint8_t *dst = (uint8_t *)(uintptr_t)phdr.p_vaddr;
-
-        /* reads bytes from p_files and offset from p_offset and stores it in dst */
-        size_t size   = phdr.p_filesz;
-        loff_t offset = phdr.p_offset;
+    /* Start reading every segment at once, and zero the memory past each
+     * segment's file data while the reads are under way. Files in memory,
+     * such as those on the initrd, are copied at once instead. */
+    struct file_aio reads[PROCESS_SEGS_MAX];
+    int             nreads = 0;
+    for (int i = 0; i < nsegs; i++) {
+        uint8_t *dst = (uint8_t *) (uintptr_t) segs[i].p_vaddr;
 
-        ssize_t n = file_pread(&p->execfile, dst, size, offset);
+        reads[i] = (struct file_aio){
+                .op    = AIO_READ,
+                .file  = &p->execfile,
+                .buf   = dst,
+                .count = segs[i].p_filesz,
+                .off   = segs[i].p_offset,
+        };
+        res = aio_submit(&reads[i]);
+        if (res < 0) break;
+        nreads++;
 
-        /* error handling for read failure and short read */
-        if (n < 0) {
-            res = (int)n;
-            goto error;
-        }
-        if ((size_t)n != (size_t)phdr.p_filesz) {
-            res = -EIO;
-            goto error;
+        if (segs[i].p_memsz > segs[i].p_filesz) {
+            memset(dst + segs[i].p_filesz, 0,
+                   (size_t) (segs[i].p_memsz - segs[i].p_filesz));
         }
+    }
 
-        /* Zeroes the remaining bytes */
-        if (phdr.p_memsz > phdr.p_filesz) {
-            memset(dst + phdr.p_filesz, 0,
-                   (size_t)(phdr.p_memsz - phdr.p_filesz));
-        }
+    /* Wait for every read that was started, even after an error, since
+     * they are using this stack frame. */
+    for (int i = 0; i < nreads; i++) {
+        aio_wait(&reads[i]);
+        if (res < 0) continue;
+        if (reads[i].res < 0) res = reads[i].res;
+        else if ((size_t) reads[i].res != reads[i].count) res = -EIO;
     }
+    if (res < 0) goto error;
 
+    p->acct.rss_pages = (ALIGN_UP(p->img_end, PAGESZ)
+                         - ALIGN_DOWN(p->img_start, PAGESZ))
+                        / PAGESZ;
+    p->state = PROC_LOADED;
     return 0;
 
 error:
     if (file_isopen) file_close(&p->execfile);
+    *p = (struct process){};
     return res;
 }
 
+/**
+ * Install a reference to an open file as one of a process's descriptors
+ *
+ * The process gets its own reference, so the caller may close theirs.
+ */
+int process_set_fd(struct process *p, int fd, struct file *f)
+{
+    if (fd < 0 || FD_MAX <= fd) return -EBADF;
+    file_close(&p->fds[fd]);
+    p->fds[fd] = (struct file){};
+    return f ? file_dup(&p->fds[fd], f) : 0;
+}
+
+/** Look up an open file descriptor */
+struct file *process_get_fd(struct process *p, int fd)
+{
+    if (!p || fd < 0 || FD_MAX <= fd || !p->fds[fd].f_op) return NULL;
+    return &p->fds[fd];
+}
+
+static void process_close_fds(struct process *p)
+{
+    for (int fd = 0; fd < FD_MAX; fd++) {
+        file_close(&p->fds[fd]);
+        p->fds[fd] = (struct file){};
+    }
+}
+
 void process_close(struct process *p)
 {
-    file_close(&p->execfile);
+    if (p->state == PROC_LOADED || p->state == PROC_RUNNING)
+        file_close(&p->execfile);
+    process_close_fds(p);
     *p = (struct process){};
 }
 
+/** Copy arguments into the process so that they outlive the caller's */
+static int process_copy_args(struct process *p, int argc, char *argv[])
+{
+    if (argc > PROCESS_ARGV_MAX) return -E2BIG;
+
+    char *pos = p->argbuf, *end = p->argbuf + PROCESS_ARGBUF_SZ;
+    for (int i = 0; i < argc; i++) {
+        size_t len = strlen(argv[i]) + 1;
+        if (len > (size_t) (end - pos)) return -E2BIG;
+        memcpy(pos, argv[i], len);
+        p->argv[i] = pos;
+        pos += len;
+    }
+    p->argv[argc] = NULL;
+    p->argc       = argc;
+    return 0;
+}
+
 enum start_strategy {
     PSTART_CALL,
 };
 
-int process_start(struct process *p, int argc, char *argv[])
+/** Body of a process's task */
+static void process_main(void *arg)
 {
+    struct process     *p           = arg;
     enum start_strategy start_strat = PSTART_CALL;
 
     switch (start_strat) {
@@ -115,10 +281,191 @@ int process_start(struct process *p, int argc, char *argv[])
         typedef int (*entry_fn_t)(int argc, char **argv);
         entry_fn_t entry = (entry_fn_t)(uintptr_t)p->start_addr;
 
-        (void)entry(argc, argv);
-        return 0;
+        process_exit(entry(p->argc, p->argv));
+    }
     }
+
+    process_exit(-ENOTSUP);
+}
+
+/**
+ * Start a loaded process in its own task
+ *
+ * Returns as soon as the process is runnable. Use @ref process_wait to wait
+ * for it to finish and collect its exit status.
+ */
+int process_start(struct process *p, int argc, char *argv[])
+{
+    int res;
+
+    res = p->state == PROC_LOADED ? 0 : -EINVAL;
+    if (res < 0) return res;
+
+    res = process_copy_args(p, argc, argv);
+    if (res < 0) return res;
+
+    /* Keep the new task from running before it knows its process. */
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    p->task = task_create(p->name, process_main, p, 1);
+    if (p->task) {
+        p->task->process = p;
+        p->state         = PROC_RUNNING;
     }
+    intr_setenabled(intrs_enabled);
+
+    res = p->task ? 0 : -ENOMEM;
+    log_result(res, "start process %d (%s)\n", p->pid, p->name);
+    return res;
+}
+
+/**
+ * Load and start a program in one step
+ *
+ * The image is loaded straight from the ELF file into place, and the child
+ * gets its own references to the given files. If called from a process,
+ * that process becomes the child's parent.
+ *
+ * @param path  Program to run, relative to the root directory
+ * @param argv  NULL-terminated arguments
+ * @param fds   Files for the child's descriptors 0 to n-1; NULL means closed
+ * @param n     Number of entries in fds
+ *
+ * @returns the child's PID, or a negative error code.
+ */
+int process_spawn(const char *path, char *argv[], struct file *fds[], int n)
+{
+    int res;
+
+    int argc = 0;
+    while (argv && argv[argc]) argc++;
+
+    res = 0 <= n && n <= FD_MAX ? 0 : -EBADF;
+    if (res < 0) return res;
+
+    struct process *p = process_alloc();
+    res               = p ? 0 : -EAGAIN;
+    if (res < 0) return res;
+
+    res = process_load_path(p, "/", path);
+    if (res < 0) return res;
+
+    for (int fd = 0; fd < n && res >= 0; fd++)
+        res = process_set_fd(p, fd, fds[fd]);
+    if (res < 0) goto error;
 
-    return -ENOTSUP;
+    p->ppid = current_process ? current_process->pid : 0;
+    res     = process_start(p, argc, argv);
+    if (res < 0) goto error;
+    return p->pid;
+
+error:
+    process_close(p);
+    return res;
 }
+
+/** End the current process and wake anyone waiting for it */
+noreturn void process_exit(int status)
+{
+    struct process *p = current_process;
+
+    intr_setenabled(0);
+    process_acct_switch(p, NULL);
+    pr_debug(
+            "process %d (%s) exited with status %d\n", p->pid, p->name, status
+    );
+    file_close(&p->execfile);
+    process_close_fds(p);
+    p->exit_status        = status;
+    p->state              = PROC_ZOMBIE;
+    current_task->process = NULL;
+
+    /* Nobody will wait for our children now. Free those that have already
+     * exited, and have the rest free themselves. */
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        struct process *child = &pcb[i];
+        if (!child->pid || child->ppid != p->pid) continue;
+        if (child->state == PROC_ZOMBIE) *child = (struct process){};
+        else child->autoreap = 1;
+    }
+
+    /* Whoever set exit_fn takes the status now, instead of waiting. */
+    if (p->exit_fn) p->exit_fn(p, p->exit_arg);
+    if (p->exit_fn || p->autoreap) *p = (struct process){};
+
+    waitq_wake_all(&exit_waitq);
+    task_exit();
+}
+
+/**
+ * Reap an exited process
+ *
+ * @param pid       Process to wait for
+ * @param status    [output] Exit status of the process
+ * @param nohang    If set, return right away if the process is still running
+ *
+ * @returns pid once the process has been reaped, 0 if it is still running
+ *          and nohang is set, or -ECHILD if there is no such process.
+ */
+int process_wait(pid_t pid, int *status, int nohang)
+{
+    int res;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    for (;;) {
+        struct process *p = process_find(pid);
+        if (!p) {
+            res = -ECHILD;
+            break;
+        }
+        if (p->state == PROC_ZOMBIE) {
+            if (status) *status = p->exit_status;
+            *p  = (struct process){};
+            res = pid;
+            break;
+        }
+        if (nohang) {
+            res = 0;
+            break;
+        }
+        waitq_wait(&exit_waitq);
+    }
+    intr_setenabled(intrs_enabled);
+    return res;
+}
+
+/** @name Accounting */
+///@{
+
+/** Charge the cycles since the last charge to the current mode */
+static void process_acct_charge(struct process *p)
+{
+    uint64_t now = clock_cycles();
+    if (p->acct_since) {
+        if (p->acct_kmode) p->acct.stime_cycles += now - p->acct_since;
+        else p->acct.utime_cycles += now - p->acct_since;
+    }
+    p->acct_since = now;
+}
+
+/**
+ * Note a task switch; either process may be NULL for a kernel task
+ *
+ * The process leaving the CPU is charged for its time on it, and the time
+ * of the one arriving is counted from now.
+ */
+void process_acct_switch(struct process *prev, struct process *next)
+{
+    if (prev) process_acct_charge(prev);
+    if (next) next->acct_since = clock_cycles();
+}
+
+/** Note entry into (kmode = 1) or return from (kmode = 0) a syscall */
+void process_acct_mode(struct process *p, int kmode)
+{
+    process_acct_charge(p);
+    p->acct_kmode = kmode;
+}
+
+///@}
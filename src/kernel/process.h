@@ -1,6 +1,8 @@
 #ifndef PROCESS_H
 #define PROCESS_H
 
+#include "sched.h"
+
 #include <abi.h>
 
 #include <drivers/vfs.h>
@@ -8,21 +10,84 @@
 #include <core/types.h>
 
 #include <stdint.h>
+#include <stdnoreturn.h>
+
+#define FD_MAX      4
+#define PROCESS_MAX 8 ///< Max processes, including zombies
+
+#define PROCESS_ARGV_MAX  16  ///< Max arguments passed to a process
+#define PROCESS_ARGBUF_SZ 256 ///< Space for a process's argument strings
+
+enum process_state {
+    PROC_FREE = 0, ///< Slot unused, or claimed and not yet loaded
+    PROC_LOADED,   ///< Image loaded, not yet started
+    PROC_RUNNING,  ///< Started and has not exited
+    PROC_ZOMBIE,   ///< Exited, waiting to be reaped with @ref process_wait
+};
+
+/** What a process has cost so far, shown in /proc/PID/stat and by ps */
+struct process_acct {
+    uint64_t utime_cycles; ///< CPU cycles spent running the program
+    uint64_t stime_cycles; ///< CPU cycles spent in syscalls on its behalf
+    unsigned syscalls;     ///< Syscalls made
+    unsigned minflt;       ///< Page faults served without I/O
+    unsigned majflt;       ///< Page faults that needed I/O or were fatal
+    unsigned rss_pages;    ///< Resident pages: the loaded image
+    uint64_t rchar;        ///< Bytes read through syscalls
+    uint64_t wchar;        ///< Bytes written through syscalls
+};
 
-#define FD_MAX 4
+struct process;
+
+/** Takes a process's exit status as it exits; see @ref process.exit_fn */
+typedef void process_exit_fn(struct process *p, void *arg);
 
 struct process {
     struct file execfile;
     char        name[DEBUGSTR_MAX];
 
     pid_t     pid;
+    pid_t     ppid; ///< Parent that will reap us, or 0 for the kernel shell
     uintptr_t start_addr;
 
+    enum process_state state;
+    int                exit_status;
+    int                autoreap;  ///< Parent is gone; free slot on exit
+    process_exit_fn   *exit_fn;   ///< Reaps at exit, interrupts disabled
+    void              *exit_arg;  ///< Passed to exit_fn
+    struct task       *task;      ///< Task the process runs in
+    uintptr_t          img_start; ///< Lowest address of loaded image
+    uintptr_t          img_end;   ///< One past highest address of image
+
+    struct file fds[FD_MAX]; ///< Open files by descriptor; closed if no f_op
+
+    struct process_acct acct;
+    uint64_t            acct_since; ///< Cycle count when last charged
+    int                 acct_kmode; ///< In a syscall: charge time to stime
+
+    /* Copies of the arguments, since the caller's may not outlive us. */
+    int   argc;
+    char *argv[PROCESS_ARGV_MAX + 1];
+    char  argbuf[PROCESS_ARGBUF_SZ];
 };
 
+/** The process running in the current task, or NULL if it is a kernel task */
+#define current_process (current_task->process)
+
 struct process *process_alloc(void);
+struct process *process_find(pid_t pid);
+struct process *process_slot(int i);
+char            process_state_char(const struct process *p);
 int  process_load_path(struct process *p, const char *cwd, const char *path);
+int  process_set_fd(struct process *p, int fd, struct file *f);
+struct file *process_get_fd(struct process *p, int fd);
 int  process_start(struct process *p, int argc, char *argv[]);
+int  process_spawn(const char *path, char *argv[], struct file *fds[], int n);
+int  process_wait(pid_t pid, int *status, int nohang);
 void process_close(struct process *p);
+noreturn void process_exit(int status);
+
+void process_acct_switch(struct process *prev, struct process *next);
+void process_acct_mode(struct process *p, int kmode);
 
 #endif /* PROCESS_H */
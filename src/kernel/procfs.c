@@ -0,0 +1,208 @@
+/**
+ * @file
+ * procfs: a read-only view of the process table
+ *
+ * The root lists a directory per process, named by PID. Each holds a
+ * `stat` file with one line, formatted when read:
+ *
+ *     pid (name) state ppid utime stime syscalls minflt majflt rss rchar wchar
+ *
+ * Times are CPU cycles, rss is in pages, and rchar and wchar are bytes; see
+ * @ref process_acct. Like sysfs counters, stat files report a size of 0, so
+ * read them to end of file.
+ */
+#include "procfs.h"
+
+#include "process.h"
+
+#include <drivers/devices.h>
+#include <drivers/vfs.h>
+
+#include <core/ctype.h>
+#include <core/errno.h>
+#include <core/inttypes.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+
+#define PROCFS_STAT_MAX 160 ///< Longest stat line
+
+/** @name Inode numbers */
+///@{
+#define PROCFS_INO_ROOT      1
+#define PROCFS_INO_DIR(pid)  (2 * (pid) + 2)
+#define PROCFS_INO_STAT(pid) (2 * (pid) + 3)
+///@}
+
+static int procfs_stat_line(const struct process *p, char *buf, size_t n)
+{
+    const struct process_acct *a = &p->acct;
+    return snprintf(
+            buf, n,
+            "%d (%s) %c %d %" PRIu64 " %" PRIu64 " %u %u %u %u %" PRIu64
+            " %" PRIu64 "\n",
+            p->pid, p->name, process_state_char(p), p->ppid, a->utime_cycles,
+            a->stime_cycles, a->syscalls, a->minflt, a->majflt, a->rss_pages,
+            a->rchar, a->wchar
+    );
+}
+
+/** Parse a PID path component; 0 if it is not a number */
+static pid_t procfs_parse_pid(const char *s, size_t len)
+{
+    pid_t pid = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!isdigit(s[i]) || pid > 99999) return 0;
+        pid = pid * 10 + (s[i] - '0');
+    }
+    return pid;
+}
+
+/** Look up a path, giving its metadata and PID (0 for the root) */
+static int procfs_lookup(const char *path, struct fstat *fstat, pid_t *pid)
+{
+    *fstat = (struct fstat){.f_ino = PROCFS_INO_ROOT, .f_type = DT_DIR};
+    *pid   = 0;
+    if (!*path) return 0;
+
+    const char *slash = strchr(path, '/');
+    size_t      len   = slash ? (size_t) (slash - path) : strlen(path);
+    *pid              = procfs_parse_pid(path, len);
+    if (!*pid || !process_find(*pid)) return -ENOENT;
+    fstat->f_ino = PROCFS_INO_DIR(*pid);
+    if (!slash || !slash[1]) return 0;
+
+    if (strcmp(slash + 1, "stat") != 0) return -ENOENT;
+    fstat->f_ino  = PROCFS_INO_STAT(*pid);
+    fstat->f_type = DT_REG;
+    return 0;
+}
+
+static int
+procfs_stat_path(struct fstat *fstat, struct superblock *sb, const char *path)
+{
+    UNUSED(sb);
+    pid_t pid;
+    return procfs_lookup(path, fstat, &pid);
+}
+
+static int
+procfs_open_path(struct file *f, struct superblock *sb, const char *path)
+{
+    UNUSED(sb);
+    pid_t pid;
+    int   res = procfs_lookup(path, &f->f_stat, &pid);
+    if (res < 0) return res;
+    f->f_driver_data = (void *) (uintptr_t) pid;
+    return 0;
+}
+
+static ssize_t
+procfs_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    if (f->f_stat.f_type != DT_REG) return -EISDIR;
+
+    /* The process may have been reaped since the file was opened. */
+    struct process *p = process_find((uintptr_t) f->f_driver_data);
+    if (!p) return -ENOENT;
+
+    char buf[PROCFS_STAT_MAX];
+    int  len = procfs_stat_line(p, buf, sizeof(buf));
+    if (len < 0) return len;
+    len = MIN(len, (int) sizeof(buf) - 1);
+
+    if (*off < 0) *off = 0;
+    if (*off >= len) return 0;
+    count = MIN(count, (size_t) (len - *off));
+    memcpy(dst, buf + *off, count);
+    *off += count;
+    return count;
+}
+
+/**
+ * The next position to list in a directory, or -1 at the end
+ *
+ * The root's position is a process table slot. A process directory has the
+ * single entry "stat" at position 0.
+ */
+static int procfs_dir_peek(struct file *f)
+{
+    if (f->f_driver_data) return f->f_pos == 0 ? 0 : -1;
+    for (int i = f->f_pos; i < PROCESS_MAX; i++)
+        if (process_slot(i)) return i;
+    return -1;
+}
+
+static void procfs_dir_entry(
+        struct file *f, int i, ino_t *ino, enum dirtype *type, char *name
+)
+{
+    pid_t pid = (uintptr_t) f->f_driver_data;
+    if (pid) {
+        *ino  = PROCFS_INO_STAT(pid);
+        *type = DT_REG;
+        snprintf(name, PATH_MAX, "stat");
+    } else {
+        pid   = process_slot(i)->pid;
+        *ino  = PROCFS_INO_DIR(pid);
+        *type = DT_DIR;
+        snprintf(name, PATH_MAX, "%d", pid);
+    }
+}
+
+static int procfs_readdir(struct file *f, struct dirent *d)
+{
+    if (f->f_stat.f_type != DT_DIR) return -ENOTDIR;
+    int i = procfs_dir_peek(f);
+    if (i < 0) return 0;
+    f->f_pos = i + 1;
+
+    enum dirtype type;
+    procfs_dir_entry(f, i, &d->d_ino, &type, d->d_name);
+    d->d_type = type;
+    return 1;
+}
+
+static ssize_t procfs_readdir_batch(struct file *f, void *buf, size_t size)
+{
+    if (f->f_stat.f_type != DT_DIR) return -ENOTDIR;
+
+    size_t used = 0;
+    int    i;
+    while ((i = procfs_dir_peek(f)) >= 0) {
+        ino_t        ino;
+        enum dirtype type;
+        char         name[PATH_MAX];
+        procfs_dir_entry(f, i, &ino, &type, name);
+        if (!dirent_rec_put(buf, size, &used, ino, type, name))
+            return used ? (ssize_t) used : -EINVAL;
+        f->f_pos = i + 1;
+    }
+    return used;
+}
+
+static int procfs_sb_open(struct superblock *sb)
+{
+    snprintf(sb->s_name, sizeof(sb->s_name), "procfs");
+    sb->s_root_ino = PROCFS_INO_ROOT;
+    return 0;
+}
+
+static const struct file_operations procfs_file_ops = {
+        .name      = "procfs_file",
+        .stat_path = procfs_stat_path,
+        .open_path = procfs_open_path,
+        .read      = procfs_read,
+        .readdir   = procfs_readdir,
+
+        .readdir_batch = procfs_readdir_batch,
+};
+
+static const struct fs_operations procfs_fs_ops = {
+        .name        = "procfs",
+        .sb_open     = procfs_sb_open,
+        .fs_file_ops = &procfs_file_ops,
+        .no_dcache   = 1, // Processes come and go without telling us.
+};
+
+int init_driver_procfs(void) { return fs_register(FS_PROC, &procfs_fs_ops); }
@@ -0,0 +1,6 @@
+#ifndef KERNEL_PROCFS_H
+#define KERNEL_PROCFS_H
+
+int init_driver_procfs(void);
+
+#endif /* KERNEL_PROCFS_H */
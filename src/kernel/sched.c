@@ -0,0 +1,247 @@
+/**
+ * @file
+ * Kernel tasks, run queue, and the idle task
+ *
+ * Tasks are switched cooperatively when they block or yield, and
+ * preemptible tasks are also switched when their time slice runs out.
+ * The time-slice timer is only armed while some other task is waiting on
+ * the run queue, so a lone task is never interrupted for nothing.
+ *
+ * When the run queue is empty, the idle task halts the CPU until the next
+ * interrupt. Since the timer is one-shot, that is the next device event or
+ * the next timer deadline, whichever comes first.
+ */
+#include "sched.h"
+
+#include "process.h"
+#include "timer.h"
+
+#include <cpu_context.h>
+#include <cpu_interrupt.h>
+
+#include <drivers/log.h>
+#include <drivers/sysfs.h>
+
+#include <core/compiler.h>
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/time.h>
+
+#define SCHED_QUANTUM_NS (10 * NSEC_PER_MSEC) ///< Time slice length
+
+static struct task tasks[TASK_MAX];
+static ATTR_ALIGNED(16) unsigned char kstacks[TASK_MAX][KSTACK_SIZE];
+
+struct task        *current_task;
+struct sched_stats  sched_stats;
+static struct task *idle_task;
+static LIST_HEAD(runqueue);
+
+static struct timer quantum_timer;
+static int          need_resched;
+
+/* === Switching === */
+
+static void quantum_expired(struct timer *t)
+{
+    UNUSED(t);
+    need_resched = 1;
+}
+
+/** Start a new time slice, but only if someone else is waiting to run */
+static void start_quantum(void)
+{
+    if (list_empty(&runqueue)) timer_cancel(&quantum_timer);
+    else timer_arm(&quantum_timer, timer_now() + SCHED_QUANTUM_NS);
+}
+
+/**
+ * Switch to the next runnable task
+ *
+ * Call with interrupts disabled. If the current task is still runnable, it
+ * goes to the back of the run queue.
+ */
+static void schedule(void)
+{
+    struct task *prev = current_task;
+    if (prev->state == TASK_RUNNABLE && prev != idle_task)
+        list_add_tail(&prev->link, &runqueue);
+
+    struct task *next = idle_task;
+    if (!list_empty(&runqueue))
+        next = list_shift_entry(&runqueue, struct task, link);
+
+    need_resched = 0;
+    start_quantum();
+    if (next == prev) return;
+
+    sched_stats.switches++;
+    process_acct_switch(prev->process, next->process);
+    current_task = next;
+    cpu_context_switch(&prev->sp, next->sp);
+}
+
+/** Put a task on the run queue */
+static void make_runnable(struct task *t)
+{
+    t->state = TASK_RUNNABLE;
+    list_add_tail(&t->link, &runqueue);
+    if (current_task == idle_task) need_resched = 1;
+    if (!quantum_timer.pending) start_quantum();
+}
+
+/** Give up the CPU to another runnable task, if there is one */
+void sched_yield(void)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    schedule();
+    intr_setenabled(intrs_enabled);
+}
+
+/**
+ * Switch tasks at the end of an interrupt if the time slice is up
+ *
+ * Called from interrupt context with interrupts disabled.
+ */
+void sched_preempt(void)
+{
+    if (!need_resched || !current_task->preemptible) return;
+    sched_stats.preemptions++;
+    schedule();
+}
+
+/* === Wait queues === */
+
+void waitq_init(struct waitq *wq) { INIT_LIST_HEAD(&wq->tasks); }
+
+/**
+ * Block the current task until the queue is woken
+ *
+ * To avoid missing a wakeup, disable interrupts before checking the
+ * condition being waited for, and keep them disabled until this call.
+ */
+void waitq_wait(struct waitq *wq)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    current_task->state = TASK_BLOCKED;
+    list_add_tail(&current_task->link, &wq->tasks);
+    schedule();
+    intr_setenabled(intrs_enabled);
+}
+
+/** Make every task on the queue runnable */
+void waitq_wake_all(struct waitq *wq)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    while (!list_empty(&wq->tasks))
+        make_runnable(list_shift_entry(&wq->tasks, struct task, link));
+    intr_setenabled(intrs_enabled);
+}
+
+/* === Task lifecycle === */
+
+/** First code run by every new task */
+static void task_start(void)
+{
+    current_task->entry(current_task->arg);
+    task_exit();
+}
+
+/**
+ * Create a new task and put it on the run queue
+ *
+ * @param name      Name for debugging
+ * @param entry     Function to run; the task exits when it returns
+ * @param arg       Argument to entry
+ * @param preempt   Whether the task may be preempted on timer interrupt
+ * @returns         The new task, or NULL if the task table is full
+ */
+struct task *
+task_create(const char *name, void (*entry)(void *), void *arg, int preempt)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    /* Dead tasks can be reused once we are no longer on their stack. */
+    struct task *t = NULL;
+    for (int i = 0; i < TASK_MAX && !t; i++) {
+        if (tasks[i].state == TASK_FREE) t = &tasks[i];
+        if (tasks[i].state == TASK_DEAD && &tasks[i] != current_task)
+            t = &tasks[i];
+    }
+
+    if (t) {
+        *t = (struct task){
+                .entry       = entry,
+                .arg         = arg,
+                .preemptible = preempt,
+        };
+        snprintf(t->name, TASK_NAME_MAX, "%s", name);
+        void *stack_top = kstacks[t - tasks] + KSTACK_SIZE;
+        t->sp           = cpu_context_init(stack_top, task_start);
+        if (entry) make_runnable(t);
+    }
+
+    intr_setenabled(intrs_enabled);
+    return t;
+}
+
+/** End the current task. */
+noreturn void task_exit(void)
+{
+    intr_setenabled(0);
+    pr_debug("task %s exited\n", current_task->name);
+    current_task->state = TASK_DEAD;
+    schedule();
+    for (;;) cpu_halt(); // Unreachable: dead tasks are never resumed.
+}
+
+/* === Idle === */
+
+static void idle_main(void *arg)
+{
+    UNUSED(arg);
+    for (;;) {
+        /* Check for work with interrupts off, so that a wakeup cannot
+         * arrive between the check and the halt. */
+        intr_setenabled(0);
+        if (!list_empty(&runqueue)) {
+            schedule();
+            continue;
+        }
+
+        /* Make sure the next deadline is programmed, then sleep until it
+         * or a device interrupt arrives. */
+        timer_program();
+        intr_enable_halt();
+    }
+}
+
+int init_sched(void)
+{
+    int res;
+
+    /* The code that is running now becomes the first task. */
+    current_task  = &tasks[0];
+    *current_task = (struct task){.state = TASK_RUNNABLE};
+    snprintf(current_task->name, TASK_NAME_MAX, "%s", "kmain");
+
+    timer_init(&quantum_timer, quantum_expired);
+    SYSFS_COUNTER("sched", "switches", sched_stats.switches);
+    SYSFS_COUNTER("sched", "preemptions", sched_stats.preemptions);
+
+    /* The idle task is never on the run queue. It is picked when the run
+     * queue is empty. */
+    idle_task = task_create("idle", NULL, NULL, 1);
+    res       = idle_task ? 0 : -ENOMEM;
+    log_result(res, "create idle task\n");
+    if (res < 0) return res;
+    idle_task->entry = idle_main;
+    idle_task->state = TASK_RUNNABLE;
+
+    return 0;
+}
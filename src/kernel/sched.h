@@ -0,0 +1,63 @@
+#ifndef KERNEL_SCHED_H
+#define KERNEL_SCHED_H
+
+#include <cpu.h>
+
+#include <core/list.h>
+
+#include <stdnoreturn.h>
+
+#define TASK_MAX      10    ///< Max tasks, including the boot and idle tasks
+#define TASK_NAME_MAX 32    ///< Max length of a task name, for debugging
+#define KSTACK_SIZE   16384 ///< Size of each task's kernel stack
+
+struct process;
+
+enum task_state {
+    TASK_FREE = 0, ///< Slot unused
+    TASK_RUNNABLE, ///< Running or on the run queue
+    TASK_BLOCKED,  ///< Sleeping on a wait queue
+    TASK_DEAD,     ///< Exited; slot is reclaimed once switched away from
+};
+
+/** A kernel thread of execution with its own stack */
+struct task {
+    ureg_t          *sp;          ///< Saved stack pointer while switched out
+    enum task_state  state;       ///< Scheduling state
+    struct list_head link;        ///< Run queue or wait queue membership
+    int              preemptible; ///< May be switched out on timer IRQ
+    void (*entry)(void *arg);     ///< Function the task starts in
+    void            *arg;         ///< Argument to entry
+    struct process  *process;     ///< Process running in this task, if any
+    char             name[TASK_NAME_MAX]; ///< Name for debugging
+};
+
+/** A list of tasks waiting for something to happen */
+struct waitq {
+    struct list_head tasks;
+};
+
+#define WAITQ_INIT(name) {.tasks = LIST_HEAD_INIT(name.tasks)}
+
+/** Scheduler counters, also in /sys/sched */
+struct sched_stats {
+    unsigned switches;    ///< Switches from one task to another
+    unsigned preemptions; ///< Tasks switched out because their slice ran out
+};
+
+extern struct task       *current_task;
+extern struct sched_stats sched_stats;
+
+int init_sched(void);
+struct task *
+task_create(const char *name, void (*entry)(void *), void *arg, int preempt);
+noreturn void task_exit(void);
+
+void sched_yield(void);
+void sched_preempt(void);
+
+void waitq_init(struct waitq *wq);
+void waitq_wait(struct waitq *wq);
+void waitq_wake_all(struct waitq *wq);
+
+#endif /* KERNEL_SCHED_H */
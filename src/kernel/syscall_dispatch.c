@@ -1,14 +1,69 @@
+#include "clock.h"
+#include "interrupt.h"
 #include "process.h"
 
 #include <cpu.h>
 #include <sys/syscall.h>
 
 #include <drivers/log.h>
+#include <drivers/sysfs.h>
 
 #include <core/errno.h>
 #include <core/macros.h>
 
-long syscall_dispatch(
+/** @name Counters, in /sys/syscall */
+///@{
+static unsigned syscall_calls;
+static unsigned syscall_unhandled;
+///@}
+
+/**
+ * Start a child with files taken from the caller's descriptors
+ *
+ * Child descriptor i gets the caller's descriptor fdmap[i], or is left closed
+ * if fdmap[i] is negative. A NULL map passes on the caller's descriptors as
+ * they are.
+ */
+static long
+sys_spawn(const char *path, char *argv[], const int fdmap[], int nfd)
+{
+    struct file *fds[FD_MAX];
+
+    if (!fdmap) nfd = FD_MAX;
+    if (nfd < 0 || nfd > FD_MAX) return -EINVAL;
+
+    for (int i = 0; i < nfd; i++) {
+        int pfd = fdmap ? fdmap[i] : i;
+        fds[i]  = pfd < 0 ? NULL : process_get_fd(current_process, pfd);
+        if (pfd >= 0 && !fds[i] && fdmap) return -EBADF;
+    }
+    return process_spawn(path, argv, fds, nfd);
+}
+
+/** Open a file or directory at the caller's lowest free descriptor */
+static long sys_open(const char *path, int flags)
+{
+    struct process *p = current_process;
+    if (flags != O_RDONLY) return -EINVAL;
+
+    for (int fd = 0; fd < FD_MAX; fd++) {
+        if (p->fds[fd].f_op) continue;
+        int res = file_open_path(&p->fds[fd], "/", path);
+        if (res < 0) p->fds[fd] = (struct file){};
+        return res < 0 ? res : fd;
+    }
+    return -EMFILE;
+}
+
+/** Wait for one of the caller's own children to exit */
+static long sys_wait(pid_t pid, int *status, int options)
+{
+    struct process *child = process_find(pid);
+    if (!child || child->ppid != current_process->pid) return -ECHILD;
+    return process_wait(pid, status, options & WNOHANG);
+}
+
+static long syscall_do(
         long   number,
         ureg_t arg1,
         ureg_t arg2,
@@ -17,19 +72,83 @@ long syscall_dispatch(
         ureg_t arg5
 )
 {
-    pr_debug("syscall %ld from process %s\n", number, current_process->name);
-
     switch ((enum syscall_nr) number) {
     case SYS_NULL:
     case SYS_MAX: break;
 
+    case SYS_exit: process_exit(arg1);
+
+    case SYS_read: {
+        struct file *f = process_get_fd(current_process, arg1);
+        if (!f) return -EBADF;
+        return file_read(f, (void *) arg2, arg3);
+    }
+
+    case SYS_write: {
+        struct file *f = process_get_fd(current_process, arg1);
+        if (!f) return -EBADF;
+        return file_write(f, (const void *) arg2, arg3);
+    }
+
+    case SYS_getdents: {
+        struct file *f = process_get_fd(current_process, arg1);
+        if (!f) return -EBADF;
+        return file_readdir_batch(f, (void *) arg2, arg3);
+    }
+
+    case SYS_open: return sys_open((const char *) arg1, arg2);
+
+    case SYS_close:
+        if (!process_get_fd(current_process, arg1)) return -EBADF;
+        return process_set_fd(current_process, arg1, NULL);
+
+    case SYS_clock_gettime:
+        return clock_gettime(arg1, (struct timespec *) arg2);
+
+    case SYS_spawn:
+        return sys_spawn(
+                (const char *) arg1, (char **) arg2, (const int *) arg3, arg4
+        );
+
+    case SYS_wait: return sys_wait(arg1, (int *) arg2, arg3);
     }
 
     UNUSED(arg1), UNUSED(arg2), UNUSED(arg3);
     UNUSED(arg4), UNUSED(arg5);
 
+    syscall_unhandled++;
     pr_info("unhandled syscall %ld from process %d (%s)\n", number,
             current_process->pid, current_process->name);
     return -ENOSYS;
 }
 
+/** Run a syscall, and charge its time and I/O to the calling process */
+long syscall_dispatch(
+        long   number,
+        ureg_t arg1,
+        ureg_t arg2,
+        ureg_t arg3,
+        ureg_t arg4,
+        ureg_t arg5
+)
+{
+    struct process *p = current_process;
+    pr_debug("syscall %ld from process %s\n", number, p->name);
+    syscall_calls++;
+    p->acct.syscalls++;
+
+    process_acct_mode(p, 1);
+    long res = syscall_do(number, arg1, arg2, arg3, arg4, arg5);
+    process_acct_mode(p, 0);
+
+    if (res > 0 && number == SYS_read) p->acct.rchar += res;
+    if (res > 0 && number == SYS_write) p->acct.wchar += res;
+    return res;
+}
+
+int init_syscalls(void)
+{
+    SYSFS_COUNTER("syscall", "calls", syscall_calls);
+    SYSFS_COUNTER("syscall", "unhandled", syscall_unhandled);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file
+ * One-shot software timers on a tickless hardware timer
+ *
+ * Pending timers are kept sorted by deadline, and the PIT is programmed in
+ * one-shot mode for the earliest one only. With nothing pending, the PIT is
+ * left stopped and the CPU is not woken at all.
+ */
+#include "timer.h"
+
+#include "clock.h"
+
+#include <cpu_interrupt.h>
+#include <cpu_timer.h>
+
+static LIST_HEAD(pending_timers);
+
+/**
+ * Fallback time for when there is no TSC clock
+ *
+ * Advanced by the programmed delay each time the PIT fires. It is coarse,
+ * since time spent before a reprogram is lost, but it keeps deadlines
+ * moving forward.
+ */
+static uint64_t soft_ns;
+static uint64_t soft_armed_ns; ///< Delay last programmed into the PIT
+
+/** Current time in nanoseconds since boot */
+uint64_t timer_now(void)
+{
+    uint64_t ns = clock_ns();
+    return ns ? ns : soft_ns;
+}
+
+void timer_init(struct timer *t, timer_fn *fn)
+{
+    *t = (struct timer){.fn = fn};
+    INIT_LIST_HEAD(&t->link);
+}
+
+/**
+ * Program the hardware timer for the earliest pending deadline
+ *
+ * Call with interrupts disabled.
+ */
+void timer_program(void)
+{
+    if (list_empty(&pending_timers)) {
+        pit_stop();
+        soft_armed_ns = 0;
+        return;
+    }
+
+    struct timer *t   = list_first_entry(&pending_timers, struct timer, link);
+    uint64_t      now = timer_now();
+    soft_armed_ns     = pit_oneshot(t->deadline > now ? t->deadline - now : 0);
+}
+
+/** Arm (or re-arm) a timer to expire at an absolute deadline */
+void timer_arm(struct timer *t, uint64_t deadline)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    if (t->pending) list_del(&t->link);
+    t->deadline = deadline;
+    t->pending  = 1;
+
+    /* Insert in deadline order. */
+    struct timer *pos;
+    list_for_each_entry(pos, &pending_timers, link) {
+        if (pos->deadline > deadline) break;
+    }
+    list_add_tail(&t->link, &pos->link);
+
+    if (list_first_entry(&pending_timers, struct timer, link) == t)
+        timer_program();
+
+    intr_setenabled(intrs_enabled);
+}
+
+/** Disarm a timer if it is pending */
+void timer_cancel(struct timer *t)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    if (t->pending) {
+        int was_first =
+                list_first_entry(&pending_timers, struct timer, link) == t;
+        list_del(&t->link);
+        t->pending = 0;
+        if (was_first) timer_program();
+    }
+
+    intr_setenabled(intrs_enabled);
+}
+
+/** Run expired timers and re-arm for the next one. Called on timer IRQ. */
+void timer_irq(void)
+{
+    soft_ns += soft_armed_ns;
+    soft_armed_ns = 0;
+
+    uint64_t now = timer_now();
+    while (!list_empty(&pending_timers)) {
+        struct timer *t =
+                list_first_entry(&pending_timers, struct timer, link);
+        if (t->deadline > now) break;
+        list_del(&t->link);
+        t->pending = 0;
+        t->fn(t);
+    }
+    timer_program();
+}
@@ -0,0 +1,26 @@
+#ifndef KERNEL_TIMER_H
+#define KERNEL_TIMER_H
+
+#include <core/list.h>
+
+#include <stdint.h>
+
+struct timer;
+typedef void timer_fn(struct timer *t); ///< Expiry callback, IRQ context
+
+/** A one-shot software timer */
+struct timer {
+    struct list_head link;     ///< Position in pending list, by deadline
+    uint64_t         deadline; ///< Expiry time, ns since boot
+    timer_fn        *fn;       ///< Called once the deadline has passed
+    int              pending;  ///< Armed and not yet expired
+};
+
+uint64_t timer_now(void);
+void     timer_init(struct timer *t, timer_fn *fn);
+void     timer_arm(struct timer *t, uint64_t deadline);
+void     timer_cancel(struct timer *t);
+void     timer_program(void);
+void     timer_irq(void);
+
+#endif /* KERNEL_TIMER_H */
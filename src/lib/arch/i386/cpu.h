@@ -69,4 +69,71 @@ static inline void outl(uint32_t val, ioport_t port) { IO_OUT(val, port); }
 
 static inline void cpu_halt(void) { asm inline volatile("hlt"); }
 
+int init_cpu(void);
+
+/** @name CPU identification and time-stamp counter */
+///@{
+
+/** Register values returned by the CPUID instruction */
+struct cpuid_regs {
+    uint32_t eax, ebx, ecx, edx;
+};
+
+#define CPUID_1_EDX_TSC  (1 << 4)  ///< Leaf 1, EDX: Time-Stamp Counter
+#define CPUID_1_EDX_FXSR (1 << 24) ///< Leaf 1, EDX: FXSAVE/FXRSTOR
+#define CPUID_1_EDX_SSE2 (1 << 26) ///< Leaf 1, EDX: SSE2 instructions
+
+/**
+ * Check if the CPU supports the CPUID instruction
+ *
+ * CPUID is supported if software can toggle the ID flag (bit 21) in EFLAGS.
+ * Early 486 models cannot.
+ */
+static inline int cpu_has_cpuid(void)
+{
+    ureg_t before, after;
+    asm inline volatile(
+            "pushf\n\t"
+            "pop	%0\n\t"     // before = flags
+            "mov	%0, %1\n\t" // after = before ^ ID
+            "xor	$(1 << 21), %1\n\t"
+            "push	%1\n\t" // flags = after
+            "popf\n\t"
+            "pushf\n\t" // after = flags
+            "pop	%1\n\t"
+            "push	%0\n\t" // Restore original flags.
+            "popf"
+            : "=&r"(before), "=&r"(after)
+    );
+    return !!((before ^ after) & (1 << 21));
+}
+
+/** Query CPU identification and feature information */
+static inline void cpuid(uint32_t leaf, struct cpuid_regs *r)
+{
+    asm inline volatile("cpuid"
+                        : "=a"(r->eax), "=b"(r->ebx), "=c"(r->ecx),
+                          "=d"(r->edx)
+                        : "a"(leaf), "c"(0));
+}
+
+/** Check a feature bit in EDX of CPUID leaf 1 */
+static inline int cpu_has_feature_edx1(uint32_t bit)
+{
+    if (!cpu_has_cpuid()) return 0;
+    struct cpuid_regs r;
+    cpuid(1, &r);
+    return !!(r.edx & bit);
+}
+
+/** Read the Time-Stamp Counter */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm inline volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+///@}
+
 #endif /* CPU_X86_H */
@@ -0,0 +1,38 @@
+/**
+ * @file
+ * Saving and restoring kernel execution contexts on their own stacks
+ */
+#ifndef CPU_X86_CONTEXT_H
+#define CPU_X86_CONTEXT_H
+
+#include "cpu.h"
+
+#define CPU_FLAGS_IF       (1 << 9) ///< Interrupt enable flag
+#define CPU_FLAGS_RESERVED (1 << 1) ///< Always-set bit in EFLAGS
+
+void cpu_context_switch(ureg_t **save_sp, ureg_t *next_sp);
+
+/**
+ * Build an initial context that @ref cpu_context_switch will resume
+ *
+ * The new context starts in @p entry with interrupts enabled. The function
+ * must never return since there is nothing on the stack to return to.
+ *
+ * @param stack_top     One past the highest address of the new stack
+ * @param entry         Function to start in
+ * @returns             Stack pointer to pass to cpu_context_switch
+ */
+static inline ureg_t *cpu_context_init(void *stack_top, void (*entry)(void))
+{
+    ureg_t *sp = stack_top;
+    *--sp      = 0;                                  // Return from entry
+    *--sp      = (uintptr_t) entry;                  // RET
+    *--sp      = 0;                                  // EBP
+    *--sp      = 0;                                  // EBX
+    *--sp      = 0;                                  // ESI
+    *--sp      = 0;                                  // EDI
+    *--sp      = CPU_FLAGS_IF | CPU_FLAGS_RESERVED; // POPF
+    return sp;
+}
+
+#endif /* CPU_X86_CONTEXT_H */
@@ -1,5 +1,6 @@
 #include "cpu_interrupt.h"
 
+#include "cpu_pic.h"
 #include "x86_seg.h"
 
 #include <drivers/log.h>
@@ -102,7 +103,8 @@ const char *ivec_name(ivec_t ivec)
     case 12: return "#SS - Stack-Segment Fault";
     case 13: return "#GP - General Protection Fault";
     case 14: return "#PF - Page Fault";
-    default: return "[unknown]";
+    case IVEC_SYSCALL: return "syscall";
+    default: return ivec_isirq(ivec) ? "IRQ" : "[unknown]";
     }
 }
 
@@ -119,6 +121,10 @@ const char *ivec_name(ivec_t ivec)
 //ISR_E(13, isr13);    ///< Handler for x86 #GP General Protection Fault
 //ISR_E(14, isr14);    ///< Handler for x86 #PF Page Fault
 
+ISR(IVEC_IRQ0 + IRQ_TIMER, isr_irq_timer); ///< Handler for PIT channel 0
+ISR(IVEC_IRQ0 + IRQ_COM2, isr_irq_com2);   ///< Handler for serial COM2
+ISR(IVEC_IRQ0 + IRQ_COM1, isr_irq_com1);   ///< Handler for serial COM1
+
 /** Interrupt handler functions to install into the IDT. */
 static const struct handler_to_install HANDLERS[] = {
 /* TODO: Add defined interrupt handlers to this array/ */
@@ -127,6 +133,9 @@ static const struct handler_to_install HANDLERS[] = {
 //{8, isr8},   /// Double Fault
 //{13, isr13}, /// General Protection Fault
 //{14, isr14}, /// Page Fault
+        {IVEC_IRQ0 + IRQ_TIMER, isr_irq_timer}, /// PIT channel 0
+        {IVEC_IRQ0 + IRQ_COM2, isr_irq_com2},   /// Serial COM2
+        {IVEC_IRQ0 + IRQ_COM1, isr_irq_com1},   /// Serial COM1
 };
 
 /* The kernel will provide a syscall entry interrupt handler. */
@@ -23,6 +23,7 @@ typedef unsigned char ivec_t; ///< CPU Interrupt Vector
 enum ivec {
     IVEC_PF = 14, ///< \#PF - Page Fault
     IVEC_USER_START = 32, ///< start of vectors available to the OS
+    IVEC_IRQ0 = 32, ///< First of 16 vectors for remapped PIC IRQs
     IVEC_SYSCALL = 48, ///< Interrupt vector for syscalls
 };
 
@@ -74,6 +75,24 @@ static inline int ivec_isexception(ivec_t ivec)
     return ivec < IVEC_USER_START;
 }
 
+/** Is this interrupt a hardware IRQ from the PIC? */
+static inline int ivec_isirq(ivec_t ivec)
+{
+    return IVEC_IRQ0 <= ivec && ivec < IVEC_IRQ0 + 16;
+}
+
+/**
+ * Enable interrupts and halt until the next one arrives
+ *
+ * STI only takes effect after the following instruction, so an interrupt
+ * cannot slip in between the two and leave the CPU halted with nobody to
+ * wake it.
+ */
+static inline void intr_enable_halt(void)
+{
+    asm inline volatile("sti\n\thlt");
+}
+
 /** Kernel function called on interrupt */
 void interrupt_dispatch(ivec_t vec, struct intrdata *idata);
 
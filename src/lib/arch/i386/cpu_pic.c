@@ -0,0 +1,83 @@
+#include "cpu_pic.h"
+
+#include <drivers/log.h>
+
+/* I/O ports */
+#define PORT_PIC1_CMD  0x20 ///< Master PIC command port
+#define PORT_PIC1_DATA 0x21 ///< Master PIC data (mask) port
+#define PORT_PIC2_CMD  0xa0 ///< Slave PIC command port
+#define PORT_PIC2_DATA 0xa1 ///< Slave PIC data (mask) port
+#define PORT_IOWAIT    0x80 ///< Unused port, written to give the PIC time
+
+/* Initialization Command Words and Operation Command Words */
+#define ICW1_ICW4   0x01 ///< ICW4 will follow
+#define ICW1_INIT   0x10 ///< Start initialization sequence
+#define ICW3_MASTER 0x04 ///< Master: slave is on IRQ2
+#define ICW3_SLAVE  0x02 ///< Slave: cascade identity 2
+#define ICW4_8086   0x01 ///< 8086/88 mode
+#define OCW2_EOI    0x20 ///< Non-specific End Of Interrupt
+
+#define IRQ_CASCADE 2 ///< Master input that the slave is wired to
+
+static inline void pic_iowait(void) { outb(0, PORT_IOWAIT); }
+
+/** Current mask, bit set = line disabled. Bits 8-15 belong to the slave. */
+static uint16_t pic_masks = 0xffff;
+
+static void pic_write_masks(void)
+{
+    outb(pic_masks & 0xff, PORT_PIC1_DATA);
+    outb(pic_masks >> 8, PORT_PIC2_DATA);
+}
+
+/**
+ * Remap the PIC pair to vectors base..base+15 with every line masked
+ *
+ * The BIOS leaves the master on vectors 8-15, which overlap CPU exceptions.
+ */
+void pic_init(ivec_t base)
+{
+    outb(ICW1_INIT | ICW1_ICW4, PORT_PIC1_CMD);
+    pic_iowait();
+    outb(ICW1_INIT | ICW1_ICW4, PORT_PIC2_CMD);
+    pic_iowait();
+    outb(base, PORT_PIC1_DATA);
+    pic_iowait();
+    outb(base + 8, PORT_PIC2_DATA);
+    pic_iowait();
+    outb(ICW3_MASTER, PORT_PIC1_DATA);
+    pic_iowait();
+    outb(ICW3_SLAVE, PORT_PIC2_DATA);
+    pic_iowait();
+    outb(ICW4_8086, PORT_PIC1_DATA);
+    pic_iowait();
+    outb(ICW4_8086, PORT_PIC2_DATA);
+    pic_iowait();
+
+    /* Everything off except the cascade line. */
+    pic_masks = 0xffff & ~(1 << IRQ_CASCADE);
+    pic_write_masks();
+    pr_info("PIC remapped to vectors " FMT_IVEC "-" FMT_IVEC "\n", base,
+            (ivec_t) (base + IRQ_MAX - 1));
+}
+
+/** Disable an IRQ line */
+void pic_mask(unsigned irq)
+{
+    pic_masks |= 1 << irq;
+    pic_write_masks();
+}
+
+/** Enable an IRQ line */
+void pic_unmask(unsigned irq)
+{
+    pic_masks &= ~(1 << irq);
+    pic_write_masks();
+}
+
+/** Acknowledge an IRQ so that the PIC will deliver further ones */
+void pic_eoi(unsigned irq)
+{
+    if (irq >= 8) outb(OCW2_EOI, PORT_PIC2_CMD);
+    outb(OCW2_EOI, PORT_PIC1_CMD);
+}
@@ -0,0 +1,26 @@
+/**
+ * @file
+ * Legacy 8259 Programmable Interrupt Controller (PIC) pair
+ *
+ * @see
+ * - <https://wiki.osdev.org/8259_PIC>
+ */
+#ifndef CPU_X86_PIC_H
+#define CPU_X86_PIC_H
+
+#include "cpu_interrupt.h"
+
+/** @name IRQ lines used by the kernel */
+///@{
+#define IRQ_TIMER 0  ///< PIT channel 0
+#define IRQ_COM2  3  ///< Serial port COM2 (and COM4)
+#define IRQ_COM1  4  ///< Serial port COM1 (and COM3)
+#define IRQ_MAX   16 ///< Number of IRQ lines on the PIC pair
+///@}
+
+void pic_init(ivec_t base);
+void pic_mask(unsigned irq);
+void pic_unmask(unsigned irq);
+void pic_eoi(unsigned irq);
+
+#endif /* CPU_X86_PIC_H */
@@ -0,0 +1,304 @@
+/**
+ * @file
+ * x86 memory kernels: `rep movs`/`rep stos`, and SSE2 for large sizes
+ *
+ * At boot, @ref init_cpu_string checks CPUID and installs the best kernels
+ * it can in @ref mem_kernels. Every x86 CPU has the string instructions.
+ * SSE2 moves 64 bytes per loop, and page-sized fills use non-temporal
+ * stores so that zeroing a page does not push useful data out of the cache.
+ * SSE2 also compares and scans for a terminator 16 bytes at a time, which
+ * the string instructions do no faster than the portable word loops.
+ *
+ * Task switches do not save the XMM registers, and the rest of the system
+ * is built without SSE. So the SSE2 kernels run in chunks with interrupts
+ * disabled, and nothing else can run while the XMM registers are in use.
+ * A chunk is one page, which keeps interrupt latency to about a microsecond.
+ */
+#include "cpu_string.h"
+
+#include "cpu.h"
+#include "cpu_interrupt.h"
+#include "x86_seg.h"
+
+#include <drivers/log.h>
+
+#include <core/macros.h>
+#include <core/string.h>
+
+#define SSE_MIN   512  ///< Smaller sizes use the string instructions
+#define SSE_NT    4096 ///< Fills at least this large bypass the cache
+#define SSE_CHUNK 4096 ///< Most bytes moved with interrupts disabled
+
+#define CR0_MP         (1 << 1)  ///< Monitor coprocessor
+#define CR0_EM         (1 << 2)  ///< Emulate FPU: SSE raises \#UD if set
+#define CR4_OSFXSR     (1 << 9)  ///< OS supports SSE state
+#define CR4_OSXMMEXCPT (1 << 10) ///< OS handles SSE exceptions
+
+/** @name String instructions */
+///@{
+
+/** `rep movs` with the given operand suffix, advancing both pointers */
+#define REP_MOVS(SUFFIX, D, S, N) \
+    asm inline volatile("rep movs" SUFFIX \
+                        : "+D"(D), "+S"(S), "+c"(N) \
+                        : \
+                        : "memory")
+
+/** `rep stos` with the given operand suffix, advancing the pointer */
+#define REP_STOS(SUFFIX, D, V, N) \
+    asm inline volatile("rep stos" SUFFIX \
+                        : "+D"(D), "+c"(N) \
+                        : "a"(V) \
+                        : "memory")
+
+/** Copy low to high: bytes up to alignment, then dwords, then the rest */
+static void *copy_rep(void *dest, const void *src, size_t n)
+{
+    unsigned char       *d     = dest;
+    const unsigned char *s     = src;
+    size_t               head  = MIN(-(uintptr_t) d % 4, n);
+    size_t               words = (n - head) / 4;
+    size_t               tail  = (n - head) % 4;
+    REP_MOVS("b", d, s, head);
+    REP_MOVS("l", d, s, words);
+    REP_MOVS("b", d, s, tail);
+    return dest;
+}
+
+static void *fill_rep(void *s, int c, size_t n)
+{
+    unsigned char *d       = s;
+    uint32_t       pattern = 0x01010101u * (unsigned char) c;
+    size_t         head    = MIN(-(uintptr_t) d % 4, n);
+    size_t         words   = (n - head) / 4;
+    size_t         tail    = (n - head) % 4;
+    REP_STOS("b", d, pattern, head);
+    REP_STOS("l", d, pattern, words);
+    REP_STOS("b", d, pattern, tail);
+    return s;
+}
+
+///@}
+
+/** @name SSE2 */
+///@{
+
+/** Fill 64 bytes per loop from XMM0 with the given store instruction */
+#define SSE_FILL_LOOP(STORE) \
+    "1:\n\t" \
+    STORE "	%%xmm0, (%[d])\n\t" \
+    STORE "	%%xmm0, 16(%[d])\n\t" \
+    STORE "	%%xmm0, 32(%[d])\n\t" \
+    STORE "	%%xmm0, 48(%[d])\n\t" \
+    "add	$64, %[d]\n\t" \
+    "sub	$64, %[n]\n\t" \
+    "jnz	1b"
+
+/**
+ * Copy low to high, 64 bytes per loop into a 16-byte aligned destination
+ *
+ * Each loop loads all 64 bytes before storing any, so a destination that
+ * overlaps the source from below is still copied correctly.
+ */
+static void *copy_sse2(void *dest, const void *src, size_t n)
+{
+    if (n < SSE_MIN) return copy_rep(dest, src, n);
+
+    unsigned char       *d    = dest;
+    const unsigned char *s    = src;
+    size_t               head = -(uintptr_t) d % 16;
+    n -= head;
+    REP_MOVS("b", d, s, head);
+
+    while (n >= 64) {
+        size_t chunk = MIN(n, SSE_CHUNK) & ~(size_t) 63;
+        n -= chunk;
+
+        int intrs_enabled = intr_isenabled();
+        intr_setenabled(0);
+        asm volatile("1:\n\t"
+                     "movdqu	(%[s]), %%xmm0\n\t"
+                     "movdqu	16(%[s]), %%xmm1\n\t"
+                     "movdqu	32(%[s]), %%xmm2\n\t"
+                     "movdqu	48(%[s]), %%xmm3\n\t"
+                     "movdqa	%%xmm0, (%[d])\n\t"
+                     "movdqa	%%xmm1, 16(%[d])\n\t"
+                     "movdqa	%%xmm2, 32(%[d])\n\t"
+                     "movdqa	%%xmm3, 48(%[d])\n\t"
+                     "add	$64, %[s]\n\t"
+                     "add	$64, %[d]\n\t"
+                     "sub	$64, %[n]\n\t"
+                     "jnz	1b"
+                     : [d] "+r"(d), [s] "+r"(s), [n] "+r"(chunk)
+                     :
+                     : "cc", "memory");
+        intr_setenabled(intrs_enabled);
+    }
+
+    copy_rep(d, s, n);
+    return dest;
+}
+
+/**
+ * Fill 64 bytes per loop into a 16-byte aligned destination
+ *
+ * Page-sized fills are mostly pages being zeroed before use, which are
+ * unlikely to be read again right away. Those use non-temporal stores,
+ * followed by SFENCE so that they are visible before any later store.
+ */
+static void *fill_sse2(void *s, int c, size_t n)
+{
+    if (n < SSE_MIN) return fill_rep(s, c, n);
+
+    unsigned char *d       = s;
+    uint32_t       pattern = 0x01010101u * (unsigned char) c;
+    int            nt      = n >= SSE_NT;
+    size_t         head    = -(uintptr_t) d % 16;
+    n -= head;
+    REP_STOS("b", d, pattern, head);
+
+    while (n >= 64) {
+        size_t chunk = MIN(n, SSE_CHUNK) & ~(size_t) 63;
+        n -= chunk;
+
+        int intrs_enabled = intr_isenabled();
+        intr_setenabled(0);
+        if (nt) {
+            asm volatile("movd	%[p], %%xmm0\n\t"
+                         "pshufd	$0, %%xmm0, %%xmm0\n\t" //
+                         SSE_FILL_LOOP("movntdq")
+                         : [d] "+r"(d), [n] "+r"(chunk)
+                         : [p] "r"(pattern)
+                         : "cc", "memory");
+        } else {
+            asm volatile("movd	%[p], %%xmm0\n\t"
+                         "pshufd	$0, %%xmm0, %%xmm0\n\t" //
+                         SSE_FILL_LOOP("movdqa")
+                         : [d] "+r"(d), [n] "+r"(chunk)
+                         : [p] "r"(pattern)
+                         : "cc", "memory");
+        }
+        intr_setenabled(intrs_enabled);
+    }
+    if (nt) asm volatile("sfence" ::: "memory");
+
+    fill_rep(d, c, n);
+    return s;
+}
+
+/** Compare 16 bytes per loop, then find the first difference by its bit */
+static int cmp_sse2(const void *s1, const void *s2, size_t n)
+{
+    const unsigned char *a = s1;
+    const unsigned char *b = s2;
+    while (n >= 16) {
+        size_t   chunk = MIN(n, SSE_CHUNK) & ~(size_t) 15;
+        size_t   left  = chunk;
+        unsigned diff;
+
+        int intrs_enabled = intr_isenabled();
+        intr_setenabled(0);
+        asm volatile("1:\n\t"
+                     "movdqu	(%[a]), %%xmm0\n\t"
+                     "movdqu	(%[b]), %%xmm1\n\t"
+                     "pcmpeqb	%%xmm1, %%xmm0\n\t"
+                     "pmovmskb	%%xmm0, %[diff]\n\t"
+                     "xor	$0xffff, %[diff]\n\t"
+                     "jnz	2f\n\t"
+                     "add	$16, %[a]\n\t"
+                     "add	$16, %[b]\n\t"
+                     "sub	$16, %[left]\n\t"
+                     "jnz	1b\n"
+                     "2:"
+                     : [a] "+r"(a), [b] "+r"(b), [left] "+r"(left),
+                       [diff] "=&r"(diff)
+                     :
+                     : "cc", "memory");
+        intr_setenabled(intrs_enabled);
+
+        if (diff) {
+            int i = __builtin_ctz(diff);
+            return a[i] < b[i] ? -1 : 1;
+        }
+        n -= chunk;
+    }
+    for (; n; n--, a++, b++)
+        if (*a != *b) return *a < *b ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Find the terminator 16 bytes per loop with aligned loads
+ *
+ * An aligned load never crosses a page, so reading past the terminator is
+ * safe. The bytes up to the first aligned block are checked one by one.
+ */
+static size_t strlen_sse2(const char *s)
+{
+    const char *p = s;
+    for (; (uintptr_t) p % 16; p++)
+        if (!*p) return p - s;
+
+    for (;;) {
+        size_t   left = SSE_CHUNK / 16;
+        unsigned zeros;
+
+        int intrs_enabled = intr_isenabled();
+        intr_setenabled(0);
+        asm volatile("pxor	%%xmm0, %%xmm0\n"
+                     "1:\n\t"
+                     "movdqa	(%[p]), %%xmm1\n\t"
+                     "pcmpeqb	%%xmm0, %%xmm1\n\t"
+                     "pmovmskb	%%xmm1, %[zeros]\n\t"
+                     "test	%[zeros], %[zeros]\n\t"
+                     "jnz	2f\n\t"
+                     "add	$16, %[p]\n\t"
+                     "dec	%[left]\n\t"
+                     "jnz	1b\n"
+                     "2:"
+                     : [p] "+r"(p), [left] "+r"(left), [zeros] "=&r"(zeros)
+                     :
+                     : "cc", "memory");
+        intr_setenabled(intrs_enabled);
+
+        if (zeros) return p - s + __builtin_ctz(zeros);
+    }
+}
+
+/** Let SSE instructions run: no FPU emulation, and OS support for state */
+static void sse_enable(void)
+{
+    ureg_t cr0, cr4;
+    x86_get_reg("cr0", cr0);
+    x86_get_reg("cr4", cr4);
+    cr0 = (cr0 & ~CR0_EM) | CR0_MP;
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    x86_set_reg("cr0", cr0);
+    x86_set_reg("cr4", cr4);
+}
+
+///@}
+
+/** Pick memory kernels for this CPU */
+int init_cpu_string(void)
+{
+    struct cpuid_regs r = {0};
+    if (cpu_has_cpuid()) cpuid(1, &r);
+
+    /* The compare and scan kernels stay portable unless SSE2 is here. */
+    uint32_t sse2 = CPUID_1_EDX_FXSR | CPUID_1_EDX_SSE2;
+    if ((r.edx & sse2) == sse2) {
+        sse_enable();
+        mem_kernels.name   = "sse2";
+        mem_kernels.copy   = copy_sse2;
+        mem_kernels.fill   = fill_sse2;
+        mem_kernels.cmp    = cmp_sse2;
+        mem_kernels.strlen = strlen_sse2;
+    } else {
+        mem_kernels.name = "rep";
+        mem_kernels.copy = copy_rep;
+        mem_kernels.fill = fill_rep;
+    }
+    pr_info("memory kernels: %s\n", mem_kernels.name);
+    return 0;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file
+ * x86 memory kernels behind memcpy, memmove and memset
+ */
+#ifndef CPU_X86_STRING_H
+#define CPU_X86_STRING_H
+
+int init_cpu_string(void);
+
+#endif /* CPU_X86_STRING_H */
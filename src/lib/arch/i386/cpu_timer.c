@@ -0,0 +1,115 @@
+#include "cpu_timer.h"
+
+#include "cpu_interrupt.h"
+
+#include <drivers/log.h>
+
+#include <core/inttypes.h>
+#include <core/macros.h>
+#include <core/time.h>
+
+/* I/O ports */
+#define PORT_PIT_CH0  0x40 ///< PIT channel 0 data port (IRQ 0)
+#define PORT_PIT_CH2  0x42 ///< PIT channel 2 data port (PC speaker)
+#define PORT_PIT_CMD  0x43 ///< PIT mode/command register
+#define PORT_SPKR_CTL 0x61 ///< PC speaker control (channel 2 gate)
+
+/* PIT mode/command register fields */
+#define PIT_SEL_CH0  (0 << 6) ///< Select channel 0
+#define PIT_SEL_CH2  (2 << 6) ///< Select channel 2
+#define PIT_ACC_LOHI (3 << 4) ///< Access mode: low byte, then high byte
+#define PIT_MODE0    (0 << 1) ///< Mode 0: interrupt on terminal count
+
+/* Speaker control port bits */
+#define SPKR_GATE2 (1 << 0) ///< Channel 2 gate input
+#define SPKR_DATA  (1 << 1) ///< Speaker data enable
+#define SPKR_OUT2  (1 << 5) ///< Channel 2 output state (read-only)
+
+#define CALIBRATE_MS    10 ///< Length of one calibration window
+#define CALIBRATE_TRIES 3  ///< Take the best of this many windows
+
+/**
+ * Measure TSC cycles over one PIT channel 2 countdown
+ *
+ * Channel 2 is used because its gate is under software control and its
+ * output can be polled, so no interrupts are needed.
+ */
+static uint64_t tsc_pit_window(uint16_t pit_ticks)
+{
+    /* Gate off, speaker off. */
+    uint8_t spkr = inb(PORT_SPKR_CTL);
+    outb((spkr & ~(SPKR_DATA | SPKR_GATE2)), PORT_SPKR_CTL);
+
+    /* Program a one-shot countdown. */
+    outb(PIT_SEL_CH2 | PIT_ACC_LOHI | PIT_MODE0, PORT_PIT_CMD);
+    outb(pit_ticks & 0xff, PORT_PIT_CH2);
+    outb(pit_ticks >> 8, PORT_PIT_CH2);
+
+    /* Raise the gate to start counting and wait for OUT2 to go high. */
+    outb((spkr & ~SPKR_DATA) | SPKR_GATE2, PORT_SPKR_CTL);
+    uint64_t start = rdtsc();
+    while (!(inb(PORT_SPKR_CTL) & SPKR_OUT2))
+        ;
+    uint64_t end = rdtsc();
+
+    outb(spkr, PORT_SPKR_CTL);
+    return end - start;
+}
+
+/**
+ * Calibrate the Time-Stamp Counter against the PIT
+ *
+ * @returns TSC frequency in Hz, or 0 if the CPU has no TSC.
+ */
+uint64_t x86_tsc_calibrate(void)
+{
+    if (!cpu_has_feature_edx1(CPUID_1_EDX_TSC)) return 0;
+
+    const uint16_t pit_ticks = PIT_HZ * CALIBRATE_MS / 1000;
+
+    /* Interrupts would stretch the window, so keep them off while measuring.
+     * The shortest window is the least disturbed one. */
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < CALIBRATE_TRIES; i++)
+        best = MIN(best, tsc_pit_window(pit_ticks));
+    intr_setenabled(intrs_enabled);
+
+    uint64_t hz = best * PIT_HZ / pit_ticks;
+    pr_info("TSC: %" PRIu64 " cycles in %u PIT ticks = %" PRIu64 " kHz\n",
+            best, pit_ticks, hz / 1000);
+    return hz;
+}
+
+/**
+ * Arm PIT channel 0 to raise IRQ 0 once, after a delay
+ *
+ * Mode 0 counts down once and then stays quiet, so the CPU is left alone
+ * until the next deadline instead of waking on every tick.
+ *
+ * @param ns    Requested delay in nanoseconds
+ * @returns     Delay actually programmed, which is clamped to what the
+ *              16-bit counter can hold (about 55 ms).
+ */
+uint64_t pit_oneshot(uint64_t ns)
+{
+    uint64_t ticks = MIN(ns, NSEC_PER_SEC) * PIT_HZ / NSEC_PER_SEC;
+    ticks          = MAX(MIN(ticks, PIT_ONESHOT_MAX_TICKS), 1);
+
+    outb(PIT_SEL_CH0 | PIT_ACC_LOHI | PIT_MODE0, PORT_PIT_CMD);
+    outb(ticks & 0xff, PORT_PIT_CH0);
+    outb(ticks >> 8, PORT_PIT_CH0);
+    return ticks * NSEC_PER_SEC / PIT_HZ;
+}
+
+/**
+ * Cancel any pending PIT channel 0 countdown
+ *
+ * Writing the mode word without a count makes the counter wait for a count
+ * that never comes, so no IRQ will follow.
+ */
+void pit_stop(void)
+{
+    outb(PIT_SEL_CH0 | PIT_ACC_LOHI | PIT_MODE0, PORT_PIT_CMD);
+}
@@ -0,0 +1,23 @@
+/**
+ * @file
+ * PC timer hardware: Programmable Interval Timer (PIT) and TSC calibration
+ *
+ * @see
+ * - <https://wiki.osdev.org/Programmable_Interval_Timer>
+ * - <https://wiki.osdev.org/TSC>
+ */
+#ifndef CPU_X86_TIMER_H
+#define CPU_X86_TIMER_H
+
+#include "cpu.h"
+
+#include <stdint.h>
+
+#define PIT_HZ                1193182 ///< PIT input clock frequency
+#define PIT_ONESHOT_MAX_TICKS 0xffff  ///< Longest one-shot countdown
+
+uint64_t x86_tsc_calibrate(void);
+uint64_t pit_oneshot(uint64_t ns);
+void     pit_stop(void);
+
+#endif /* CPU_X86_TIMER_H */
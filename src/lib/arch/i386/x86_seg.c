@@ -3,6 +3,7 @@
 #include "abi.h"
 #include "cpu.h"
 #include "cpu_interrupt.h"
+#include "cpu_string.h"
 
 #include <drivers/log.h>
 
@@ -330,6 +331,10 @@ int init_cpu(void)
     log_result(res, "set up TSS\n");
     if (res < 0) return res;
 
+    res = init_cpu_string();
+    log_result(res, "select memory kernels\n");
+    if (res < 0) return res;
+
     return 0;
 }
 
@@ -14,6 +14,13 @@
 
 int x86st_tostr(char *buf, size_t n, unsigned segtype);
 
+/** @name CPU Privilege Level */
+///@{
+typedef unsigned cpupl_t; ///< CPU Privilege Level (ring number)
+#define PL_KERNEL 0       ///< Ring 0: kernel
+#define PL_USER   3       ///< Ring 3: user processes
+///@}
+
 /** x86 "Pseudo Descriptor" used to load/read a descriptor table register */
 struct ATTR_PACKED x86_pseudodesc32 {
     uint16_t limit;
@@ -97,6 +97,18 @@
  */
 #define ATTR_ALIGNED(ALIGNMENT) __attribute__((aligned(ALIGNMENT)))
 
+/**
+ * Type attr: Objects of this type may alias objects of any other type
+ *
+ * Accesses through such a type are exempt from strict aliasing rules,
+ * like accesses through `char`. This allows copying memory a word at a time.
+ *
+ * @see
+ * [GCC's `may_alias` attribute](
+        https://gcc.gnu.org/onlinedocs/gcc/Common-Type-Attributes.html#index-may_005falias-type-attribute)
+ */
+#define ATTR_MAY_ALIAS __attribute__((may_alias))
+
 ///@}
 
 /** @name Interrupt handlers. */
@@ -83,7 +83,7 @@
 ///@{
 #define EIO              20 ///< I/O error.
 #define ENOBUFS          21 ///< No buffer space available.
-//#define ENOSPC           22 ///< No space left on device.
+#define ENOSPC           22 ///< No space left on device.
 ///@}
 
 /** @name POSIX: I/O: File Descriptors */
@@ -102,15 +102,15 @@
 /** @name POSIX: I/O: Filesystem */
 ///@{
 //#define EACCES           28 ///< Permission denied.
-//#define EEXIST           29 ///< File exists.
+#define EEXIST           29 ///< File exists.
 //#define EFBIG            30 ///< File too large.
 #define EISDIR           31 ///< Is a directory.
-//#define ENAMETOOLONG     32 ///< Filename too long.
+#define ENAMETOOLONG     32 ///< Filename too long.
 #define ENOENT           33 ///< No such file or directory.
 //#define ENOLCK           34 ///< No locks available.
 #define ENOTDIR          35 ///< Not a directory or a symbolic link to a directory.
 //#define ENOTEMPTY        36 ///< Directory not empty.
-//#define EROFS            37 ///< Read-only file system.
+#define EROFS            37 ///< Read-only file system.
 ///@}
 
 /** @name POSIX: I/O: Executables */
@@ -121,7 +121,7 @@
 
 /** @name POSIX: I/O: Pipes */
 ///@{
-//#define EPIPE            43 ///< Broken pipe.
+#define EPIPE            43 ///< Broken pipe.
 //#define ESPIPE           44 ///< Invalid seek.
 ///@}
 
@@ -129,6 +129,11 @@
 ///@{
 #define ENOTTY           45 ///< Inappropriate I/O control operation.
 ///@}
+
+/** @name POSIX: Processes */
+///@{
+#define ECHILD           46 ///< No child processes.
+///@}
 #endif /* __munix__ */
 
 #endif /* KERRNO_H */
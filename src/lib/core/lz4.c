@@ -0,0 +1,76 @@
+#include "lz4.h"
+
+#include <core/errno.h>
+#include <core/string.h>
+
+#include <stdint.h>
+
+/** Read an extended length: bytes of 255 continue it, anything else ends it */
+static int lz4_read_len(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    unsigned b;
+    do {
+        if (*ip >= iend) return -EINVAL;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/**
+ * Decompress one LZ4 block
+ *
+ * Every length and offset is checked against the buffers, so corrupt input
+ * gives an error rather than a stray write.
+ *
+ * @returns number of bytes written to dst, or -EINVAL if the input is
+ *          corrupt or does not fit in dstsz bytes.
+ */
+ssize_t
+lz4_decompress(const void *src, size_t srclen, void *dst, size_t dstsz)
+{
+    const uint8_t *ip   = src;
+    const uint8_t *iend = ip + srclen;
+    uint8_t       *op   = dst;
+    uint8_t       *oend = op + dstsz;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+
+        /* Literals. */
+        size_t len = token >> 4;
+        if (len == 15 && lz4_read_len(&ip, iend, &len) < 0) return -EINVAL;
+        if (len > (size_t) (iend - ip) || len > (size_t) (oend - op))
+            return -EINVAL;
+        memcpy(op, ip, len);
+        ip += len;
+        op += len;
+
+        /* The last sequence has literals only. */
+        if (ip == iend) break;
+
+        /* Match. */
+        if (iend - ip < 2) return -EINVAL;
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (!offset || offset > (size_t) (op - (uint8_t *) dst))
+            return -EINVAL;
+
+        len = token & 15;
+        if (len == 15 && lz4_read_len(&ip, iend, &len) < 0) return -EINVAL;
+        len += LZ4_MIN_MATCH;
+        if (len > (size_t) (oend - op)) return -EINVAL;
+
+        /* A match may overlap its own output, e.g. to repeat a short run.
+         * Only then does it need copying a byte at a time. */
+        const uint8_t *match = op - offset;
+        if (offset >= len) {
+            memcpy(op, match, len);
+            op += len;
+        } else {
+            while (len--) *op++ = *match++;
+        }
+    }
+
+    return op - (uint8_t *) dst;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file
+ * LZ4 block decompression
+ *
+ * An LZ4 block is a series of sequences. Each sequence copies some literal
+ * bytes from the input, then copies a match from earlier in the output.
+ * Decoding needs no tables and no state beyond the output itself.
+ *
+ * @see
+ * - LZ4 Block Format:
+ *      <https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md>
+ */
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <core/types.h>
+
+#include <stddef.h>
+
+#define LZ4_MIN_MATCH 4 ///< Shortest match; match lengths are stored less this
+
+ssize_t
+lz4_decompress(const void *src, size_t srclen, void *dst, size_t dstsz);
+
+#endif /* LZ4_H */
@@ -1,19 +1,125 @@
 #include "string.h"
 
+#include "compiler.h"
+#include "macros.h"
+
 #include <stdint.h>
 
+/** @name Memory kernels */
+///@{
+
+/** A machine word that may alias anything, for moving memory in words */
+typedef uintptr_t ATTR_MAY_ALIAS mem_word_t;
+
+#define WORDSZ sizeof(mem_word_t)
+#define ONES   ((mem_word_t) -1 / 0xff) ///< 0x01 in every byte
+#define HIGHS  (ONES << 7)              ///< 0x80 in every byte
+
 /**
- * Copy memory area (not overlap safe)
+ * Nonzero if any byte of the word is zero
+ *
+ * Subtracting 1 from each byte borrows into the high bit only from a byte
+ * that was 0, or from one at or above 0x80, which `~w` then masks out.
  */
-void *memcpy(void *restrict dest, const void *restrict src, size_t count)
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+/**
+ * Smallest page size on any supported CPU
+ *
+ * Reading an aligned word past the end of a string is safe, because the
+ * word cannot cross into a page that might not be mapped. An unaligned word
+ * is only read if it does not cross a page boundary.
+ */
+#define SCAN_PAGESZ 4096
+
+/** Whether an unaligned word read at p stays within one page */
+#define WORD_IN_PAGE(p) ((uintptr_t) (p) % SCAN_PAGESZ <= SCAN_PAGESZ - WORDSZ)
+
+/**
+ * Copy low to high, a word at a time once the destination is aligned
+ *
+ * The source may stay unaligned, which x86 handles at a small cost.
+ */
+static void *copy_words(void *dest, const void *src, size_t n)
 {
-    const unsigned char *restrict bsrc = src;
-    for (unsigned char *cur = dest; count > 0; count--, cur++, bsrc++)
-        *cur = *(unsigned char *) bsrc;
+    unsigned char       *d = dest;
+    const unsigned char *s = src;
+    for (; n && (uintptr_t) d % WORDSZ; n--) *d++ = *s++;
+    for (; n >= WORDSZ; n -= WORDSZ, d += WORDSZ, s += WORDSZ)
+        *(mem_word_t *) d = *(const mem_word_t *) s;
+    for (; n; n--) *d++ = *s++;
+    return dest;
+}
 
+/** Copy high to low, a word at a time once the destination end is aligned */
+static void *copy_words_back(void *dest, const void *src, size_t n)
+{
+    unsigned char       *d = (unsigned char *) dest + n;
+    const unsigned char *s = (const unsigned char *) src + n;
+    for (; n && (uintptr_t) d % WORDSZ; n--) *--d = *--s;
+    for (; n >= WORDSZ; n -= WORDSZ) {
+        d -= WORDSZ, s -= WORDSZ;
+        *(mem_word_t *) d = *(const mem_word_t *) s;
+    }
+    for (; n; n--) *--d = *--s;
     return dest;
 }
 
+static void *fill_words(void *s, int c, size_t n)
+{
+    mem_word_t     pattern = (mem_word_t) -1 / 0xff * (unsigned char) c;
+    unsigned char *d       = s;
+    for (; n && (uintptr_t) d % WORDSZ; n--) *d++ = (unsigned char) c;
+    for (; n >= WORDSZ; n -= WORDSZ, d += WORDSZ) *(mem_word_t *) d = pattern;
+    for (; n; n--) *d++ = (unsigned char) c;
+    return s;
+}
+
+/** Compare a word at a time up to the first differing word */
+static int cmp_words(const void *s1, const void *s2, size_t n)
+{
+    const unsigned char *a = s1;
+    const unsigned char *b = s2;
+    for (; n >= WORDSZ; n -= WORDSZ, a += WORDSZ, b += WORDSZ)
+        if (*(const mem_word_t *) a != *(const mem_word_t *) b) break;
+    for (; n; n--, a++, b++)
+        if (*a != *b) return *a < *b ? -1 : 1;
+    return 0;
+}
+
+static size_t strlen_words(const char *s)
+{
+    const char *p = s;
+    while (!HAS_ZERO(*(const mem_word_t *) p)) p += WORDSZ;
+    while (*p) p++;
+    return p - s;
+}
+
+struct mem_kernels mem_kernels = {
+        .name   = "words",
+        .copy   = copy_words,
+        .fill   = fill_words,
+        .cmp    = cmp_words,
+        .strlen = strlen_words,
+};
+
+/** Copy low to high, with the kernel if it is worth the call */
+static void *copy_forward(void *dest, const void *src, size_t n)
+{
+    if (n < MEM_KERNEL_MIN) return copy_words(dest, src, n);
+    return mem_kernels.copy(dest, src, n);
+}
+
+///@}
+
+/**
+ * Copy memory area (not overlap safe)
+ */
+void *memcpy(void *restrict dest, const void *restrict src, size_t count)
+{
+    return copy_forward(dest, src, count);
+}
+
 /**
  * Copy memory area (overlap safe)
  */
@@ -21,18 +127,12 @@ void *memmove(void *dest, const void *src, size_t n)
 {
     if (n == 0 || src == dest) return dest;
 
-    if (src > dest) {
-        /* If source is higher than dest, copy from low to high. */
-        const unsigned char *s = src;
-        unsigned char       *d = dest;
-        for (; n; n--) *(d++) = *(s++);
-    } else {
-        /* If source is lower dest, copy from high to low. */
-        const unsigned char *s = src + n;
-        unsigned char       *d = dest + n;
-        for (; n; n--) *--d = *--s;
-    }
-    return dest;
+    /* If source is higher than dest, copy from low to high. Otherwise copy
+     * from high to low, unless the areas do not overlap at all. */
+    const unsigned char *s = src;
+    unsigned char       *d = dest;
+    if (s > d || s + n <= d) return copy_forward(dest, src, n);
+    return copy_words_back(dest, src, n);
 }
 
 /**
@@ -40,8 +140,8 @@ void *memmove(void *dest, const void *src, size_t n)
  */
 void *memset(void *s, int c, size_t n)
 {
-    for (unsigned char *cur = s; n > 0; n--, cur++) *cur = (unsigned char) c;
-    return s;
+    if (n < MEM_KERNEL_MIN) return fill_words(s, c, n);
+    return mem_kernels.fill(s, c, n);
 }
 
 /**
@@ -49,14 +149,25 @@ void *memset(void *s, int c, size_t n)
  */
 int memcmp(const void *s1, const void *s2, size_t n)
 {
-    const unsigned char *b1 = s1;
-    const unsigned char *b2 = s2;
+    if (n < MEM_KERNEL_MIN) return cmp_words(s1, s2, n);
+    return mem_kernels.cmp(s1, s2, n);
+}
 
-    for (; n > 0; n--, b1++, b2++) {
-        if (*b1 < *b2) return -1;
-        if (*b1 > *b2) return 1;
-    }
-    return 0;
+/**
+ * Find the first occurrence of a byte in a memory area
+ */
+void *memchr(const void *s, int c, size_t n)
+{
+    const unsigned char *p       = s;
+    unsigned char        b       = c;
+    mem_word_t           pattern = ONES * b;
+    for (; n && (uintptr_t) p % WORDSZ; n--, p++)
+        if (*p == b) return (void *) p;
+    for (; n >= WORDSZ; n -= WORDSZ, p += WORDSZ)
+        if (HAS_ZERO(*(const mem_word_t *) p ^ pattern)) break;
+    for (; n; n--, p++)
+        if (*p == b) return (void *) p;
+    return NULL;
 }
 
 char *strcpy(char *restrict dest, const char *restrict src)
@@ -112,15 +223,28 @@ char *strncat(char *dest, const char *src, size_t n)
     return destorig;
 }
 
+/*
+ * strcmp and strncmp compare a word at a time while the first string is
+ * aligned and the second string's word stays within a page. Around a
+ * difference or a terminator they fall back to bytes, which realigns them.
+ */
+
 int strcmp(const char *s, const char *t)
 {
-    for (;; s++, t++) {
-        if (*s && *t && *s == *t) continue;
-        if (*s < *t) return -1;
-        if (*s == *t) return 0;
-        if (*s > *t) return 1;
+    const unsigned char *a = (const unsigned char *) s;
+    const unsigned char *b = (const unsigned char *) t;
+    for (;;) {
+        if ((uintptr_t) a % WORDSZ == 0 && WORD_IN_PAGE(b)) {
+            mem_word_t wa = *(const mem_word_t *) a;
+            if (wa == *(const mem_word_t *) b && !HAS_ZERO(wa)) {
+                a += WORDSZ, b += WORDSZ;
+                continue;
+            }
+        }
+        if (*a != *b) return *a < *b ? -1 : 1;
+        if (!*a) return 0;
+        a++, b++;
     }
-    return 0;
 }
 
 /*
@@ -130,11 +254,19 @@ int strcmp(const char *s, const char *t)
  */
 int strncmp(const char *s, const char *t, size_t n)
 {
-    for (; n; s++, t++, n--) {
-        if (*s && *t && *s == *t) continue;
-        if (*s < *t) return -1;
-        if (*s == *t) return 0;
-        if (*s > *t) return 1;
+    const unsigned char *a = (const unsigned char *) s;
+    const unsigned char *b = (const unsigned char *) t;
+    while (n) {
+        if (n >= WORDSZ && (uintptr_t) a % WORDSZ == 0 && WORD_IN_PAGE(b)) {
+            mem_word_t wa = *(const mem_word_t *) a;
+            if (wa == *(const mem_word_t *) b && !HAS_ZERO(wa)) {
+                a += WORDSZ, b += WORDSZ, n -= WORDSZ;
+                continue;
+            }
+        }
+        if (*a != *b) return *a < *b ? -1 : 1;
+        if (!*a) return 0;
+        a++, b++, n--;
     }
     return 0;
 }
@@ -145,22 +277,132 @@ size_t strlen(const char *s)
     /* Note that there is no null-pointer check here.
      * This is dictated by the C Standard: "The behavior is undefined if str is
      * not a pointer to a null-terminated byte string." */
-    size_t n;
-    for (n = 0; *s != '\0'; s++) n++;
-    return n;
+    const char *p = s;
+    for (; (uintptr_t) p % WORDSZ; p++)
+        if (!*p) return p - s;
+
+    /* Short strings are done here; long ones go to the kernel. */
+    for (size_t i = 0; !HAS_ZERO(*(const mem_word_t *) p); p += WORDSZ)
+        if (++i == MEM_KERNEL_MIN / WORDSZ)
+            return p + WORDSZ - s + mem_kernels.strlen(p + WORDSZ);
+    while (*p) p++;
+    return p - s;
 }
 
 char *strchr(const char *str, int ch)
 {
-    for (;; str++)
-        if (*str == (char) ch) return (char *) str;
-        else if (!*str) return NULL;
+    const unsigned char *p       = (const unsigned char *) str;
+    unsigned char        c       = ch;
+    mem_word_t           pattern = ONES * c;
+    for (; (uintptr_t) p % WORDSZ; p++)
+        if (*p == c) return (char *) p;
+        else if (!*p) return NULL;
+
+    for (;; p += WORDSZ) {
+        mem_word_t w = *(const mem_word_t *) p;
+        if (HAS_ZERO(w) || HAS_ZERO(w ^ pattern)) break;
+    }
+    for (;; p++)
+        if (*p == c) return (char *) p;
+        else if (!*p) return NULL;
+}
+
+char *strrchr(const char *str, int ch)
+{
+    const char *last = NULL;
+    for (;; str++) {
+        if (*str == (char) ch) last = str;
+        if (!*str) return (char *) last;
+    }
+}
+
+/**
+ * Split a needle for the Two-Way algorithm: its critical factorization
+ *
+ * Finds the maximal suffix of the needle, under the byte order or its
+ * reverse (rev). Returns the position just before the suffix, and gives
+ * the suffix's period.
+ */
+static size_t twoway_max_suffix(
+        const unsigned char *n, size_t len, int rev, size_t *period
+)
+{
+    size_t ip = -1, jp = 0, k = 1, p = 1;
+    while (jp + k < len) {
+        unsigned char a = n[ip + k], b = n[jp + k];
+        if (a == b) {
+            if (k == p) jp += p, k = 1;
+            else k++;
+        } else if (rev ? a < b : a > b) {
+            jp += k, k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    *period = p;
+    return ip;
+}
+
+/**
+ * Find a substring in linear time with the Two-Way algorithm
+ *
+ * Each haystack byte is compared a bounded number of times, and no extra
+ * memory is needed. The end of the haystack is found lazily, so a match
+ * near the start of a long string does not scan all of it.
+ *
+ * @see Crochemore and Perrin, "Two-way string-matching", J. ACM 38(3), 1991
+ */
+static char *twoway_strstr(const unsigned char *h, const unsigned char *n)
+{
+    size_t len = strlen((const char *) n);
+
+    size_t p, p_rev;
+    size_t ms     = twoway_max_suffix(n, len, 0, &p);
+    size_t ms_rev = twoway_max_suffix(n, len, 1, &p_rev);
+    if (ms_rev + 1 > ms + 1) ms = ms_rev, p = p_rev;
+
+    /* If the needle is periodic, a match of the right half lets us skip a
+     * whole period and remember how much of the left half already matches.
+     * Otherwise shift past the longer half. */
+    size_t mem0;
+    if (memcmp(n, n + p, ms + 1) == 0) {
+        mem0 = len - p;
+    } else {
+        mem0 = 0;
+        p    = MAX(ms, len - ms - 1) + 1;
+    }
+
+    const unsigned char *z   = h; ///< Known haystack end, or a lower bound
+    size_t               mem = 0;
+    for (;;) {
+        if ((size_t) (z - h) < len) {
+            size_t               grow = len | 63;
+            const unsigned char *end  = memchr(z, 0, grow);
+            if (end && (size_t) (end - h) < len) return NULL;
+            z = end ? end : z + grow;
+        }
+
+        size_t k;
+        for (k = MAX(ms + 1, mem); n[k] && n[k] == h[k]; k++) continue;
+        if (n[k]) {
+            h += k - ms;
+            mem = 0;
+            continue;
+        }
+        for (k = ms + 1; k > mem && n[k - 1] == h[k - 1]; k--) continue;
+        if (k <= mem) return (char *) h;
+        h += p;
+        mem = mem0;
+    }
 }
 
 char *strstr(const char *str, const char *substr)
 {
-    int substrlen = strlen(substr);
-    for (; *str; str++)
-        if (strncmp(str, substr, substrlen) == 0) return (char *) str;
-    return NULL;
+    if (!substr[0]) return (char *) str;
+    if (!substr[1]) return strchr(str, substr[0]);
+    return twoway_strstr(
+            (const unsigned char *) str, (const unsigned char *) substr
+    );
 }
@@ -15,6 +15,33 @@ void *memcpy(void *dest, const void *src, size_t count);
 void *memmove(void *dest, const void *src, size_t n);
 void *memset(void *s, int c, size_t n);
 int   memcmp(const void *s1, const void *s2, size_t n);
+void *memchr(const void *s, int c, size_t n);
+/// @}
+
+/** @name Memory kernels */
+/// @{
+
+#define MEM_KERNEL_MIN 64 ///< Smaller sizes do not use the kernels
+
+/**
+ * Routines behind memcpy, memmove, memset, memcmp and strlen for larger sizes
+ *
+ * The defaults are portable C that work a word at a time. The CPU code may
+ * replace them at boot with faster ones for the CPU it finds.
+ */
+struct mem_kernels {
+    const char *name;
+
+    /** Copy low to high; must also work if dest overlaps src from below */
+    void *(*copy)(void *dest, const void *src, size_t n);
+    void *(*fill)(void *s, int c, size_t n);
+    int (*cmp)(const void *s1, const void *s2, size_t n);
+
+    /** Length of the rest of a string; s is word-aligned */
+    size_t (*strlen)(const char *s);
+};
+
+extern struct mem_kernels mem_kernels;
 /// @}
 
 /** @name String manipulation */
@@ -36,6 +63,7 @@ int   strerror_s(char *dst, size_t n, int errnum);
 /// @{
 size_t strlen(const char *s);
 char  *strchr(const char *str, int ch);
+char  *strrchr(const char *str, int ch);
 char  *strstr(const char *str, const char *substr);
 /// @}
 
@@ -56,7 +56,7 @@ static const char *known_constant(int errnum)
 
     case EIO:             return "EIO";
     case ENOBUFS:         return "ENOBUFS";
-    //case ENOSPC:          return "ENOSPC";
+    case ENOSPC:          return "ENOSPC";
 
     /* --- POSIX: I/O: File Descriptors --- */
 
@@ -72,15 +72,15 @@ static const char *known_constant(int errnum)
     /* --- POSIX: I/O: Filesystem --- */
 
     //case EACCES:          return "EACCES";
-    //case EEXIST:          return "EEXIST";
+    case EEXIST:          return "EEXIST";
     //case EFBIG:           return "EFBIG";
     case EISDIR:          return "EISDIR";
-    //case ENAMETOOLONG:    return "ENAMETOOLONG";
+    case ENAMETOOLONG:    return "ENAMETOOLONG";
     case ENOENT:          return "ENOENT";
     //case ENOLCK:          return "ENOLCK";
     case ENOTDIR:         return "ENOTDIR";
     //case ENOTEMPTY:       return "ENOTEMPTY";
-    //case EROFS:           return "EROFS";
+    case EROFS:           return "EROFS";
 
     /* --- POSIX: I/O: Executables --- */
 
@@ -89,13 +89,17 @@ static const char *known_constant(int errnum)
 
     /* --- POSIX: I/O: Pipes --- */
 
-    //case EPIPE:           return "EPIPE";
+    case EPIPE:           return "EPIPE";
     //case ESPIPE:          return "ESPIPE";
 
     /* --- POSIX: I/O: Terminals --- */
 
     case ENOTTY:          return "ENOTTY";
 
+    /* --- POSIX: Processes --- */
+
+    case ECHILD:          return "ECHILD";
+
     /* --- Default --- */
 
     default: return NULL;
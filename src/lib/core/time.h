@@ -0,0 +1,34 @@
+/**
+ * @file
+ * Time types shared by the kernel and processes
+ */
+#ifndef CORE_TIME_H
+#define CORE_TIME_H
+
+#include <stdint.h>
+
+#define NSEC_PER_SEC  1000000000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_USEC 1000L
+
+typedef long time_t;    ///< Time in seconds
+typedef int  clockid_t; ///< Clock selector for @ref clock_gettime
+
+#define CLOCK_MONOTONIC 1 ///< Time since boot; never jumps, never goes back
+
+/** Time value with nanosecond resolution */
+struct timespec {
+    time_t tv_sec;  ///< Whole seconds
+    long   tv_nsec; ///< Nanoseconds (0 to 999,999,999)
+};
+
+/** Split a nanosecond count into a @ref timespec */
+static inline struct timespec ns_to_timespec(uint64_t ns)
+{
+    return (struct timespec){
+            .tv_sec  = ns / NSEC_PER_SEC,
+            .tv_nsec = ns % NSEC_PER_SEC,
+    };
+}
+
+#endif /* CORE_TIME_H */
@@ -0,0 +1,515 @@
+// #define LOG_LEVEL LOG_DEBUG
+
+#include "blkdev.h"
+
+#include "pagecache.h"
+
+#include <cpu_interrupt.h>
+
+#include <drivers/devices.h>
+#include <drivers/log.h>
+
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+
+#define BLK_MERGE_MAX 256 ///< Max sectors in one merged transfer
+#define BLK_AIO_MAX   8   ///< Max asynchronous file reads in flight
+
+/** @name Block device driver registration */
+///@{
+
+static const struct blkdev_operations *blkdev_drivers[MAJORS_MAX];
+static const struct file_operations    blkdev_file_ops;
+
+/**
+ * Register a block device driver for a major number
+ *
+ * The devices also become available as files through @ref file_open_dev.
+ */
+int blkdev_register(unsigned maj, const struct blkdev_operations *ops)
+{
+    if (maj <= 0 || MAJORS_MAX <= maj) return -EINVAL;
+    if (blkdev_drivers[maj] && blkdev_drivers[maj] != ops) return -EBUSY;
+    blkdev_drivers[maj] = ops;
+    return chrdev_register(maj, &blkdev_file_ops);
+}
+
+/** Set up a device struct for a driver, with an empty request queue */
+void blkdev_init(
+        struct blkdev *bd, const struct blkdev_operations *ops, dev_t dev,
+        loff_t size
+)
+{
+    *bd = (struct blkdev){
+            .ops      = ops,
+            .dev      = dev,
+            .size     = size,
+            .nsectors = ALIGN_UP(size, SECTOR_SIZE) >> SECTOR_SHIFT,
+    };
+    INIT_LIST_HEAD(&bd->queue);
+}
+
+/** Find a block device by device number */
+struct blkdev *blkdev_get(dev_t dev)
+{
+    unsigned maj = MAJOR(dev);
+    if (maj <= 0 || MAJORS_MAX <= maj) return NULL;
+    const struct blkdev_operations *ops = blkdev_drivers[maj];
+    if (!ops || !ops->get) return NULL;
+    return ops->get(MINOR(dev));
+}
+
+///@}
+
+/** @name Request queue */
+///@{
+
+/**
+ * Try to add a request to the transfer of a queued request
+ *
+ * Only requests that continue the transfer on the device and in memory can
+ * be merged, since the driver gets a single buffer.
+ */
+static int blk_try_merge(struct blk_request *head, struct blk_request *rq)
+{
+    if (head->dir != rq->dir) return 0;
+    if (head->io_nsectors + rq->nsectors > BLK_MERGE_MAX) return 0;
+
+    char *head_end = (char *) head->io_buf + head->io_nsectors * SECTOR_SIZE;
+    char *rq_end   = (char *) rq->buf + rq->nsectors * SECTOR_SIZE;
+
+    if (head->io_sector + head->io_nsectors == rq->sector
+        && head_end == rq->buf) {
+        /* Back merge: rq follows head. */
+    } else if (rq->sector + rq->nsectors == head->io_sector
+               && rq_end == head->io_buf) {
+        /* Front merge: rq comes just before head. */
+        head->io_sector = rq->sector;
+        head->io_buf    = rq->buf;
+    } else return 0;
+
+    head->io_nsectors += rq->nsectors;
+    list_add_tail(&rq->link, &head->merged);
+    return 1;
+}
+
+/** Hand queued requests to the driver, unless the queue is plugged */
+static void blk_run_queue(struct blkdev *bd)
+{
+    for (;;) {
+        /* Take the request off the queue with interrupts disabled, but let
+         * the driver do the transfer with them as they were. */
+        int intrs_enabled = intr_isenabled();
+        intr_setenabled(0);
+        struct blk_request *rq = NULL;
+        if (!bd->plugged && !list_empty(&bd->queue))
+            rq = list_shift_entry(&bd->queue, struct blk_request, link);
+        intr_setenabled(intrs_enabled);
+
+        if (!rq) return;
+        pr_debug(
+                "%s: %s sectors %u+%zu\n", bd->ops->name,
+                rq->dir == BLK_READ ? "read" : "write", rq->io_sector,
+                rq->io_nsectors
+        );
+        bd->ops->submit(bd, rq);
+    }
+}
+
+/**
+ * Queue a request for a transfer
+ *
+ * The request must stay in place until it completes. Check
+ * @ref blk_request.complete, wait with @ref blk_wait, or give a callback.
+ */
+void blk_submit(struct blkdev *bd, struct blk_request *rq)
+{
+    rq->complete    = 0;
+    rq->res         = 0;
+    rq->io_sector   = rq->sector;
+    rq->io_nsectors = rq->nsectors;
+    rq->io_buf      = rq->buf;
+    INIT_LIST_HEAD(&rq->merged);
+
+    if (!rq->nsectors || rq->sector + rq->nsectors > bd->nsectors) {
+        blk_complete(rq, -EINVAL);
+        return;
+    }
+
+    /* Cached copies of what is about to be written are now stale. */
+    if (rq->dir == BLK_WRITE) {
+        pcache_invalidate(
+                bd, rq->sector / SECTORS_PER_PAGE,
+                (rq->sector + rq->nsectors - 1) / SECTORS_PER_PAGE
+        );
+    }
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    bd->nsubmit++;
+
+    struct blk_request *head;
+    int                 merged = 0;
+    list_for_each_entry(head, &bd->queue, link)
+    {
+        merged = blk_try_merge(head, rq);
+        if (merged) break;
+    }
+    if (merged) bd->nmerge++;
+    else list_add_tail(&rq->link, &bd->queue);
+
+    intr_setenabled(intrs_enabled);
+    blk_run_queue(bd);
+}
+
+static void blk_complete_one(struct blk_request *rq, int res)
+{
+    rq->res      = res;
+    rq->complete = 1;
+    if (rq->done) rq->done(rq, res);
+}
+
+/** Finish a request and every request merged into it; for drivers */
+void blk_complete(struct blk_request *rq, int res)
+{
+    struct blk_request *pos, *next;
+    list_for_each_entry_safe(pos, next, &rq->merged, link)
+    {
+        list_del(&pos->link);
+        blk_complete_one(pos, res);
+    }
+    blk_complete_one(rq, res);
+}
+
+/**
+ * Wait until a submitted request is complete
+ *
+ * The queue must not be left plugged, or the request may never start.
+ */
+void blk_wait(struct blk_request *rq)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    while (!rq->complete) {
+        intr_enable_halt();
+        intr_setenabled(0);
+    }
+    intr_setenabled(intrs_enabled);
+}
+
+/** Hold back requests so that the ones that follow can be merged */
+void blk_plug(struct blkdev *bd) { bd->plugged++; }
+
+/** Release a plug, and start the queued requests if it was the last one */
+void blk_unplug(struct blkdev *bd)
+{
+    if (bd->plugged && --bd->plugged == 0) blk_run_queue(bd);
+}
+
+/** Transfer sectors and wait for the result */
+int blk_rw(
+        struct blkdev *bd, enum blk_dir dir, sector_t sector, size_t nsectors,
+        void *buf
+)
+{
+    struct blk_request rq = {
+            .dir      = dir,
+            .sector   = sector,
+            .nsectors = nsectors,
+            .buf      = buf,
+    };
+    blk_submit(bd, &rq);
+    blk_wait(&rq);
+    return rq.res;
+}
+
+///@}
+
+/** @name Cached reads */
+///@{
+
+/**
+ * Finish filling a page
+ *
+ * If the page was invalidated meanwhile, the data may predate a write, so
+ * the page is left neither up to date nor in error, to be filled again.
+ */
+static void blkdev_page_done(struct blk_request *rq, int res)
+{
+    struct cpage *pg    = rq->private;
+    int           stale = pg->fill_gen != pg->gen;
+    pg->err             = stale ? 0 : res;
+    pg->uptodate        = !stale && res >= 0;
+    pg->filling         = 0;
+    pcache_put(pg); // Reference held for the I/O
+}
+
+/** Start reading a page from the device, using the caller's reference */
+static void blkdev_fill_page(struct blkdev *bd, struct cpage *pg)
+{
+    /* The last page may run past the end of the device. */
+    sector_t first = pg->index * SECTORS_PER_PAGE;
+    size_t   n     = MIN(SECTORS_PER_PAGE, bd->nsectors - first);
+    memset((char *) pg->data + n * SECTOR_SIZE, 0, PAGESZ - n * SECTOR_SIZE);
+
+    pg->filling  = 1;
+    pg->fill_gen = pg->gen;
+
+    pg->rq = (struct blk_request){
+            .dir      = BLK_READ,
+            .sector   = first,
+            .nsectors = n,
+            .buf      = pg->data,
+            .done     = blkdev_page_done,
+            .private  = pg,
+    };
+    blk_submit(bd, &pg->rq);
+}
+
+/**
+ * Start reading the pages of a readahead window that are not cached
+ *
+ * The queue is plugged meanwhile. Cache pages are usually handed out in
+ * order, so neighbouring pages end up in one merged transfer.
+ */
+static void blkdev_readahead(struct blkdev *bd, size_t index, size_t npages)
+{
+    size_t devpages = ALIGN_UP(bd->size, PAGESZ) / PAGESZ;
+    size_t end      = MIN(index + npages, devpages);
+
+    blk_plug(bd);
+    for (size_t i = index; i < end; i++) {
+        struct cpage *pg = pcache_grab(bd, i);
+        if (!pg) break;
+        if (pg->uptodate || pg->filling) {
+            pcache_put(pg);
+            continue;
+        }
+        if (i != index) pcache_stats.readahead++;
+        blkdev_fill_page(bd, pg);
+    }
+    blk_unplug(bd);
+}
+
+/**
+ * Get a reference to an up-to-date page of the device
+ *
+ * On a miss, the page is read in together with the readahead window. Pass
+ * NULL for ra to read only the page itself, e.g. for filesystem metadata.
+ *
+ * @returns the page, which may hold an error instead of data (see
+ * @ref cpage.err), or NULL if the cache has no room.
+ */
+struct cpage *
+blkdev_get_page(struct blkdev *bd, struct ra_state *ra, size_t index)
+{
+    size_t npages = ra ? ra_window(ra, index) : 1;
+    for (;;) {
+        struct cpage *pg = pcache_find(bd, index);
+        if (pg && (pg->uptodate || pg->filling)) {
+            pcache_stats.hits++;
+        } else {
+            if (pg) pcache_put(pg);
+            pcache_stats.misses++;
+            blkdev_readahead(bd, index, npages);
+            pg = pcache_find(bd, index);
+            if (!pg) return NULL;
+        }
+
+        if (pg->filling) blk_wait(&pg->rq);
+
+        /* A fill overtaken by invalidation leaves neither data nor error. */
+        if (pg->uptodate || pg->err) return pg;
+        pcache_put(pg);
+    }
+}
+
+///@}
+
+/** @name Block devices as files */
+///@{
+
+static int blkdev_file_open_dev(struct file *f, unsigned min)
+{
+    UNUSED(min);
+    struct blkdev *bd = blkdev_get(f->f_stat.f_rdev);
+    if (!bd) return -ENODEV;
+
+    f->f_driver_data = bd;
+    f->f_stat.f_size = bd->size;
+    return 0;
+}
+
+static int blkdev_file_debugstr(char *descbuf, size_t n, struct file *f)
+{
+    struct blkdev *bd = f->f_driver_data;
+    return snprintf(descbuf, n, "%s%u", bd->ops->name, MINOR(bd->dev));
+}
+
+static ssize_t blkdev_file_direct_access(
+        struct file *f, loff_t off, size_t count, const void **addr
+)
+{
+    struct blkdev *bd = f->f_driver_data;
+    if (!bd->ops->direct_access) return -ENOTSUP;
+    return bd->ops->direct_access(bd, off, count, addr);
+}
+
+/**
+ * Read any byte range of the device
+ *
+ * Data comes straight from memory if the driver allows it, or else from the
+ * page cache. If the cache is full, whole sectors are read directly into the
+ * destination and partial ones through a bounce buffer.
+ */
+static ssize_t
+blkdev_file_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    struct blkdev *bd = f->f_driver_data;
+
+    if (*off < 0) *off = 0;         // Do not go below zero.
+    if (*off >= bd->size) return 0; // If past end of device, EOF.
+    count = MIN((loff_t) count, bd->size - *off);
+
+    char   *pos = dst, *end = pos + count;
+    ssize_t res = 0;
+    while (pos < end && res >= 0) {
+        const void   *src;
+        struct cpage *pg;
+        size_t        left = end - pos, chunk;
+        sector_t      sec  = *off >> SECTOR_SHIFT;
+        size_t        skip = *off & (SECTOR_SIZE - 1);
+
+        if ((res = blkdev_file_direct_access(f, *off, left, &src)) > 0) {
+            chunk = res;
+            memcpy(pos, src, chunk);
+        } else if (res < 0 && res != -ENOTSUP) {
+            break;
+        } else if ((pg = blkdev_get_page(bd, &f->f_ra, *off / PAGESZ))) {
+            size_t pgoff = *off % PAGESZ;
+            chunk        = MIN(left, PAGESZ - pgoff);
+            res          = pg->uptodate ? 0 : pg->err ? pg->err : -EIO;
+            if (res >= 0) memcpy(pos, (char *) pg->data + pgoff, chunk);
+            pcache_put(pg);
+        } else if (!skip && left >= SECTOR_SIZE) {
+            chunk = ALIGN_DOWN(left, SECTOR_SIZE);
+            res   = blk_rw(bd, BLK_READ, sec, chunk >> SECTOR_SHIFT, pos);
+        } else {
+            char bounce[SECTOR_SIZE];
+            chunk = MIN(left, SECTOR_SIZE - skip);
+            res   = blk_rw(bd, BLK_READ, sec, 1, bounce);
+            if (res >= 0) memcpy(pos, bounce + skip, chunk);
+        }
+        if (res < 0) break;
+        pos += chunk;
+        *off += chunk;
+    }
+
+    if (pos == (char *) dst && res < 0) return res;
+    return pos - (char *) dst;
+}
+
+/**
+ * Read consecutive device data into several buffers
+ *
+ * Devices in memory, such as ramdisks, are copied from straight into each
+ * buffer. For others, reads for the whole range are started up front, so
+ * they reach the driver as merged transfers instead of buffer by buffer.
+ */
+static ssize_t blkdev_file_readv(
+        struct file *f, const struct iovec *iov, int iovcnt, loff_t *off
+)
+{
+    struct blkdev *bd = f->f_driver_data;
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+    if (!bd->ops->direct_access && total && 0 <= *off && *off < bd->size) {
+        loff_t end   = MIN(*off + (loff_t) total, bd->size);
+        size_t first = *off / PAGESZ, last = (end - 1) / PAGESZ;
+        blkdev_readahead(bd, first, last - first + 1);
+    }
+
+    size_t done = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t  len = iov[i].iov_len;
+        ssize_t res = blkdev_file_read(f, iov[i].iov_base, len, off);
+        if (res < 0) return done ? (ssize_t) done : res;
+        done += res;
+        if ((size_t) res < len) break;
+    }
+    return done;
+}
+
+/** An asynchronous file read in flight as a device request */
+struct blkdev_aio {
+    struct blk_request rq;
+    struct file_aio   *io; ///< NULL if slot unused
+};
+
+static struct blkdev_aio blkdev_aios[BLK_AIO_MAX];
+
+static void blkdev_aio_done(struct blk_request *rq, int res)
+{
+    struct blkdev_aio *ba = container_of(rq, struct blkdev_aio, rq);
+    struct file_aio   *io = ba->io;
+    ba->io                = NULL;
+    file_aio_complete(io, res < 0 ? res : (ssize_t) io->count);
+}
+
+/**
+ * Start a read without waiting for it
+ *
+ * Devices in memory are copied from right away. Reads of whole sectors are
+ * queued as device requests that complete the read when they finish, and
+ * anything else is left to the async worker.
+ */
+static int blkdev_file_aio_submit(struct file *f, struct file_aio *io)
+{
+    struct blkdev *bd = f->f_driver_data;
+    if (io->op != AIO_READ) return -ENOTSUP;
+
+    if (bd->ops->direct_access || io->off >= bd->size || !io->count) {
+        loff_t  off = io->off;
+        ssize_t res = blkdev_file_read(f, io->buf, io->count, &off);
+        file_aio_complete(io, res);
+        return 0;
+    }
+
+    if (io->off < 0 || io->off % SECTOR_SIZE || io->count % SECTOR_SIZE
+        || io->off + (loff_t) io->count > bd->size)
+        return -ENOTSUP;
+
+    struct blkdev_aio *ba = NULL;
+    int intrs_enabled     = intr_isenabled();
+    intr_setenabled(0);
+    for (int i = 0; i < BLK_AIO_MAX && !ba; i++)
+        if (!blkdev_aios[i].io) ba = &blkdev_aios[i];
+    if (ba) ba->io = io;
+    intr_setenabled(intrs_enabled);
+    if (!ba) return -ENOTSUP;
+
+    ba->rq = (struct blk_request){
+            .dir      = BLK_READ,
+            .sector   = io->off >> SECTOR_SHIFT,
+            .nsectors = io->count >> SECTOR_SHIFT,
+            .buf      = io->buf,
+            .done     = blkdev_aio_done,
+    };
+    blk_submit(bd, &ba->rq);
+    return 0;
+}
+
+static const struct file_operations blkdev_file_ops = {
+        .name          = "blkdev",
+        .open_dev      = blkdev_file_open_dev,
+        .debugstr      = blkdev_file_debugstr,
+        .read          = blkdev_file_read,
+        .readv         = blkdev_file_readv,
+        .direct_access = blkdev_file_direct_access,
+        .aio_submit    = blkdev_file_aio_submit,
+};
+
+///@}
@@ -0,0 +1,142 @@
+/**
+ * @file
+ * Block devices: sector I/O through a request queue
+ *
+ * A block device is read and written in whole sectors. Callers describe
+ * each transfer with a @ref blk_request and submit it to the device's
+ * queue. Requests for adjacent sectors with adjacent buffers are merged into
+ * one transfer before the driver sees them. Plug the queue to collect a
+ * batch of requests, then unplug it to send them on.
+ *
+ * Every block device is also available as a file through its device
+ * number, so byte-granular users such as @ref file_pread keep working.
+ */
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <cpu_pagemap.h>
+
+#include <drivers/vfs.h>
+
+#include <core/list.h>
+#include <core/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SECTOR_SHIFT 9
+#define SECTOR_SIZE  (1 << SECTOR_SHIFT)
+
+typedef uint32_t sector_t; ///< Sector number on a block device
+
+enum blk_dir {
+    BLK_READ,
+    BLK_WRITE,
+};
+
+struct blk_request;
+struct blkdev;
+
+/** Called once the transfer is done; res is 0 or a negative error code */
+typedef void (*blk_done_fn)(struct blk_request *rq, int res);
+
+struct blk_request {
+    /** @name Set by the caller */
+    ///@{
+    enum blk_dir dir;
+    sector_t     sector;   ///< First sector
+    size_t       nsectors; ///< Number of sectors
+    void        *buf;      ///< Memory to transfer to or from
+    blk_done_fn  done;     ///< Optional completion callback
+    void        *private;  ///< For the caller's use
+    ///@}
+
+    /** @name Result */
+    ///@{
+    int complete; ///< Set once the transfer is done
+    int res;      ///< 0 or a negative error code
+    ///@}
+
+    /** @name Queue internals */
+    ///@{
+    struct list_head link;        ///< Place in queue or in a merged list
+    struct list_head merged;      ///< Requests merged into this one
+    sector_t         io_sector;   ///< First sector of the merged transfer
+    size_t           io_nsectors; ///< Sectors in the merged transfer
+    void            *io_buf;      ///< Buffer for the merged transfer
+    ///@}
+};
+
+struct blkdev_operations {
+    const char *name;
+
+    /** Find the device for a minor number */
+    struct blkdev *(*get)(unsigned min);
+
+    /**
+     * Start the transfer described by the io_ fields of rq
+     *
+     * The driver must call @ref blk_complete when the transfer is done,
+     * either before returning or later, e.g. from an interrupt.
+     */
+    void (*submit)(struct blkdev *bd, struct blk_request *rq);
+
+    /** Optional: point straight at device data that is in memory */
+    ssize_t (*direct_access
+    )(struct blkdev *bd, loff_t off, size_t count, const void **addr);
+};
+
+struct blkdev {
+    const struct blkdev_operations *ops;
+    dev_t                           dev;
+    loff_t                          size;     ///< Size in bytes
+    sector_t                        nsectors; ///< Size in sectors, rounded up
+    void                           *driver_data;
+
+    /** @name Request queue */
+    ///@{
+    struct list_head queue;   ///< Requests waiting for the driver
+    unsigned         plugged; ///< Plug depth; queue is held while nonzero
+    unsigned         nsubmit; ///< Requests submitted, for statistics
+    unsigned         nmerge;  ///< Requests merged into another
+    ///@}
+};
+
+int  blkdev_register(unsigned maj, const struct blkdev_operations *ops);
+void blkdev_init(
+        struct blkdev *bd, const struct blkdev_operations *ops, dev_t dev,
+        loff_t size
+);
+struct blkdev *blkdev_get(dev_t dev);
+
+void blk_submit(struct blkdev *bd, struct blk_request *rq);
+void blk_complete(struct blk_request *rq, int res);
+void blk_wait(struct blk_request *rq);
+void blk_plug(struct blkdev *bd);
+void blk_unplug(struct blkdev *bd);
+
+int blk_rw(
+        struct blkdev *bd, enum blk_dir dir, sector_t sector, size_t nsectors,
+        void *buf
+);
+
+/** @name Page-sized I/O */
+///@{
+#define SECTORS_PER_PAGE (PAGESZ / SECTOR_SIZE)
+
+static inline int blk_read_page(struct blkdev *bd, size_t pgno, void *buf)
+{
+    return blk_rw(
+            bd, BLK_READ, pgno * SECTORS_PER_PAGE, SECTORS_PER_PAGE, buf
+    );
+}
+
+static inline int blk_write_page(struct blkdev *bd, size_t pgno, void *buf)
+{
+    return blk_rw(
+            bd, BLK_WRITE, pgno * SECTORS_PER_PAGE, SECTORS_PER_PAGE, buf
+    );
+}
+///@}
+
+#endif /* BLKDEV_H */
@@ -0,0 +1,212 @@
+/**
+ * @file
+ * Read-only block device over an LZ4 block-compressed image in memory
+ *
+ * The image stays compressed. Reads decompress only the blocks they touch:
+ * whole blocks straight into the request's buffer, and parts of blocks
+ * through a buffer that keeps the most recently decompressed block for the
+ * next read, which is usually for a neighbouring page. See lz4img.h for the
+ * image format.
+ */
+#include <cpu_interrupt.h>
+
+#include <drivers/blkdev.h>
+#include <drivers/devices.h>
+#include <drivers/fileformat/lz4img.h>
+#include <drivers/log.h>
+
+#include <core/errno.h>
+#include <core/lz4.h>
+#include <core/macros.h>
+#include <core/string.h>
+
+#define LZ4DISKS_MAX 2
+
+struct lz4disk {
+    struct blkdev               bd;
+    const char                 *addr; ///< Compressed image
+    const struct lz4img_header *hdr;
+    const uint32_t             *offsets; ///< Compressed block offsets
+    const char                 *name;
+};
+
+static struct lz4disk                  lz4disks[LZ4DISKS_MAX];
+static const struct blkdev_operations lz4disk_ops;
+
+/** @name Decompressed block cache, shared by all disks and tasks */
+///@{
+static char                  lz4disk_buf[LZ4IMG_BLOCK_MAX];
+static const struct lz4disk *lz4disk_buf_disk; ///< Owner of buf, or NULL
+static uint32_t              lz4disk_buf_block;
+///@}
+
+/** Check that the header and offset table describe the image they head */
+static int lz4disk_check(const void *addr, size_t size)
+{
+    const struct lz4img_header *hdr = addr;
+
+    if (!lz4disk_probe(addr, size)) return -EINVAL;
+
+    uint32_t bs = hdr->block_size;
+    if (bs < LZ4IMG_BLOCK_MIN || bs > LZ4IMG_BLOCK_MAX || (bs & (bs - 1)))
+        return -EINVAL;
+    if (hdr->nblocks != ALIGN_UP((uint64_t) hdr->size, bs) / bs)
+        return -EINVAL;
+
+    /* Offsets must fit in the image and never go backwards. */
+    if (hdr->nblocks >= (size - sizeof(*hdr)) / 4) return -EINVAL;
+    size_t          tabend  = sizeof(*hdr) + (hdr->nblocks + 1) * 4;
+    const uint32_t *offsets = (const void *) (hdr + 1);
+    if (tabend > size || offsets[0] < tabend) return -EINVAL;
+    for (uint32_t i = 0; i < hdr->nblocks; i++)
+        if (offsets[i + 1] < offsets[i]) return -EINVAL;
+    if (offsets[hdr->nblocks] > size) return -EINVAL;
+
+    return 0;
+}
+
+static int lz4disk_create_inner(void *addr, size_t size, const char *name)
+{
+    int res = lz4disk_check(addr, size);
+    if (res < 0) return res;
+
+    const struct lz4img_header *hdr = addr;
+    for (int i = 0; i < LZ4DISKS_MAX; i++) {
+        struct lz4disk *ld = &lz4disks[i];
+        if (!ld->addr) {
+            *ld = (struct lz4disk){
+                    .addr    = addr,
+                    .hdr     = hdr,
+                    .offsets = (const void *) (hdr + 1),
+                    .name    = name,
+            };
+            blkdev_init(
+                    &ld->bd, &lz4disk_ops, MAKEDEV(MAJ_LZ4DISK, i), hdr->size
+            );
+            return i;
+        }
+    }
+    return -ENOMEM;
+}
+
+/** Check for the magic number of a compressed image */
+int lz4disk_probe(const void *addr, size_t size)
+{
+    return size >= sizeof(struct lz4img_header)
+           && memcmp(addr, LZ4IMG_MAGIC, 8) == 0;
+}
+
+int lz4disk_create(void *addr, size_t size, const char *name)
+{
+    int res = lz4disk_create_inner(addr, size, name);
+    log_result(
+            res, "create lz4disk device for %s at %p, size %#zx -> %#x\n",
+            name, addr, size, res >= 0 ? lz4disks[res].hdr->size : 0
+    );
+    return res;
+}
+
+static struct blkdev *lz4disk_get(unsigned min)
+{
+    if (min >= LZ4DISKS_MAX || !lz4disks[min].addr) return NULL;
+    return &lz4disks[min].bd;
+}
+
+/** Decompress a whole block into dst, which has room for it */
+static ssize_t
+lz4disk_decompress(struct lz4disk *ld, uint32_t block, char *dst, size_t ulen)
+{
+    size_t      clen = ld->offsets[block + 1] - ld->offsets[block];
+    const char *src  = ld->addr + ld->offsets[block];
+
+    if (lz4_decompress(src, clen, dst, ulen) != (ssize_t) ulen) {
+        pr_error("%s: block %u is corrupt\n", ld->name, block);
+        return -EIO;
+    }
+    return ulen;
+}
+
+/**
+ * Copy uncompressed data from a block
+ *
+ * Blocks that were stored as is are copied in place, and whole blocks are
+ * decompressed straight into dst. Parts of other blocks go through the
+ * cache buffer, with interrupts disabled so no other task can refill it
+ * while we copy out of it.
+ *
+ * @returns the number of bytes copied, or a negative error code.
+ */
+static ssize_t lz4disk_copy(
+        struct lz4disk *ld, uint32_t block, size_t boff, char *dst, size_t len
+)
+{
+    uint32_t    bs   = ld->hdr->block_size;
+    size_t      ulen = MIN(bs, ld->hdr->size - block * bs);
+    size_t      clen = ld->offsets[block + 1] - ld->offsets[block];
+    const char *src  = ld->addr + ld->offsets[block];
+
+    len = MIN(len, ulen - boff);
+    if (clen == ulen) {
+        memcpy(dst, src + boff, len);
+        return len;
+    }
+    if (boff == 0 && len == ulen)
+        return lz4disk_decompress(ld, block, dst, ulen);
+
+    ssize_t res           = 0;
+    int     intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    if (lz4disk_buf_disk != ld || lz4disk_buf_block != block) {
+        lz4disk_buf_disk = NULL;
+        res              = lz4disk_decompress(ld, block, lz4disk_buf, ulen);
+        if (res >= 0) {
+            lz4disk_buf_disk  = ld;
+            lz4disk_buf_block = block;
+        }
+    }
+    if (res >= 0) {
+        memcpy(dst, lz4disk_buf + boff, len);
+        res = len;
+    }
+    intr_setenabled(intrs_enabled);
+    return res;
+}
+
+/** Do the whole transfer right away, a block at a time */
+static void lz4disk_submit(struct blkdev *bd, struct blk_request *rq)
+{
+    struct lz4disk *ld = container_of(bd, struct lz4disk, bd);
+
+    if (rq->dir != BLK_READ) {
+        blk_complete(rq, -EROFS);
+        return;
+    }
+
+    uint32_t bs  = ld->hdr->block_size;
+    loff_t   off = (loff_t) rq->io_sector << SECTOR_SHIFT;
+    size_t   len = rq->io_nsectors << SECTOR_SHIFT;
+    char    *dst = rq->io_buf;
+    ssize_t  res = 0;
+
+    /* The last sector may be partial; pad it with zeros. */
+    while (len && off < bd->size) {
+        res = lz4disk_copy(ld, off / bs, off % bs, dst, len);
+        if (res < 0) break;
+        dst += res;
+        off += res;
+        len -= res;
+    }
+    if (res >= 0) memset(dst, 0, len);
+    blk_complete(rq, res < 0 ? res : 0);
+}
+
+static const struct blkdev_operations lz4disk_ops = {
+        .name   = "lz4disk",
+        .get    = lz4disk_get,
+        .submit = lz4disk_submit,
+};
+
+int init_driver_lz4disk(void)
+{
+    return blkdev_register(MAJ_LZ4DISK, &lz4disk_ops);
+}
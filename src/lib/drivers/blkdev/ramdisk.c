@@ -0,0 +1,90 @@
+#include <drivers/blkdev.h>
+#include <drivers/devices.h>
+#include <drivers/log.h>
+
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/string.h>
+
+#define RAMDISKS_MAX 4
+
+struct ramdisk {
+    struct blkdev bd;
+    char         *addr;
+    const char   *name;
+};
+
+static struct ramdisk                  ramdisks[RAMDISKS_MAX];
+static const struct blkdev_operations ramdisk_ops;
+
+static int ramdisk_create_inner(void *addr, size_t size, const char *name)
+{
+    if (!addr || !size) return -EINVAL;
+    for (int i = 0; i < RAMDISKS_MAX; i++) {
+        struct ramdisk *rd = &ramdisks[i];
+        if (!rd->addr) {
+            *rd = (struct ramdisk){.addr = addr, .name = name};
+            blkdev_init(&rd->bd, &ramdisk_ops, MAKEDEV(MAJ_RAMDISK, i), size);
+            return i;
+        }
+    }
+    return -ENOMEM;
+}
+
+int ramdisk_create(void *addr, size_t size, const char *name)
+{
+    int res = ramdisk_create_inner(addr, size, name);
+    log_result(
+            res, "create ramdisk device for %s at %p, size %#zx\n", name, addr,
+            size
+    );
+    return res;
+}
+
+static struct blkdev *ramdisk_get(unsigned min)
+{
+    /* Use minor number as ramdisk index. */
+    if (min >= RAMDISKS_MAX || !ramdisks[min].addr) return NULL;
+    return &ramdisks[min].bd;
+}
+
+static ssize_t ramdisk_direct_access(
+        struct blkdev *bd, loff_t off, size_t count, const void **addr
+)
+{
+    struct ramdisk *rd = container_of(bd, struct ramdisk, bd);
+
+    if (off < 0 || off >= bd->size) return 0;
+    *addr = rd->addr + off;
+    return MIN((loff_t) count, bd->size - off);
+}
+
+/** Do the whole transfer right away; the last sector may be partial */
+static void ramdisk_submit(struct blkdev *bd, struct blk_request *rq)
+{
+    struct ramdisk *rd = container_of(bd, struct ramdisk, bd);
+
+    loff_t off   = (loff_t) rq->io_sector << SECTOR_SHIFT;
+    size_t len   = rq->io_nsectors << SECTOR_SHIFT;
+    size_t avail = MIN((loff_t) len, bd->size - off);
+
+    if (rq->dir == BLK_READ) {
+        memcpy(rq->io_buf, rd->addr + off, avail);
+        memset((char *) rq->io_buf + avail, 0, len - avail);
+    } else {
+        memcpy(rd->addr + off, rq->io_buf, avail);
+    }
+    blk_complete(rq, 0);
+}
+
+static const struct blkdev_operations ramdisk_ops = {
+        .name          = "ramdisk",
+        .get           = ramdisk_get,
+        .submit        = ramdisk_submit,
+        .direct_access = ramdisk_direct_access,
+};
+
+int init_driver_ramdisk(void)
+{
+    return blkdev_register(MAJ_RAMDISK, &ramdisk_ops);
+}
@@ -9,6 +9,7 @@
 #include <cpu.h>
 
 #include <drivers/devices.h>
+#include <drivers/sysfs.h>
 #include <drivers/vfs.h>
 
 #include <core/errno.h>
@@ -74,6 +75,12 @@ struct serial {
 
 static struct serial serials[ARRAY_SIZE(PORT_NOS)] = {};
 
+/** @name Counters for all ports, in /sys/serial */
+///@{
+static unsigned serial_rx_bytes;
+static unsigned serial_tx_bytes;
+///@}
+
 static int serial_open_dev(struct file *file, unsigned min)
 {
     /* Use device minor number as com number. */
@@ -98,6 +105,10 @@ static int serial_open_dev(struct file *file, unsigned min)
 
     /* Return to regular operation */
     outb(MC_DTR | MC_RTS | MC_OUT1 | MC_OUT2, s->port + POFF_MODEMCTL);
+
+    /* Raise an IRQ when data arrives. Reads still poll, but readers can
+     * sleep until the IRQ instead of spinning. */
+    outb(IE_RDA, s->port + POFF_INTENABLE);
     return 0;
 }
 
@@ -109,6 +120,7 @@ static inline int check_linestat(struct serial *s, unsigned bits)
 static int serial_readch(struct serial *s)
 {
     if (!check_linestat(s, LS_DR)) return -EAGAIN;
+    serial_rx_bytes++;
     return inb(s->port);
 }
 
@@ -117,6 +129,7 @@ static int serial_writech(struct serial *s, char ch)
     while (!check_linestat(s, LS_THRE)) // Wait for send ready
         ;
     outb(ch, s->port);
+    serial_tx_bytes++;
     return ch;
 }
 
@@ -136,12 +149,8 @@ static char *ofilter(struct serial *s, char *outbuf, char ch)
     return outbuf;
 }
 
-static ssize_t
-serial_read(struct file *f, void *dst, size_t count, loff_t *off)
+static ssize_t serial_readbuf(struct serial *s, void *dst, size_t count)
 {
-    UNUSED(off);
-    struct serial *s = f->f_driver_data;
-
     unsigned char *bdst = dst;
     for (size_t n = 0; n < count; n++, bdst++) {
         /* Read char from hardware. */
@@ -156,11 +165,8 @@ serial_read(struct file *f, void *dst, size_t count, loff_t *off)
 }
 
 static ssize_t
-serial_write(struct file *f, const void *src, size_t count, loff_t *off)
+serial_writebuf(struct serial *s, const void *src, size_t count)
 {
-    UNUSED(off);
-    struct serial *s = f->f_driver_data;
-
     const unsigned char *bsrc = src;
     for (size_t n = 0; n < count; n++, bsrc++) {
         /* Filter output. */
@@ -176,6 +182,56 @@ serial_write(struct file *f, const void *src, size_t count, loff_t *off)
     return count;
 }
 
+static ssize_t
+serial_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    UNUSED(off);
+    return serial_readbuf(f->f_driver_data, dst, count);
+}
+
+static ssize_t
+serial_write(struct file *f, const void *src, size_t count, loff_t *off)
+{
+    UNUSED(off);
+    return serial_writebuf(f->f_driver_data, src, count);
+}
+
+/** Read into each buffer in turn, until the port runs out of data */
+static ssize_t serial_readv(
+        struct file *f, const struct iovec *iov, int iovcnt, loff_t *off
+)
+{
+    UNUSED(off);
+    struct serial *s = f->f_driver_data;
+
+    size_t done = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (!iov[i].iov_len) continue;
+        ssize_t res = serial_readbuf(s, iov[i].iov_base, iov[i].iov_len);
+        if (res < 0) return done ? (ssize_t) done : res;
+        done += res;
+        if ((size_t) res < iov[i].iov_len) break;
+    }
+    return done;
+}
+
+/** Send every buffer in one pass over the port */
+static ssize_t serial_writev(
+        struct file *f, const struct iovec *iov, int iovcnt, loff_t *off
+)
+{
+    UNUSED(off);
+    struct serial *s = f->f_driver_data;
+
+    size_t done = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t res = serial_writebuf(s, iov[i].iov_base, iov[i].iov_len);
+        if (res < 0) return done ? (ssize_t) done : res;
+        done += res;
+    }
+    return done;
+}
+
 static int serial_ioctl(struct file *f, unsigned cmd, uintptr_t arg)
 {
     struct serial *s = f->f_driver_data;
@@ -192,9 +248,13 @@ static const struct file_operations serial_ops = {
         .read     = serial_read,
         .write    = serial_write,
         .ioctl    = serial_ioctl,
+        .readv    = serial_readv,
+        .writev   = serial_writev,
 };
 
 int init_driver_serial(void)
 {
+    SYSFS_COUNTER("serial", "rx_bytes", serial_rx_bytes);
+    SYSFS_COUNTER("serial", "tx_bytes", serial_tx_bytes);
     return chrdev_register(MAJ_SERIAL, &serial_ops);
 }
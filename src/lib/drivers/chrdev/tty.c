@@ -6,9 +6,11 @@
 #include <core/ctype.h>
 #include <core/errno.h>
 #include <core/macros.h>
+#include <core/sprintf.h>
 #include <core/string.h>
 
 #define IBUFSZ 256
+#define EBUFSZ 64
 
 struct tty {
     struct file portdev; ///< File for wrapped port device: serial or screen
@@ -20,6 +22,9 @@ struct tty {
 
     size_t ilen;
     char   ibuf[IBUFSZ];
+
+    size_t elen;         ///< Echo not yet written to the port
+    char   ebuf[EBUFSZ]; ///< Echo for the input taken in so far
 };
 
 #define TTY_CT 2
@@ -72,21 +77,43 @@ static int tty_open_dev(struct file *file, unsigned min)
     return 0;
 }
 
-/** @name Echo */
+/** @name Echo
+ *
+ * Echo is collected in the TTY's echo buffer while input is taken in, and
+ * written to the port once per batch of input, not once per character.
+ */
 ///@{
 
-static void echoc(struct tty *tty, char ch)
+static void echo_flush(struct tty *tty)
+{
+    if (tty->elen) file_write(&tty->portdev, tty->ebuf, tty->elen);
+    tty->elen = 0;
+}
+
+static void echo_add(struct tty *tty, const char *str, size_t len)
 {
     if (!(tty->flags & TTY_ECHO)) return;
+    if (tty->elen + len > EBUFSZ) echo_flush(tty);
+    if (len > EBUFSZ) {
+        file_write(&tty->portdev, str, len);
+        return;
+    }
+    memcpy(tty->ebuf + tty->elen, str, len);
+    tty->elen += len;
+}
 
+static void echoc(struct tty *tty, char ch)
+{
     /* If ECHOCTL is not set, or if it is set and the character is printable,
      * print it verbatime. */
     if (!(tty->flags & TTY_ECHOCTL) || isprint(ch) || strchr("\n\r\t", ch)) {
-        file_write(&tty->portdev, &ch, 1);
+        echo_add(tty, &ch, 1);
         return;
     }
 
     /* Print representation of control chars. */
+    char ctlbuf[8];
+    int  len;
     if (0x00 <= ch && ch < 0x1f) {
         /* Control chars from 0x00 to 0x1f have a caret notation
          * where the letter after the caret is the control code + 0x40.
@@ -94,23 +121,22 @@ static void echoc(struct tty *tty, char ch)
          *  - 0x01 SOH  -> ^A
          *  - 0x02 STX  -> ^B
          *  - ...and so on. */
-        char ctlbuf[2] = {'^', ch + 0x40};
-        file_write(&tty->portdev, ctlbuf, 2);
+        len = snprintf(ctlbuf, sizeof(ctlbuf), "^%c", ch + 0x40);
 
     } else if (ch == 0x7f) {
         /* 0x7f (delete) has its own caret notation: "^?". */
-        file_write(&tty->portdev, "^?", 2);
+        len = snprintf(ctlbuf, sizeof(ctlbuf), "^?");
 
     } else {
         /* For other characters, print hex notation, e.g. "\xff" */
-        file_printf(&tty->portdev, "\\x%02hhx", ch);
+        len = snprintf(ctlbuf, sizeof(ctlbuf), "\\x%02hhx", ch);
     }
-    return;
+    echo_add(tty, ctlbuf, len);
 }
 
 static inline void echos(struct tty *tty, char *str)
 {
-    if (tty->flags & TTY_ECHO) file_write(&tty->portdev, str, strlen(str));
+    echo_add(tty, str, strlen(str));
 }
 
 ///@}
@@ -133,9 +159,23 @@ static void backspace(struct tty *tty)
     echos(tty, "\b \b");
 }
 
+/** Erase the whole line with a single write, not one per character */
 static void clearline(struct tty *tty)
 {
-    for (int n = tty->ilen; n; n--) backspace(tty);
+    size_t n = tty->ilen;
+    if (!n) return;
+    tty->ilen = 0;
+    if (!(tty->flags & TTY_ECHO)) return;
+
+    /* Send along whatever echo is pending, in the same write. */
+    char bs[IBUFSZ], sp[IBUFSZ];
+    memset(bs, '\b', n);
+    memset(sp, ' ', n);
+    const struct iovec iov[] = {
+            {tty->ebuf, tty->elen}, {bs, n}, {sp, n}, {bs, n}
+    };
+    file_writev(&tty->portdev, iov, ARRAY_SIZE(iov));
+    tty->elen = 0;
 }
 
 static void on_eof(struct tty *tty)
@@ -179,14 +219,16 @@ static int tty_inchar(struct tty *tty, char ch)
 
 ///@}
 
-static ssize_t tty_read(struct file *f, void *dst, size_t count, loff_t *off)
+/**
+ * Take in characters from the port until there is something to return
+ *
+ * @returns 1 if there is input to yield, 0 at EOF, -EAGAIN if there is
+ * nothing yet, or another negative error code.
+ */
+static int tty_fill(struct tty *tty)
 {
-    UNUSED(off);
-    struct tty *tty = f->f_driver_data;
-
     /* Read characters from port device into buffer. */
-    char *cdst    = dst;
-    int   portres = -EAGAIN;
+    int portres = -EAGAIN;
     while (tty->ilen < IBUFSZ && !tty->ibuf_eol) {
         /* Read char. */
         char ch;
@@ -195,8 +237,12 @@ static ssize_t tty_read(struct file *f, void *dst, size_t count, loff_t *off)
 
         /* Add to buffer. */
         int res = tty_inchar(tty, ch);
-        if (res < 0) return res;
+        if (res < 0) {
+            echo_flush(tty);
+            return res;
+        }
     }
+    echo_flush(tty);
 
     /* If there is no data in buffer, is it an EOF? Or just no new data? */
     if (tty->ilen == 0) {
@@ -210,10 +256,14 @@ static ssize_t tty_read(struct file *f, void *dst, size_t count, loff_t *off)
 
     /* If waiting for rest of line, continue waiting. */
     if (ISCOOKED(tty) && !tty->ibuf_eol) return -EAGAIN;
+    return 1;
+}
 
-    /* If there are characters to yield, yield them. */
+/** Move up to count buffered characters out to dst */
+static size_t tty_yield(struct tty *tty, void *dst, size_t count)
+{
     size_t retct = MIN(tty->ilen, count);
-    memcpy(cdst, tty->ibuf, retct);
+    memcpy(dst, tty->ibuf, retct);
 
     /* If the whole line wasn't yielded,
      * move the remaining chars to the front of the line buffer. */
@@ -223,6 +273,33 @@ static ssize_t tty_read(struct file *f, void *dst, size_t count, loff_t *off)
     return retct;
 }
 
+static ssize_t tty_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    UNUSED(off);
+    struct tty *tty = f->f_driver_data;
+
+    int res = tty_fill(tty);
+    if (res <= 0) return res;
+    return tty_yield(tty, dst, count);
+}
+
+/** Spread the buffered input over the buffers */
+static ssize_t tty_readv(
+        struct file *f, const struct iovec *iov, int iovcnt, loff_t *off
+)
+{
+    UNUSED(off);
+    struct tty *tty = f->f_driver_data;
+
+    int res = tty_fill(tty);
+    if (res <= 0) return res;
+
+    size_t done = 0;
+    for (int i = 0; i < iovcnt && tty->ilen; i++)
+        done += tty_yield(tty, iov[i].iov_base, iov[i].iov_len);
+    return done;
+}
+
 static ssize_t
 tty_write(struct file *f, const void *src, size_t count, loff_t *off)
 {
@@ -231,6 +308,16 @@ tty_write(struct file *f, const void *src, size_t count, loff_t *off)
     return file_write(&tty->portdev, src, count);
 }
 
+/** Pass the buffers on to the port in one call */
+static ssize_t tty_writev(
+        struct file *f, const struct iovec *iov, int iovcnt, loff_t *off
+)
+{
+    UNUSED(off);
+    struct tty *tty = f->f_driver_data;
+    return file_writev(&tty->portdev, iov, iovcnt);
+}
+
 static int tty_ioctl(struct file *f, unsigned cmd, uintptr_t arg)
 {
     struct tty *tty = f->f_driver_data;
@@ -247,6 +334,8 @@ static struct file_operations tty_ops = {
         .read     = tty_read,
         .write    = tty_write,
         .ioctl    = tty_ioctl,
+        .readv    = tty_readv,
+        .writev   = tty_writev,
 };
 
 int init_driver_tty(void) { return chrdev_register(MAJ_TTY, &tty_ops); }
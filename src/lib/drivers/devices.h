@@ -1,6 +1,8 @@
 #ifndef CHRDEV_H
 #define CHRDEV_H
 
+#include <core/types.h>
+
 #include <stddef.h>
 
 enum chrdev_majors {
@@ -8,7 +10,8 @@ enum chrdev_majors {
     MAJ_MEM,
     MAJ_SERIAL,
     MAJ_TTY,
-    MAJ_RAMDISK,
+    MAJ_RAMDISK, ///< Block device, see blkdev.h
+    MAJ_LZ4DISK, ///< Block device, compressed and read-only
 
     MAJORS_MAX
 };
@@ -26,6 +29,9 @@ enum fs_types {
     FS_DEV,
     FS_SYS,
     FS_CPIO,
+    FS_TMP,
+    FS_EXT2,
+    FS_PROC,
 
     FSTYPES_MAX
 };
@@ -43,5 +49,13 @@ int init_driver_tty(void);
 int init_driver_ramdisk(void);
 int ramdisk_create(void *addr, size_t size, const char *name);
 
+int init_driver_lz4disk(void);
+int lz4disk_probe(const void *addr, size_t size);
+int lz4disk_create(void *addr, size_t size, const char *name);
+
 int init_driver_cpiofs(void);
+int init_driver_tmpfs(void);
+int init_driver_sysfs(void);
+int init_driver_ext2fs(void);
+int ext2_probe(dev_t dev);
 #endif /* CHRDEV_H */
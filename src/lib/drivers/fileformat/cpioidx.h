@@ -0,0 +1,44 @@
+/**
+ * @file
+ * Path index appended to a CPIO archive, shared by the kernel and mkinitrd
+ *
+ * An indexed archive is still a plain "newc" CPIO archive, so other tools
+ * can read it. Two things are added:
+ *
+ * - The data of every non-empty file starts on a @ref CPIOIDX_ALIGN
+ *   boundary. The padding is extra NUL bytes after the path name, which
+ *   the header's name size includes.
+ * - After the end-of-archive marker, where CPIO readers stop, comes a table
+ *   of @ref cpioidx_entry sorted by path, then the path names, then a
+ *   @ref cpioidx_footer as the very last bytes of the archive.
+ *
+ * So the kernel can find the index from the end of the archive and
+ * binary-search it without reading any CPIO headers. All fields are
+ * little-endian. Offsets count from the start of the archive.
+ */
+#ifndef FILEFORMAT_CPIOIDX_H
+#define FILEFORMAT_CPIOIDX_H
+
+#include <stdint.h>
+
+#define CPIOIDX_MAGIC "MUCPIOIX" ///< 8 bytes, no terminator
+#define CPIOIDX_ALIGN 4096       ///< Alignment of file data
+
+struct cpioidx_entry {
+    uint32_t name_off;   ///< Path, NUL-terminated, from start of names
+    uint32_t data_off;   ///< File data
+    uint32_t size;       ///< File size
+    uint32_t mode;       ///< CPIO mode field
+    uint32_t rdev_major; ///< Device number, for device files
+    uint32_t rdev_minor;
+};
+
+struct cpioidx_footer {
+    char     magic[8];    ///< @ref CPIOIDX_MAGIC
+    uint32_t nentries;    ///< Entries in the table
+    uint32_t entries_off; ///< Start of the entry table
+    uint32_t names_off;   ///< Start of the path names
+    uint32_t names_size;  ///< Bytes of path names
+};
+
+#endif /* FILEFORMAT_CPIOIDX_H */
@@ -0,0 +1,35 @@
+/**
+ * @file
+ * Block-compressed disk image format, shared by the kernel and host tools
+ *
+ * The image is cut into blocks of equal size that are compressed one by
+ * one with LZ4, so that any block can be read without decompressing what
+ * comes before it. Layout:
+ *
+ * 1. A @ref lz4img_header
+ * 2. nblocks + 1 offsets (uint32_t): block i's compressed data runs from
+ *    offset i to offset i + 1, counted from the start of the image
+ * 3. The compressed blocks
+ *
+ * A block whose compressed data is as long as the block itself is stored
+ * as is, since it did not compress. The last block may be short. All
+ * fields are little-endian.
+ */
+#ifndef FILEFORMAT_LZ4IMG_H
+#define FILEFORMAT_LZ4IMG_H
+
+#include <stdint.h>
+
+#define LZ4IMG_MAGIC     "MULZ4IMG" ///< 8 bytes, no terminator
+#define LZ4IMG_BLOCK_MIN 4096       ///< Smallest block size
+#define LZ4IMG_BLOCK_MAX 65536      ///< Largest block size
+
+struct lz4img_header {
+    char     magic[8];   ///< @ref LZ4IMG_MAGIC
+    uint32_t block_size; ///< Uncompressed bytes per block; power of two
+    uint32_t nblocks;    ///< Number of blocks
+    uint32_t size;       ///< Uncompressed size of the whole image
+    uint32_t reserved;
+};
+
+#endif /* FILEFORMAT_LZ4IMG_H */
@@ -1,6 +1,7 @@
 // #define LOG_LEVEL LOG_DEBUG
 
 #include <drivers/devices.h>
+#include <drivers/fileformat/cpioidx.h>
 #include <drivers/log.h>
 #include <drivers/vfs.h>
 
@@ -119,6 +120,24 @@ static long newc_atoi(const char *field) { return cpio_atoi(field, 8, 16); }
 /** @name CPIO header reading and decoding */
 ///@{
 
+/**
+ * Read from the archive at the current position
+ *
+ * When the archive is already in memory, copy straight from it instead of
+ * going through the device's read method.
+ */
+static ssize_t cpio_read(struct file *af, void *dst, size_t count)
+{
+    const void *src;
+    ssize_t     res = file_direct_access(af, af->f_pos, count, &src);
+    if (res == -ENOTSUP) return file_read(af, dst, count);
+    if (res <= 0) return res;
+
+    memcpy(dst, src, res);
+    af->f_pos += res;
+    return res;
+}
+
 /**
  * Check CPIO magic numbers and read in raw header data
  *
@@ -135,7 +154,7 @@ static ssize_t cpio_read_header_raw(struct file *f, struct cpio_header *h)
     *h = (struct cpio_header){.hoff = f->f_pos};
 
     /* Read enough bytes to check ASCII magic numbers. */
-    ct += res = file_read(f, h->bytes, 6);
+    ct += res = cpio_read(f, h->bytes, 6);
     if (res < 0) return res;
     if (res == 0) {
         pr_error(CPIOH(h, "read past EOF\n"));
@@ -153,7 +172,7 @@ static ssize_t cpio_read_header_raw(struct file *f, struct cpio_header *h)
     }
 
     /* Read rest of header. */
-    ct += res = file_read(f, h->bytes + ct, h->hsize - ct);
+    ct += res = cpio_read(f, h->bytes + ct, h->hsize - ct);
     if (res < 0) return res;
 
     return ct;
@@ -212,13 +231,21 @@ static ssize_t cpio_read_pathname(struct file *f, struct cpio_header *h)
 
     /* Read pathname. */
     ssize_t readsz = MIN(h->psize, sizeof(h->pathname));
+    if (!readsz) return -EINVAL;
     while (ct < readsz) {
-        ct += res = file_read(f, h->pathname + ct, readsz - ct);
+        ct += res = cpio_read(f, h->pathname + ct, readsz - ct);
         if (res < 0) return res;
     }
-    if (h->psize > sizeof(h->pathname)) return -EOVERFLOW;
+    if (h->pathname[readsz - 1] != '\0') return -EOVERFLOW;
     pr_debug(CPIOH(h, "got pathname\n"));
 
+    /* Names may be padded with extra NULs, e.g. to align file data. */
+    if (h->psize > (size_t) readsz) {
+        res = file_lseek(f, h->psize - readsz, SEEK_CUR);
+        if (res < 0) return res;
+        ct += h->psize - readsz;
+    }
+
     /* Skip post-path padding. */
     if (h->ppad != 0) {
         res = file_lseek(f, h->ppad, SEEK_CUR);
@@ -260,194 +287,782 @@ static ssize_t cpio_skip_fdata(struct file *f, struct cpio_header *h)
 
 ///@}
 
-/** @name CPIO searches */
+/** @name CPIO path index
+ *
+ * The archive is scanned once at mount time. Every entry goes into a hash
+ * table keyed by path, so opening or stat'ing a file never has to read and
+ * decode archive headers again. Entries are also linked into a tree, each
+ * directory with a list of its direct children, for readdir.
+ *
+ * Archives packed by mkinitrd end with their own sorted index (see
+ * cpioidx.h), however many entries they have. It is searched by bisection
+ * where it lies, so nothing is scanned or copied at mount time.
+ *
+ * An archive without its own index and with more entries or path names
+ * than the hash table has room for is still mounted, but unindexed: see
+ * @ref cpio_scan_find.
+ */
 ///@{
 
-static int cpio_find_path(struct file *f, const char *p, struct cpio_header *h)
+#define CPIO_INDEX_MAX 128  ///< Max entries hashed per archive
+#define CPIO_HASH_SIZE 256  ///< Hash slots; power of two > CPIO_INDEX_MAX
+#define CPIO_NAMES_SZ  4096 ///< Space for the path names of all entries
+#define CPIO_SB_MAX    2    ///< Max mounted CPIO archives
+
+/** What we need to know about an archive entry without reading it again */
+struct cpio_entry {
+    const char  *path; ///< Path name, in @ref cpio_index.names
+    uint32_t     hash; ///< Hash of path
+    loff_t       foff; ///< Offset of file data inside archive file
+    struct fstat stat; ///< Metadata; f_ino is the entry's index
+
+    /** @name Directory tree links: entry index + 1, or 0 for none */
+    ///@{
+    uint16_t child;   ///< First child, if a directory
+    uint16_t sibling; ///< Next entry in the same directory
+    ///@}
+};
+
+struct cpio_index {
+    struct superblock *sb; ///< Owning superblock, or NULL if unused
+    struct file        af; ///< Archive file, open while mounted
+
+    struct cpio_entry entries[CPIO_INDEX_MAX]; ///< Entries in archive order
+    size_t            nentries;
+
+    /** Open-addressed hash table: entry index + 1, or 0 if empty */
+    uint16_t slots[CPIO_HASH_SIZE];
+
+    char   names[CPIO_NAMES_SZ];
+    size_t namesz;
+
+    /** @name The archive's own index, if it has one */
+    ///@{
+    struct cpioidx_footer       foot;
+    const struct cpioidx_entry *own_entries; ///< In memory, or NULL to read
+    const char                 *own_names;   ///< In memory, or NULL to read
+    ///@}
+
+    int sorted; ///< Search the archive's own index, not slots
+    int scan;   ///< Too big to index; search the archive itself
+};
+
+static struct cpio_index cpio_indexes[CPIO_SB_MAX];
+
+static struct cpio_index *cpio_index_alloc(struct superblock *sb)
 {
-    int res;
-    *h = (struct cpio_header){};
-    pr_debug("find_path %s\n", p);
-    for (size_t i = 0; !h->is_endmarker; i++) {
-        res = cpio_read_header(f, h);
+    for (size_t i = 0; i < ARRAY_SIZE(cpio_indexes); i++) {
+        struct cpio_index *idx = &cpio_indexes[i];
+        if (!idx->sb) {
+            *idx = (struct cpio_index){.sb = sb};
+            return idx;
+        }
+    }
+    return NULL;
+}
+
+static void cpio_index_free(struct cpio_index *idx) { idx->sb = NULL; }
+
+/** FNV-1a string hash */
+static uint32_t cpio_hash(const char *s)
+{
+    uint32_t hash = 2166136261u;
+    for (; *s; s++) hash = (hash ^ (unsigned char) *s) * 16777619u;
+    return hash;
+}
+
+static const struct cpio_entry *
+cpio_index_find(const struct cpio_index *idx, const char *path)
+{
+    uint32_t hash = cpio_hash(path);
+    for (size_t i = hash;; i++) {
+        unsigned slot = idx->slots[i % CPIO_HASH_SIZE];
+        if (!slot) return NULL;
+        const struct cpio_entry *e = &idx->entries[slot - 1];
+        if (e->hash == hash && strcmp(e->path, path) == 0) return e;
+    }
+}
+
+/** Record the entry for a header that has just been read */
+static int cpio_index_add(struct cpio_index *idx, const struct cpio_header *h)
+{
+    int    res;
+    size_t len = strlen(h->pathname) + 1;
+
+    if (idx->nentries >= CPIO_INDEX_MAX || idx->namesz + len > CPIO_NAMES_SZ)
+        return -ENOSPC;
+
+    /* The first entry with a given path wins, as with a linear search. */
+    if (cpio_index_find(idx, h->pathname)) return 0;
+
+    struct cpio_entry *e = &idx->entries[idx->nentries];
+
+    *e = (struct cpio_entry){
+            .path = idx->names + idx->namesz,
+            .hash = cpio_hash(h->pathname),
+            .foff = h->hoff + h->hsize + h->psize + h->ppad,
+    };
+    res = cpioh_fstat(h, &e->stat);
+    if (res < 0) return res;
+    e->stat.f_ino = idx->nentries;
+
+    memcpy(idx->names + idx->namesz, h->pathname, len);
+    idx->namesz += len;
+
+    size_t i = e->hash;
+    while (idx->slots[i % CPIO_HASH_SIZE]) i++;
+    idx->slots[i % CPIO_HASH_SIZE] = ++idx->nentries;
+    return 0;
+}
+
+/** Find the entry for the directory that holds an entry */
+static struct cpio_entry *
+cpio_index_parent(const struct cpio_index *idx, const struct cpio_entry *e)
+{
+    if (strcmp(e->path, ".") == 0) return NULL;
+
+    char        dir[PATH_MAX] = ".";
+    const char *slash         = strrchr(e->path, '/');
+    if (slash) {
+        int dirlen = slash - e->path;
+        snprintf(dir, sizeof(dir), "%.*s", dirlen, e->path);
+    }
+    return (struct cpio_entry *) cpio_index_find(idx, dir);
+}
+
+/** Link every entry into its parent directory's list of children */
+static void cpio_index_link(struct cpio_index *idx)
+{
+    /* Go backwards, so that prepending keeps children in archive order. */
+    for (size_t i = idx->nentries; i-- > 0;) {
+        struct cpio_entry *e      = &idx->entries[i];
+        struct cpio_entry *parent = cpio_index_parent(idx, e);
+        if (!parent || parent->stat.f_type != DT_DIR) {
+            if (strcmp(e->path, ".") != 0)
+                pr_debug("%s: no parent directory, not listed\n", e->path);
+            continue;
+        }
+        e->sibling    = parent->child;
+        parent->child = i + 1;
+    }
+}
+
+/** Read every header in the archive into the index */
+static int cpio_index_scan(struct cpio_index *idx, struct file *af)
+{
+    int                res;
+    struct cpio_header h = {};
+    for (;;) {
+        res = cpio_read_header(af, &h);
         if (res < 0) return res;
+        if (h.is_endmarker) break;
 
-        if (strcmp(h->pathname, p) == 0) return i;
+        res = cpio_index_add(idx, &h);
+        if (res < 0) return res;
 
-        res = cpio_skip_fdata(f, h);
+        res = cpio_skip_fdata(af, &h);
         if (res < 0) return res;
     }
-    return -ENOENT;
+    return 0;
 }
 
-///@}
+/**
+ * Read exactly count bytes at an offset in the archive
+ *
+ * When the archive is already in memory, copy straight from it.
+ */
+static int
+cpio_pread_full(struct file *af, void *dst, size_t count, loff_t off)
+{
+    const void *src;
+    ssize_t     res = file_direct_access(af, off, count, &src);
+    if (res > 0) memcpy(dst, src, res);
+    else if (res == -ENOTSUP) res = file_pread(af, dst, count, off);
+    if (res < 0) return res;
+    return (size_t) res == count ? 0 : -EIO;
+}
 
-/** @name CPIOfs driver data for files */
-///@{
+/** Get a region of the archive in place, or NULL if it is not in memory */
+static const void *cpio_in_place(struct file *af, size_t count, loff_t off)
+{
+    const void *addr;
+    ssize_t     res = file_direct_access(af, off, count, &addr);
+    return res >= 0 && (size_t) res == count ? addr : NULL;
+}
 
-struct cfdata {
-    struct file        af;   ///< Archive file.
-    struct cpio_header h;    ///< Header for target file.
-    loff_t             foff; ///< Offset of target file inside archive file.
+/**
+ * Find the index that mkinitrd puts at the end of an archive
+ *
+ * Only the footer is read and checked. Where the archive is in memory, the
+ * entry table and the path names are used in place; elsewhere, the entries
+ * are read one at a time as they are searched.
+ *
+ * @returns 1 if found, 0 if the archive has no index, or a negative error
+ *          code if it has one that cannot be used.
+ */
+static int cpio_index_load(struct cpio_index *idx, struct file *af)
+{
+    int                    res;
+    struct cpioidx_footer *foot = &idx->foot;
+
+    loff_t footoff = af->f_stat.f_size - (loff_t) sizeof(*foot);
+    if (footoff < 0) return 0;
+    res = cpio_pread_full(af, foot, sizeof(*foot), footoff);
+    if (res < 0) return res;
+    if (memcmp(foot->magic, CPIOIDX_MAGIC, sizeof(foot->magic)) != 0)
+        return 0;
+
+    /* Both tables must fit in the archive, and the last name must end. */
+    uint64_t tabsz = (uint64_t) foot->nentries * sizeof(struct cpioidx_entry);
+    if (foot->entries_off + tabsz > (uint64_t) footoff
+        || (uint64_t) foot->names_off + foot->names_size > (uint64_t) footoff
+        || !foot->names_size)
+        return -EINVAL;
+    char   last;
+    loff_t lastoff = (loff_t) foot->names_off + foot->names_size - 1;
+    res            = cpio_pread_full(af, &last, 1, lastoff);
+    if (res < 0) return res;
+    if (last != '\0') return -EINVAL;
+
+    idx->own_entries = cpio_in_place(af, tabsz, foot->entries_off);
+    idx->own_names   = cpio_in_place(af, foot->names_size, foot->names_off);
+    idx->sorted      = 1;
+    return 1;
+}
+
+/** An entry of an archive's own index, and its path */
+struct cpio_own_entry {
+    struct cpioidx_entry ie;
+    const char          *path;          ///< In place, or in buf
+    char                 buf[PATH_MAX]; ///< Path, if it had to be read
 };
 
-#define MAX_CPIO_OPEN 4
-static struct cfdata cfdatas[MAX_CPIO_OPEN];
+/** Get entry i of the archive's own index */
+static int cpio_own_get(
+        struct cpio_index *idx, size_t i, struct cpio_own_entry *oe
+)
+{
+    int                          res;
+    const struct cpioidx_footer *foot = &idx->foot;
+
+    if (idx->own_entries) {
+        memcpy(&oe->ie, &idx->own_entries[i], sizeof(oe->ie));
+    } else {
+        loff_t ieoff = foot->entries_off + (loff_t) i * sizeof(oe->ie);
+        res = cpio_pread_full(&idx->af, &oe->ie, sizeof(oe->ie), ieoff);
+        if (res < 0) return res;
+    }
+    if (oe->ie.name_off >= foot->names_size) return -EINVAL;
 
-static struct cfdata *cfdata_alloc(void)
+    /* The names end with a NUL, which was checked at mount time. */
+    if (idx->own_names) {
+        oe->path = idx->own_names + oe->ie.name_off;
+        return 0;
+    }
+    size_t n    = MIN(sizeof(oe->buf), foot->names_size - oe->ie.name_off);
+    loff_t noff = (loff_t) foot->names_off + oe->ie.name_off;
+    res         = cpio_pread_full(&idx->af, oe->buf, n, noff);
+    if (res < 0) return res;
+    if (!memchr(oe->buf, '\0', n)) return -ENAMETOOLONG;
+    oe->path = oe->buf;
+    return 0;
+}
+
+/** Fill in a lookup result from entry i of the archive's own index */
+static int cpio_own_entry(
+        const struct cpio_own_entry *oe, size_t i, struct cpio_entry *e
+)
 {
-    for (size_t i = 0; i < ARRAY_SIZE(cfdatas); i++) {
-        struct cfdata *cfdata = cfdatas + i;
-        if (!cfdata->af.f_op) return cfdata;
+    const struct cpioidx_entry *ie = &oe->ie;
+
+    *e      = (struct cpio_entry){.foff = ie->data_off};
+    e->stat = (struct fstat){
+            .f_ino  = i,
+            .f_type = cpio_mode_to_dirtype(ie->mode),
+            .f_rdev = MAKEDEV(ie->rdev_major, ie->rdev_minor),
+            .f_size = ie->size,
+    };
+    return (int) e->stat.f_type < 0 ? -EINVAL : 0;
+}
+
+/**
+ * Bisect the archive's own index for the first path not less than path
+ *
+ * @returns the entry's position, nentries if there is none, or a negative
+ *          error code.
+ */
+static ssize_t cpio_own_lower_bound(struct cpio_index *idx, const char *path)
+{
+    struct cpio_own_entry oe;
+    size_t                lo = 0, hi = idx->foot.nentries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int    res = cpio_own_get(idx, mid, &oe);
+        if (res < 0) return res;
+        if (strcmp(oe.path, path) < 0) lo = mid + 1;
+        else hi = mid;
     }
-    return NULL;
+    return lo;
+}
+
+/** Look up a path in the archive's own index */
+static int
+cpio_own_find(struct cpio_index *idx, const char *path, struct cpio_entry *e)
+{
+    struct cpio_own_entry oe;
+    ssize_t               pos = cpio_own_lower_bound(idx, path);
+    if (pos < 0) return pos;
+    if ((size_t) pos == idx->foot.nentries) return -ENOENT;
+
+    int res = cpio_own_get(idx, pos, &oe);
+    if (res < 0) return res;
+    if (strcmp(oe.path, path) != 0) return -ENOENT;
+    return cpio_own_entry(&oe, pos, e);
 }
 
-static void cfdata_free(struct cfdata *cfdata) { cfdata->af.f_op = NULL; }
+/**
+ * Find the next entry in a directory of an archive with its own index
+ *
+ * A directory's entries all start with its path and a slash, so they lie
+ * together in the sorted table, with those of its subdirectories. The
+ * position is the next table entry to look at + 1, or 0 before the first.
+ *
+ * @returns 1 and sets the entry, its name and the next position, 0 at the
+ *          end of the directory, or a negative error code.
+ */
+static int cpio_own_dir_next(
+        struct file *f, struct cpio_entry *e, char *name, loff_t *next
+)
+{
+    struct cpio_index    *idx = f->f_inode->i_sb->s_driver_data;
+    struct cpio_own_entry oe;
+    int                   res = cpio_own_get(idx, f->f_stat.f_ino, &oe);
+    if (res < 0) return res;
+
+    /* Entries of the root directory have no slash at all. */
+    char prefix[PATH_MAX] = "";
+    if (strcmp(oe.path, ".") != 0
+        && snprintf(prefix, sizeof(prefix), "%s/", oe.path)
+                   >= (int) sizeof(prefix))
+        return -ENAMETOOLONG;
+    size_t plen = strlen(prefix);
+
+    ssize_t pos = f->f_pos - 1;
+    if (!f->f_pos) pos = cpio_own_lower_bound(idx, prefix);
+    if (pos < 0) return pos;
+
+    for (; (size_t) pos < idx->foot.nentries; pos++) {
+        res = cpio_own_get(idx, pos, &oe);
+        if (res < 0) return res;
+        if (strncmp(oe.path, prefix, plen) != 0) break;
+
+        const char *rest = oe.path + plen;
+        if (strcmp(oe.path, ".") == 0 || strchr(rest, '/')) continue;
+
+        res = cpio_own_entry(&oe, pos, e);
+        if (res < 0) return res;
+        snprintf(name, PATH_MAX, "%s", rest);
+        *next = pos + 2;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Index the archive, from its own index if it has one
+ *
+ * If the archive does not fit in the index, it is left unindexed.
+ */
+static int cpio_index_build(struct cpio_index *idx, struct file *af)
+{
+    int res = cpio_index_load(idx, af);
+    debug_result(res, "find archive's own index\n");
+    if (res > 0) return 0;
+    if (res == 0) res = cpio_index_scan(idx, af);
+    if (res == -ENOSPC) {
+        pr_info("archive too large to index; searching it instead\n");
+        memset(idx->slots, 0, sizeof(idx->slots));
+        idx->nentries = idx->namesz = 0;
+        idx->scan                   = 1;
+        return 0;
+    }
+    if (res < 0) return res;
+
+    cpio_index_link(idx);
+    return 0;
+}
 
 ///@}
 
-/** @name CPIOfs Operations */
+/** @name Unindexed archives
+ *
+ * Paths are found by reading headers from the start of the archive, as if
+ * there were no index. Inode numbers are header offsets, so a directory can
+ * find its own path again by reading its header.
+ */
 ///@{
 
-static int cpio_sb_open(struct superblock *sb)
+/** Fill in an entry from a header that has just been read */
+static int cpio_scan_entry(const struct cpio_header *h, struct cpio_entry *e)
 {
-    int res;
+    *e = (struct cpio_entry){.foff = h->hoff + h->hsize + h->psize + h->ppad};
+    int res = cpioh_fstat(h, &e->stat);
+    if (res < 0) return res;
+    e->stat.f_ino = h->hoff;
+    return 0;
+}
+
+/** Whether a path names an entry directly inside a directory */
+static int cpio_path_in_dir(const char *path, const char *dir)
+{
+    if (strcmp(path, ".") == 0) return 0;
+    const char *slash = strrchr(path, '/');
+    if (!slash) return strcmp(dir, ".") == 0;
 
-    struct file af; // Archive File
-    res = file_open_dev(&af, sb->s_bdev);
+    size_t len = slash - path;
+    return strlen(dir) == len && strncmp(path, dir, len) == 0;
+}
+
+/** Read headers from the start of the archive until one with a path */
+static int cpio_scan_find(
+        struct superblock *sb, const char *path, struct cpio_entry *e
+)
+{
+    struct file        af;
+    struct cpio_header h   = {};
+    int                res = file_open_dev(&af, sb->s_bdev);
     if (res < 0) return res;
 
-    file_debugstr(sb->s_name, sizeof(sb->s_name), &af);
+    for (;;) {
+        res = cpio_read_header(&af, &h);
+        if (res < 0) break;
+        res = -ENOENT;
+        if (h.is_endmarker) break;
+        if (strcmp(h.pathname, path) == 0) {
+            res = cpio_scan_entry(&h, e);
+            break;
+        }
+        res = cpio_skip_fdata(&af, &h);
+        if (res < 0) break;
+    }
 
-    /* Find root inode. */
-    struct cpio_header h = {};
-    sb->s_root_ino = res = cpio_find_path(&af, ".", &h);
-    debug_result(res, "find root dir: header #%u\n", sb->s_root_ino);
-    if (res < 0) goto close_and_return;
+    file_close(&af);
+    return res;
+}
 
-close_and_return:
+/**
+ * Find the next entry in a directory, for readdir
+ *
+ * The position is the archive offset to continue reading headers from.
+ *
+ * @returns 1 and sets the entry, its name and the next position, 0 at the
+ *          end of the archive, or a negative error code.
+ */
+static int cpio_scan_dir_next(
+        struct file *f, struct cpio_entry *e, char *name, loff_t *next
+)
+{
+    struct file        af;
+    struct cpio_header h   = {};
+    int                res = file_open_dev(&af, f->f_inode->i_sb->s_bdev);
+    if (res < 0) return res;
+
+    /* The directory's own path, from its header. */
+    char dir[PATH_MAX];
+    res = file_lseek(&af, f->f_stat.f_ino, SEEK_SET);
+    if (res >= 0) res = cpio_read_header(&af, &h);
+    if (res < 0) goto exit;
+    snprintf(dir, sizeof(dir), "%s", h.pathname);
+
+    res = file_lseek(&af, f->f_pos, SEEK_SET);
+    while (res >= 0) {
+        res = cpio_read_header(&af, &h);
+        if (res < 0) break;
+        res = 0;
+        if (h.is_endmarker) break;
+        res = cpio_skip_fdata(&af, &h);
+        if (res < 0 || !cpio_path_in_dir(h.pathname, dir)) continue;
+
+        res = cpio_scan_entry(&h, e);
+        if (res < 0) break;
+        path_basename(name, PATH_MAX, h.pathname);
+        *next = af.f_pos;
+        res   = 1;
+        break;
+    }
+
+exit:
     file_close(&af);
     return res;
 }
 
+///@}
+
+/** @name CPIO lookups */
+///@{
+
+/** Look up a path, giving a copy of its entry */
 static int
-cpio_file_open_path(struct file *f, struct superblock *sb, const char *path)
+cpio_lookup(struct superblock *sb, const char *path, struct cpio_entry *e)
 {
-    int res, isopen_af = 0;
+    struct cpio_index *idx = sb->s_driver_data;
     if (!*path) path = ".";
+    if (idx->scan) return cpio_scan_find(sb, path, e);
+    if (idx->sorted) return cpio_own_find(idx, path, e);
+
+    const struct cpio_entry *found = cpio_index_find(idx, path);
+    if (!found) return -ENOENT;
+    *e = *found;
+    return 0;
+}
 
-    /* Allocate a CPIO file data structure. */
-    struct cfdata *cfdata = cfdata_alloc();
-    res                   = cfdata ? 0 : -ENOMEM;
-    if (!cfdata) goto exit;
+///@}
 
-    /* Open the archive file. */
-    res = file_open_dev(&cfdata->af, sb->s_bdev);
-    if (res < 0) goto exit;
-    isopen_af = 1;
+/** @name CPIOfs files
+ *
+ * An open file keeps the archive offset of its data in
+ * @ref file.f_driver_data. In an indexed archive, the inode number is the
+ * file's position in the index, and the index keeps the archive open while
+ * mounted.
+ */
+///@{
+
+#define CPIO_DIR_END (CPIO_INDEX_MAX + 1) ///< readdir position after the end
 
-    /* Search for the desired path. */
-    res = cpio_find_path(&cfdata->af, path, &cfdata->h);
+static struct cpio_index *cpio_file_index(struct file *f)
+{
+    return f->f_inode->i_sb->s_driver_data;
+}
+
+static const struct cpio_entry *cpio_file_entry(struct file *f)
+{
+    return &cpio_file_index(f)->entries[f->f_stat.f_ino];
+}
+
+///@}
+
+/** @name CPIOfs Operations */
+///@{
+
+static int cpio_sb_open(struct superblock *sb)
+{
+    int res;
+
+    struct cpio_index *idx = cpio_index_alloc(sb);
+    if (!idx) return -ENOMEM;
+
+    res = file_open_dev(&idx->af, sb->s_bdev);
     if (res < 0) goto exit;
 
-    /* Copy metadata fields. */
-    res = cpioh_fstat(&cfdata->h, &f->f_stat);
+    file_debugstr(sb->s_name, sizeof(sb->s_name), &idx->af);
+
+    /* Index the whole archive. */
+    res = cpio_index_build(idx, &idx->af);
+    debug_result(
+            res, "index archive: %zu entries\n",
+            idx->sorted ? (size_t) idx->foot.nentries : idx->nentries
+    );
     if (res < 0) goto exit;
+    sb->s_driver_data = idx;
 
-    /* Finish file setup. */
-    cfdata->foff = cfdata->h.hoff + cfdata->h.hsize + cfdata->h.psize
-                   + cfdata->h.ppad;
-    f->f_driver_data = cfdata;
+    /* Find root inode. */
+    struct cpio_entry root;
+    res = cpio_lookup(sb, ".", &root);
+    if (res < 0) goto exit;
+    sb->s_root_ino = root.stat.f_ino;
+    debug_result(res, "find root dir: inode #%u\n", sb->s_root_ino);
 
-    res = 0;
 exit:
     if (res < 0) {
-        if (cfdata && isopen_af) file_close(&cfdata->af);
-        if (cfdata) cfdata_free(cfdata);
+        file_close(&idx->af);
+        cpio_index_free(idx);
     }
     return res;
 }
 
-static int cpio_file_release(struct file *f)
+static int cpio_sb_release(struct superblock *sb)
 {
-    if (f->f_driver_data) cfdata_free(f->f_driver_data);
+    struct cpio_index *idx = sb->s_driver_data;
+    if (idx) {
+        file_close(&idx->af);
+        cpio_index_free(idx);
+    }
     return 0;
 }
 
-static ssize_t
-cpio_file_read(struct file *f, void *dst, size_t count, loff_t *off)
+static int
+cpio_stat_path(struct fstat *fstat, struct superblock *sb, const char *path)
 {
-    struct cfdata *cfdata = f->f_driver_data;
+    struct cpio_entry e;
+    int               res = cpio_lookup(sb, path, &e);
+    if (res < 0) return res;
+    *fstat = e.stat;
+    return 0;
+}
 
-    /* Get target offset within archive file. */
-    loff_t aoff = *off + cfdata->foff;
+static int
+cpio_file_open_path(struct file *f, struct superblock *sb, const char *path)
+{
+    /* Look up the desired path. */
+    struct cpio_entry e;
+    int               res = cpio_lookup(sb, path, &e);
+    if (res < 0) return res;
+
+    /* Share the inode with other opens of the same file. */
+    int           isnew;
+    struct inode *inode = inode_get(sb, e.stat.f_ino, &isnew);
+    if (!inode) return -ENFILE;
+    if (isnew) inode->i_stat = e.stat;
 
+    f->f_inode       = inode;
+    f->f_stat        = inode->i_stat;
+    f->f_driver_data = (void *) (uintptr_t) e.foff;
+    return 0;
+}
+
+/** Clamp a request for target file data, and give its archive offset */
+static size_t
+cpio_file_range(struct file *f, size_t count, loff_t off, loff_t *aoff)
+{
     /* Don't read archive file past end of target file. */
-    if (*off + (loff_t) count > f->f_stat.f_size)
-        count = f->f_stat.f_size - f->f_pos;
+    if (off >= f->f_stat.f_size) return 0;
+    if (off + (loff_t) count > f->f_stat.f_size)
+        count = f->f_stat.f_size - off;
+
+    /* Get target offset within archive file. */
+    *aoff = off + (uintptr_t) f->f_driver_data;
+    return count;
+}
+
+static ssize_t cpio_file_direct_access(
+        struct file *f, loff_t off, size_t count, const void **addr
+)
+{
+    struct cpio_index *idx = cpio_file_index(f);
+
+    loff_t aoff;
+    count = cpio_file_range(f, count, off, &aoff);
+    if (!count) return 0;
+    return file_direct_access(&idx->af, aoff, count, addr);
+}
+
+static ssize_t
+cpio_file_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    struct cpio_index *idx = cpio_file_index(f);
 
-    /* Read target file within archive file. */
-    int res = file_pread(&cfdata->af, dst, count, aoff);
+    loff_t aoff;
+    count = cpio_file_range(f, count, *off, &aoff);
+    if (!count) return 0;
+
+    /* Copy straight from memory if the archive is there, or read it. */
+    const void *src;
+    ssize_t     res = file_direct_access(&idx->af, aoff, count, &src);
+    if (res > 0) memcpy(dst, src, res);
+    else if (res == -ENOTSUP) res = file_pread(&idx->af, dst, count, aoff);
     if (res < 0) return res;
-    aoff += res;
 
     /* Set resulting offset. */
-    *off = aoff - cfdata->foff;
-
+    *off += res;
     return res;
 }
 
-static int cpio_file_readdir(struct file *f, struct dirent *d)
+/**
+ * Start a read without waiting for it
+ *
+ * Where the archive is in memory, as an initrd usually is, the data is
+ * copied and the read completes at once, rather than waiting its turn at
+ * the async worker. Other reads are left to the worker.
+ */
+static int cpio_file_aio_submit(struct file *f, struct file_aio *io)
 {
-    int res;
+    struct cpio_index *idx = cpio_file_index(f);
+    if (io->op != AIO_READ || io->off < 0) return -ENOTSUP;
 
-    struct cfdata *cfdata  = f->f_driver_data;
-    const char    *dirpath = cfdata->h.pathname;
-    if (strcmp(dirpath, ".") == 0) dirpath = "";
-    int dirpathlen = strlen(dirpath);
+    loff_t      aoff;
+    const void *src   = NULL;
+    size_t      count = cpio_file_range(f, io->count, io->off, &aoff);
+    if (count && !(src = cpio_in_place(&idx->af, count, aoff)))
+        return -ENOTSUP;
 
-    /* If the archive was just opened, the position should be just after
-     * the directory's own header. Skip to the next header. */
-    if (f->f_pos == 0) {
-        res = cpio_skip_fdata(&cfdata->af, &cfdata->h);
-        if (res < 0) return res;
-    }
+    if (count) memcpy(io->buf, src, count);
+    file_aio_complete(io, count);
+    return 0;
+}
 
-    /* Read entries from archive file starting at current position,
-     * looking for an entry whos path begins with the directory's path. */
-    struct cpio_header h = {};
-    for (;;) {
-        res = cpio_read_header(&cfdata->af, &h);
-        if (res < 0) return res;
-        res = cpio_skip_fdata(&cfdata->af, &h);
-        if (res < 0) return res;
+/**
+ * The entry that a directory read would return next
+ *
+ * Reads of a hashed archive walk the directory's own list of children.
+ * The position is the next child as an entry index + 1, or 0 before the
+ * first child.
+ *
+ * @returns 1 and sets the entry, its name and the position after it, 0 at
+ *          the end of the directory, or a negative error code.
+ */
+static int cpio_dir_peek(
+        struct file *f, struct cpio_entry *e, char *name, loff_t *next
+)
+{
+    struct cpio_index *idx = cpio_file_index(f);
+    if (idx->scan) return cpio_scan_dir_next(f, e, name, next);
+    if (idx->sorted) return cpio_own_dir_next(f, e, name, next);
 
-        if (h.is_endmarker) return 0;
-        if (strncmp(h.pathname, dirpath, dirpathlen) == 0) break;
-    }
+    size_t pos = f->f_pos ? (size_t) f->f_pos : cpio_file_entry(f)->child;
+    if (!pos || pos == CPIO_DIR_END) return 0;
 
-    struct fstat fstat;
-    cpioh_fstat(&h, &fstat);
-    d->d_ino  = fstat.f_ino;
-    d->d_type = fstat.f_type;
+    *e    = idx->entries[pos - 1];
+    *next = e->sibling ? e->sibling : CPIO_DIR_END;
+    path_basename(name, PATH_MAX, e->path);
+    return 1;
+}
 
-    const char *relpath = path_strip_prefix(h.pathname, dirpath);
-    snprintf(d->d_name, PATH_MAX, "%s", relpath);
+static int cpio_file_readdir(struct file *f, struct dirent *d)
+{
+    struct cpio_entry e;
+    loff_t            next;
+    int               res = cpio_dir_peek(f, &e, d->d_name, &next);
+    if (res <= 0) return res;
+    f->f_pos = next;
+
+    d->d_ino  = e.stat.f_ino;
+    d->d_type = e.stat.f_type;
     return 1;
 }
 
+static ssize_t
+cpio_file_readdir_batch(struct file *f, void *buf, size_t size)
+{
+    size_t            used = 0;
+    struct cpio_entry e;
+    char              name[PATH_MAX];
+    loff_t            next;
+    int               res;
+    while ((res = cpio_dir_peek(f, &e, name, &next)) > 0) {
+        const struct fstat *st = &e.stat;
+        if (!dirent_rec_put(buf, size, &used, st->f_ino, st->f_type, name))
+            return used ? (ssize_t) used : -EINVAL;
+        f->f_pos = next;
+    }
+    return res < 0 && !used ? res : (ssize_t) used;
+}
+
 static const struct file_operations cpio_file_ops = {
         .name      = "cpio_file",
+        .stat_path = cpio_stat_path,
         .open_path = cpio_file_open_path,
-        .release   = cpio_file_release,
         .read      = cpio_file_read,
         .readdir   = cpio_file_readdir,
+
+        .readdir_batch = cpio_file_readdir_batch,
+        .direct_access = cpio_file_direct_access,
+        .aio_submit    = cpio_file_aio_submit,
 };
 
 static const struct fs_operations cpio_fs_ops = {
         .name        = "cpiofs",
         .sb_open     = cpio_sb_open,
+        .sb_release  = cpio_sb_release,
         .fs_file_ops = &cpio_file_ops,
 };
 
@@ -0,0 +1,798 @@
+/**
+ * @file
+ * ext2fs: a read-only driver for the second extended filesystem
+ *
+ * The disk is split into block groups, each with its own table of inodes.
+ * An inode lists the first blocks of its file directly, and the rest
+ * through indirect blocks. Directories are files holding a list of entries,
+ * so finding a name costs a scan of that one directory rather than of the
+ * whole filesystem, as it would in a CPIO archive.
+ *
+ * Metadata (group descriptors, inodes, directories and indirect blocks) is
+ * read through the page cache. File data is read through the device file,
+ * which copies straight from memory when the device has its data there.
+ *
+ * @see
+ * - [The Second Extended File System](https://www.nongnu.org/ext2-doc/)
+ */
+// #define LOG_LEVEL LOG_DEBUG
+
+#include <cpu_pagemap.h>
+
+#include <drivers/blkdev.h>
+#include <drivers/devices.h>
+#include <drivers/log.h>
+#include <drivers/pagecache.h>
+#include <drivers/vfs.h>
+
+#include <core/compiler.h>
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+#include <core/types.h>
+
+#include <stdint.h>
+
+#define EXT2_SUPER_OFFSET  1024   ///< Byte offset of the superblock
+#define EXT2_MAGIC         0xef53 ///< Superblock magic number
+#define EXT2_ROOT_INO      2      ///< Inode number of the root directory
+#define EXT2_SB_MAX        2      ///< Max mounted ext2 filesystems
+#define EXT2_LOG_BLOCK_MAX 6      ///< Largest block size is 1024 << this
+
+/** @name Block pointers in an inode */
+///@{
+#define EXT2_NDIR_BLOCKS 12 ///< Direct block pointers
+#define EXT2_IND_BLOCK   12 ///< Singly indirect block pointer
+#define EXT2_N_BLOCKS    15 ///< All block pointers, up to triply indirect
+///@}
+
+/** @name Inode mode field bits */
+///@{
+#define EXT2_S_IFMT  0xf000
+#define EXT2_S_IFIFO 0x1000
+#define EXT2_S_IFCHR 0x2000
+#define EXT2_S_IFDIR 0x4000
+#define EXT2_S_IFBLK 0x6000
+#define EXT2_S_IFREG 0x8000
+///@}
+
+/** @name Directory entry file types */
+///@{
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR      2
+#define EXT2_FT_CHRDEV   3
+#define EXT2_FT_BLKDEV   4
+#define EXT2_FT_FIFO     5
+///@}
+
+/** @name Incompatible features */
+///@{
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002 ///< Dir entries hold file type
+#define EXT2_FEATURE_INCOMPAT_FLEX_BG  0x0200 ///< Group metadata packed
+
+/** Features that do not change how a read-only driver finds data */
+#define EXT2_FEATURE_INCOMPAT_SUPP \
+    (EXT2_FEATURE_INCOMPAT_FILETYPE | EXT2_FEATURE_INCOMPAT_FLEX_BG)
+///@}
+
+/** @name On-disk structures (little-endian, like the CPU) */
+///@{
+
+/** Superblock, up to the fields that we need */
+struct ext2_super {
+    uint32_t s_inodes_count;
+    uint32_t s_blocks_count;
+    uint32_t s_r_blocks_count;
+    uint32_t s_free_blocks_count;
+    uint32_t s_free_inodes_count;
+    uint32_t s_first_data_block;
+    uint32_t s_log_block_size; ///< Block size is 1024 << this
+    uint32_t s_log_frag_size;
+    uint32_t s_blocks_per_group;
+    uint32_t s_frags_per_group;
+    uint32_t s_inodes_per_group;
+    uint32_t s_mtime;
+    uint32_t s_wtime;
+    uint16_t s_mnt_count;
+    uint16_t s_max_mnt_count;
+    uint16_t s_magic;
+    uint16_t s_state;
+    uint16_t s_errors;
+    uint16_t s_minor_rev_level;
+    uint32_t s_lastcheck;
+    uint32_t s_checkinterval;
+    uint32_t s_creator_os;
+    uint32_t s_rev_level;
+    uint16_t s_def_resuid;
+    uint16_t s_def_resgid;
+
+    /** @name Revision 1 and later */
+    ///@{
+    uint32_t s_first_ino;
+    uint16_t s_inode_size;
+    uint16_t s_block_group_nr;
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    ///@}
+} ATTR_PACKED;
+
+/** Block group descriptor */
+struct ext2_group_desc {
+    uint32_t bg_block_bitmap;
+    uint32_t bg_inode_bitmap;
+    uint32_t bg_inode_table; ///< First block of the group's inode table
+    uint16_t bg_free_blocks_count;
+    uint16_t bg_free_inodes_count;
+    uint16_t bg_used_dirs_count;
+    uint16_t bg_pad;
+    uint32_t bg_reserved[3];
+} ATTR_PACKED;
+
+/** Inode, in its original 128-byte form */
+struct ext2_inode {
+    uint16_t i_mode;
+    uint16_t i_uid;
+    uint32_t i_size;
+    uint32_t i_atime;
+    uint32_t i_ctime;
+    uint32_t i_mtime;
+    uint32_t i_dtime;
+    uint16_t i_gid;
+    uint16_t i_links_count;
+    uint32_t i_blocks;
+    uint32_t i_flags;
+    uint32_t i_osd1;
+    uint32_t i_block[EXT2_N_BLOCKS]; ///< Block pointers; 0 is a hole
+    uint32_t i_generation;
+    uint32_t i_file_acl;
+    uint32_t i_dir_acl;
+    uint32_t i_faddr;
+    uint8_t  i_osd2[12];
+} ATTR_PACKED;
+
+/** Directory entry header; the name follows, without a terminator */
+struct ext2_dir_entry {
+    uint32_t inode;   ///< Inode number, or 0 if the entry is unused
+    uint16_t rec_len; ///< Bytes to the next entry
+    uint8_t  name_len;
+    uint8_t  file_type; ///< With the filetype feature, else 0
+} ATTR_PACKED;
+
+///@}
+
+/** What we keep about a mounted filesystem */
+struct ext2_fs {
+    struct superblock *sb; ///< Owning superblock, or NULL if unused
+    struct blkdev     *bd; ///< Device, for metadata through the page cache
+    struct file        df; ///< Device file, for file data; open while mounted
+
+    uint32_t block_size;
+    uint32_t nblocks;
+    uint32_t ninodes;
+    uint32_t inodes_per_group;
+    uint32_t inode_size;
+    uint32_t gdt_block; ///< First block of the group descriptor table
+    uint32_t incompat;  ///< Incompatible feature flags
+};
+
+static struct ext2_fs ext2_fses[EXT2_SB_MAX];
+
+static struct ext2_fs *ext2_fs_alloc(struct superblock *sb)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(ext2_fses); i++) {
+        struct ext2_fs *fs = &ext2_fses[i];
+        if (!fs->sb) {
+            *fs = (struct ext2_fs){.sb = sb};
+            return fs;
+        }
+    }
+    return NULL;
+}
+
+static void ext2_fs_free(struct ext2_fs *fs) { fs->sb = NULL; }
+
+/** @name Block and inode access */
+///@{
+
+/**
+ * Get a filesystem block from the page cache
+ *
+ * Blocks are a power of two no larger than a page, so every block lies
+ * within one page. Release the page with @ref pcache_put when done.
+ */
+static int ext2_bread(
+        struct ext2_fs *fs, uint32_t block, struct cpage **pgp,
+        const char **data
+)
+{
+    if (!block || block >= fs->nblocks) {
+        pr_error("%s: block %u out of range\n", fs->sb->s_name, block);
+        return -EIO;
+    }
+
+    size_t        per_page = PAGESZ / fs->block_size;
+    struct cpage *pg       = blkdev_get_page(fs->bd, NULL, block / per_page);
+    if (!pg) return -ENOMEM;
+    if (!pg->uptodate) {
+        int res = pg->err ? pg->err : -EIO;
+        pcache_put(pg);
+        return res;
+    }
+
+    *pgp  = pg;
+    *data = (const char *) pg->data + block % per_page * fs->block_size;
+    return 0;
+}
+
+/** Copy part of a filesystem block */
+static int ext2_bcopy(
+        struct ext2_fs *fs, uint32_t block, size_t off, void *dst, size_t n
+)
+{
+    struct cpage *pg;
+    const char   *data;
+    int           res = ext2_bread(fs, block, &pg, &data);
+    if (res < 0) return res;
+    memcpy(dst, data + off, n);
+    pcache_put(pg);
+    return 0;
+}
+
+static int
+ext2_read_inode(struct ext2_fs *fs, ino_t ino, struct ext2_inode *ei)
+{
+    int res;
+
+    if (ino < 1 || ino > fs->ninodes) {
+        pr_error("%s: inode %u out of range\n", fs->sb->s_name, ino);
+        return -EIO;
+    }
+
+    /* Find the group's inode table. */
+    uint32_t group     = (ino - 1) / fs->inodes_per_group;
+    uint32_t index     = (ino - 1) % fs->inodes_per_group;
+    uint32_t descs_per = fs->block_size / sizeof(struct ext2_group_desc);
+
+    struct ext2_group_desc gd;
+    res = ext2_bcopy(
+            fs, fs->gdt_block + group / descs_per,
+            group % descs_per * sizeof(gd), &gd, sizeof(gd)
+    );
+    if (res < 0) return res;
+
+    /* Inode sizes are a power of two, so no inode straddles two blocks. */
+    uint32_t off = index * fs->inode_size;
+    return ext2_bcopy(
+            fs, gd.bg_inode_table + off / fs->block_size,
+            off % fs->block_size, ei, sizeof(*ei)
+    );
+}
+
+/**
+ * Find the disk block that holds a block of a file
+ *
+ * The first blocks are listed in the inode itself. The blocks after those
+ * are listed in an indirect block, then in blocks listed by a doubly
+ * indirect block, and then one level deeper again.
+ *
+ * @returns 0 and sets *block, to 0 for a hole; or a negative error code.
+ */
+static int ext2_bmap(
+        struct ext2_fs *fs, const struct ext2_inode *ei, uint32_t fblock,
+        uint32_t *block
+)
+{
+    int res;
+
+    if (fblock < EXT2_NDIR_BLOCKS) {
+        *block = ei->i_block[fblock];
+        return 0;
+    }
+    fblock -= EXT2_NDIR_BLOCKS;
+
+    /* Find the level of indirection, and how many file blocks are covered
+     * by each pointer in the top indirect block. */
+    uint32_t per   = fs->block_size / sizeof(uint32_t);
+    uint32_t span  = 1;
+    int      level = 1;
+    for (; level <= EXT2_N_BLOCKS - EXT2_IND_BLOCK; level++) {
+        if (fblock / per < span) break;
+        fblock -= per * span;
+        span *= per;
+    }
+    if (level > EXT2_N_BLOCKS - EXT2_IND_BLOCK) return -EIO;
+
+    /* Follow pointers down to the data block. */
+    uint32_t b = ei->i_block[EXT2_IND_BLOCK + level - 1];
+    for (; b && level > 0; level--) {
+        uint32_t i = fblock / span;
+        res        = ext2_bcopy(fs, b, i * sizeof(b), &b, sizeof(b));
+        if (res < 0) return res;
+        fblock %= span;
+        span /= per;
+    }
+    *block = b;
+    return 0;
+}
+
+/** Convert an inode's mode field to a @ref dirtype value */
+static enum dirtype ext2_mode_to_dirtype(uint16_t mode)
+{
+    switch (mode & EXT2_S_IFMT) {
+    case EXT2_S_IFREG: return DT_REG;
+    case EXT2_S_IFDIR: return DT_DIR;
+    case EXT2_S_IFCHR: return DT_CHR;
+    case EXT2_S_IFBLK: return DT_CHR;
+    case EXT2_S_IFIFO: return DT_FIFO;
+    default: return DT_UNKNOWN;
+    }
+}
+
+/** Convert a directory entry's file type to a @ref dirtype value */
+static enum dirtype ext2_ft_to_dirtype(uint8_t ft)
+{
+    switch (ft) {
+    case EXT2_FT_REG_FILE: return DT_REG;
+    case EXT2_FT_DIR: return DT_DIR;
+    case EXT2_FT_CHRDEV: return DT_CHR;
+    case EXT2_FT_BLKDEV: return DT_CHR;
+    case EXT2_FT_FIFO: return DT_FIFO;
+    default: return DT_UNKNOWN;
+    }
+}
+
+static void
+ext2_inode_stat(const struct ext2_inode *ei, ino_t ino, struct fstat *fstat)
+{
+    *fstat = (struct fstat){
+            .f_ino  = ino,
+            .f_type = ext2_mode_to_dirtype(ei->i_mode),
+            .f_size = ei->i_size,
+    };
+
+    /* Device numbers are kept in the first block pointers, in the old
+     * 8-bit encoding if it fits, else in the newer 20-bit one. */
+    if (fstat->f_type == DT_CHR) {
+        uint32_t old = ei->i_block[0], new = ei->i_block[1];
+        fstat->f_rdev = old ? MAKEDEV((old >> 8) & 0xff, old & 0xff)
+                            : MAKEDEV((new >> 8) & 0xfff,
+                                      (new & 0xff) | ((new >> 12) & 0xfff00));
+    }
+}
+
+///@}
+
+/** @name Directories and path lookup */
+///@{
+
+/** Check that a directory entry fits in what is left of its block */
+static int ext2_dirent_ok(
+        struct ext2_fs *fs, const struct ext2_dir_entry *de, size_t left
+)
+{
+    if (left < sizeof(*de) || de->rec_len < sizeof(*de) || de->rec_len > left
+        || de->rec_len % 4 || sizeof(*de) + de->name_len > de->rec_len) {
+        pr_error("%s: corrupt directory entry\n", fs->sb->s_name);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Look up a name in a directory
+ *
+ * The directory is scanned block by block, so the cost grows with the size
+ * of this directory and not with the size of the filesystem.
+ */
+static int ext2_dir_find(
+        struct ext2_fs *fs, const struct ext2_inode *dir, const char *name,
+        size_t len, ino_t *ino
+)
+{
+    int res;
+
+    size_t nblocks = ALIGN_UP(dir->i_size, fs->block_size) / fs->block_size;
+    for (uint32_t fb = 0; fb < nblocks; fb++) {
+        uint32_t block;
+        res = ext2_bmap(fs, dir, fb, &block);
+        if (res < 0) return res;
+        if (!block) continue;
+
+        struct cpage *pg;
+        const char   *data;
+        res = ext2_bread(fs, block, &pg, &data);
+        if (res < 0) return res;
+
+        for (size_t off = 0; off < fs->block_size;) {
+            const struct ext2_dir_entry *de = (const void *) (data + off);
+            if (!ext2_dirent_ok(fs, de, fs->block_size - off)) {
+                pcache_put(pg);
+                return -EIO;
+            }
+            if (de->inode && de->name_len == len
+                && memcmp(de + 1, name, len) == 0) {
+                *ino = de->inode;
+                pcache_put(pg);
+                return 0;
+            }
+            off += de->rec_len;
+        }
+        pcache_put(pg);
+    }
+    return -ENOENT;
+}
+
+/** Follow a path from the root directory to an inode */
+static int ext2_walk(
+        struct ext2_fs *fs, const char *path, ino_t *ino, struct ext2_inode *ei
+)
+{
+    int res;
+
+    *ino = EXT2_ROOT_INO;
+    res  = ext2_read_inode(fs, *ino, ei);
+    if (res < 0) return res;
+
+    while (*path) {
+        /* Split off the next component. Directories hold their own "."
+         * and ".." entries, so those need no special handling. */
+        while (*path == '/') path++;
+        size_t len = 0;
+        while (path[len] && path[len] != '/') len++;
+        if (!len) break;
+
+        if ((ei->i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) return -ENOTDIR;
+        res = ext2_dir_find(fs, ei, path, len, ino);
+        if (res < 0) return res;
+        res = ext2_read_inode(fs, *ino, ei);
+        if (res < 0) return res;
+        path += len;
+    }
+    return 0;
+}
+
+///@}
+
+/** @name ext2fs files
+ *
+ * Open files share an inode from the VFS inode cache. A copy of the on-disk
+ * inode is kept with it, in @ref ext2_inodes, so that mapping file blocks
+ * never reads the inode again. The filesystem is read-only, so the copy
+ * never goes stale.
+ */
+///@{
+
+/** On-disk inodes, by slot in the VFS inode cache (see inode_index) */
+static struct ext2_inode ext2_inodes[INODE_MAX];
+
+static struct ext2_fs *ext2_file_fs(struct file *f)
+{
+    return f->f_inode->i_sb->s_driver_data;
+}
+
+static const struct ext2_inode *ext2_file_inode(struct file *f)
+{
+    return f->f_inode->i_private;
+}
+
+/** Find where a range of file data is on the device, within one block */
+static ssize_t ext2_file_map(
+        struct file *f, loff_t off, size_t count, loff_t *doff
+)
+{
+    int             res;
+    struct ext2_fs *fs = ext2_file_fs(f);
+
+    /* Don't read past end of file. */
+    if (off >= f->f_stat.f_size) return 0;
+    if (off + (loff_t) count > f->f_stat.f_size)
+        count = f->f_stat.f_size - off;
+
+    uint32_t block, boff = off % fs->block_size;
+    res = ext2_bmap(fs, ext2_file_inode(f), off / fs->block_size, &block);
+    if (res < 0) return res;
+
+    *doff = block ? (loff_t) block * fs->block_size + boff : 0;
+    return MIN(count, fs->block_size - boff);
+}
+
+///@}
+
+/** @name ext2fs Operations */
+///@{
+
+static int ext2_sb_open(struct superblock *sb)
+{
+    int res;
+
+    struct ext2_fs *fs = ext2_fs_alloc(sb);
+    if (!fs) return -ENOMEM;
+
+    fs->bd = blkdev_get(sb->s_bdev);
+    res    = fs->bd ? 0 : -ENODEV;
+    if (res < 0) goto exit_free;
+
+    res = file_open_dev(&fs->df, sb->s_bdev);
+    if (res < 0) goto exit_free;
+    file_debugstr(sb->s_name, sizeof(sb->s_name), &fs->df);
+
+    /* Read and check the superblock. */
+    struct ext2_super es;
+    res = file_pread(&fs->df, &es, sizeof(es), EXT2_SUPER_OFFSET);
+    if (res >= 0) res = res == sizeof(es) && es.s_magic == EXT2_MAGIC;
+    if (res == 0) res = -EINVAL;
+    log_result(res, "%s: find ext2 superblock\n", sb->s_name);
+    if (res < 0) goto exit;
+
+    res = es.s_log_block_size <= EXT2_LOG_BLOCK_MAX ? 0 : -ENOTSUP;
+    if (res < 0) {
+        pr_error("%s: block size too large\n", sb->s_name);
+        goto exit;
+    }
+
+    fs->block_size       = 1024 << es.s_log_block_size;
+    fs->nblocks          = es.s_blocks_count;
+    fs->ninodes          = es.s_inodes_count;
+    fs->inodes_per_group = es.s_inodes_per_group;
+    fs->inode_size       = es.s_rev_level ? es.s_inode_size : 128;
+    fs->gdt_block        = es.s_first_data_block + 1;
+    fs->incompat         = es.s_rev_level ? es.s_feature_incompat : 0;
+
+    /* Blocks must fit in a cache page, and inodes must not straddle
+     * blocks. */
+    res = 0;
+    if (fs->block_size > PAGESZ || !fs->inodes_per_group) res = -ENOTSUP;
+    if (fs->inode_size < sizeof(struct ext2_inode)) res = -ENOTSUP;
+    if (fs->inode_size & (fs->inode_size - 1)) res = -ENOTSUP;
+    log_result(
+            res, "%s: block size %u, inode size %u\n", sb->s_name,
+            fs->block_size, fs->inode_size
+    );
+    if (res < 0) goto exit;
+
+    res = fs->incompat & ~EXT2_FEATURE_INCOMPAT_SUPP ? -ENOTSUP : 0;
+    debug_result(res, "%s: incompat features %#x\n", sb->s_name, fs->incompat);
+    if (res < 0) goto exit;
+
+    res = fs->nblocks <= fs->bd->size / fs->block_size ? 0 : -EINVAL;
+    debug_result(
+            res, "%s: %u blocks fit on device\n", sb->s_name, fs->nblocks
+    );
+    if (res < 0) goto exit;
+
+    sb->s_root_ino    = EXT2_ROOT_INO;
+    sb->s_driver_data = fs;
+
+exit:
+    if (res < 0) file_close(&fs->df);
+exit_free:
+    if (res < 0) ext2_fs_free(fs);
+    return res;
+}
+
+static int ext2_sb_release(struct superblock *sb)
+{
+    struct ext2_fs *fs = sb->s_driver_data;
+    if (fs) {
+        file_close(&fs->df);
+        ext2_fs_free(fs);
+    }
+    return 0;
+}
+
+static int
+ext2_stat_path(struct fstat *fstat, struct superblock *sb, const char *path)
+{
+    ino_t             ino;
+    struct ext2_inode ei;
+    int               res = ext2_walk(sb->s_driver_data, path, &ino, &ei);
+    if (res < 0) return res;
+    ext2_inode_stat(&ei, ino, fstat);
+    return 0;
+}
+
+static int
+ext2_file_open_path(struct file *f, struct superblock *sb, const char *path)
+{
+    ino_t             ino;
+    struct ext2_inode ei;
+    int               res = ext2_walk(sb->s_driver_data, path, &ino, &ei);
+    if (res < 0) return res;
+
+    /* Share the inode with other opens of the same file. */
+    int           isnew;
+    struct inode *inode = inode_get(sb, ino, &isnew);
+    if (!inode) return -ENFILE;
+    if (isnew) {
+        struct ext2_inode *copy = &ext2_inodes[inode_index(inode)];
+        *copy                   = ei;
+        inode->i_private        = copy;
+        ext2_inode_stat(&ei, ino, &inode->i_stat);
+    }
+
+    f->f_inode = inode;
+    f->f_stat  = inode->i_stat;
+    return 0;
+}
+
+static ssize_t ext2_file_direct_access(
+        struct file *f, loff_t off, size_t count, const void **addr
+)
+{
+    loff_t  doff;
+    ssize_t res = ext2_file_map(f, off, count, &doff);
+    if (res <= 0) return res;
+    if (!doff) return -ENOTSUP; // Holes have no data to point at.
+    return file_direct_access(&ext2_file_fs(f)->df, doff, res, addr);
+}
+
+static ssize_t
+ext2_file_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    struct ext2_fs *fs  = ext2_file_fs(f);
+    char           *pos = dst;
+    ssize_t         res = 0;
+
+    /* Read a block at a time, since consecutive file blocks need not be
+     * consecutive on disk. */
+    while (count) {
+        loff_t doff;
+        res = ext2_file_map(f, *off, count, &doff);
+        if (res <= 0) break;
+
+        /* Holes read as zeros. Copy other data straight from memory if
+         * the device is there, or read it. */
+        const void *src;
+        size_t      chunk = res;
+        if (!doff) memset(pos, 0, chunk);
+        else if ((res = file_direct_access(&fs->df, doff, chunk, &src)) > 0)
+            memcpy(pos, src, res);
+        else if (res == -ENOTSUP) res = file_pread(&fs->df, pos, chunk, doff);
+        if (res <= 0) break;
+        if (doff) chunk = res;
+
+        pos += chunk;
+        count -= chunk;
+        *off += chunk;
+    }
+
+    if (pos > (char *) dst) return pos - (char *) dst;
+    return res;
+}
+
+/**
+ * Read the directory entry at the file position, skipping holes
+ *
+ * The position is the byte offset of an entry within the directory. It is
+ * left at the entry; add the entry's rec_len to move past it.
+ *
+ * @returns 1 with the entry and its name, 0 at the end of the directory,
+ *          or a negative error code.
+ */
+static int ext2_dir_peek(
+        struct ext2_fs *fs, const struct ext2_inode *ei, struct file *f,
+        struct ext2_dir_entry *de, char name[256]
+)
+{
+    int res;
+
+    while (f->f_pos < f->f_stat.f_size) {
+        uint32_t block, boff = f->f_pos % fs->block_size;
+        res = ext2_bmap(fs, ei, f->f_pos / fs->block_size, &block);
+        if (res < 0) return res;
+        if (!block) {
+            f->f_pos += fs->block_size - boff;
+            continue;
+        }
+
+        res = ext2_bcopy(fs, block, boff, de, sizeof(*de));
+        if (res < 0) return res;
+        if (!ext2_dirent_ok(fs, de, fs->block_size - boff)) return -EIO;
+        res = ext2_bcopy(fs, block, boff + sizeof(*de), name, de->name_len);
+        if (res < 0) return res;
+        name[de->name_len] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+/** Whether to list an entry: not unused, and not "." or ".." */
+static int
+ext2_dirent_listed(const struct ext2_dir_entry *de, const char *name)
+{
+    return de->inode && strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+/** Get an entry's @ref dirtype, from the entry if it has it, or its inode */
+static int
+ext2_dirent_type(struct ext2_fs *fs, const struct ext2_dir_entry *de)
+{
+    if (fs->incompat & EXT2_FEATURE_INCOMPAT_FILETYPE)
+        return ext2_ft_to_dirtype(de->file_type);
+
+    struct ext2_inode child;
+    int               res = ext2_read_inode(fs, de->inode, &child);
+    if (res < 0) return res;
+    return ext2_mode_to_dirtype(child.i_mode);
+}
+
+static int ext2_file_readdir(struct file *f, struct dirent *d)
+{
+    int                      res;
+    struct ext2_fs          *fs = ext2_file_fs(f);
+    const struct ext2_inode *ei = ext2_file_inode(f);
+
+    struct ext2_dir_entry de;
+    char                  name[256];
+    while ((res = ext2_dir_peek(fs, ei, f, &de, name)) > 0) {
+        f->f_pos += de.rec_len;
+        if (!ext2_dirent_listed(&de, name)) continue;
+
+        res = ext2_dirent_type(fs, &de);
+        if (res < 0) return res;
+        d->d_ino  = de.inode;
+        d->d_type = res;
+        snprintf(d->d_name, PATH_MAX, "%s", name);
+        return 1;
+    }
+    return res;
+}
+
+static ssize_t ext2_file_readdir_batch(struct file *f, void *buf, size_t size)
+{
+    int                      res;
+    struct ext2_fs          *fs   = ext2_file_fs(f);
+    const struct ext2_inode *ei   = ext2_file_inode(f);
+    size_t                   used = 0;
+
+    struct ext2_dir_entry de;
+    char                  name[256];
+    while ((res = ext2_dir_peek(fs, ei, f, &de, name)) > 0) {
+        if (ext2_dirent_listed(&de, name)) {
+            int type = ext2_dirent_type(fs, &de);
+            if (type < 0) return used ? (ssize_t) used : type;
+            if (!dirent_rec_put(buf, size, &used, de.inode, type, name))
+                return used ? (ssize_t) used : -EINVAL;
+        }
+        f->f_pos += de.rec_len;
+    }
+    return used || res >= 0 ? (ssize_t) used : res;
+}
+
+static const struct file_operations ext2_file_ops = {
+        .name      = "ext2_file",
+        .stat_path = ext2_stat_path,
+        .open_path = ext2_file_open_path,
+        .read      = ext2_file_read,
+        .readdir   = ext2_file_readdir,
+
+        .readdir_batch = ext2_file_readdir_batch,
+        .direct_access = ext2_file_direct_access,
+};
+
+static const struct fs_operations ext2_fs_ops = {
+        .name        = "ext2fs",
+        .sb_open     = ext2_sb_open,
+        .sb_release  = ext2_sb_release,
+        .fs_file_ops = &ext2_file_ops,
+};
+
+/** Check whether a device holds an ext2 filesystem, by its magic number */
+int ext2_probe(dev_t dev)
+{
+    struct file       f = {};
+    struct ext2_super es;
+
+    int res = file_open_dev(&f, dev);
+    if (res < 0) return res;
+    res = file_pread(&f, &es, sizeof(es), EXT2_SUPER_OFFSET);
+    file_close(&f);
+    if (res < 0) return res;
+    return res == sizeof(es) && es.s_magic == EXT2_MAGIC;
+}
+
+int init_driver_ext2fs(void) { return fs_register(FS_EXT2, &ext2_fs_ops); }
+
+///@}
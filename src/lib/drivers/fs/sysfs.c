@@ -0,0 +1,281 @@
+/**
+ * @file
+ * sysfs: a read-only filesystem of kernel counters, see sysfs.h
+ *
+ * The tree is two levels deep: a directory per group under the root, and a
+ * file per counter in its group. Nothing is stored but the table of
+ * registered counters; directories are found by scanning it. Counter files
+ * report a size of 0, since the length of the value is only known once it
+ * is formatted, so read them to end of file.
+ */
+// #define LOG_LEVEL LOG_DEBUG
+
+#include <drivers/devices.h>
+#include <drivers/log.h>
+#include <drivers/pagecache.h>
+#include <drivers/sysfs.h>
+#include <drivers/vfs.h>
+
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+
+#define SYSFS_VALUE_MAX 24 ///< Longest formatted value, with newline
+
+struct sysfs_attr {
+    const char     *group;
+    const char     *name;
+    enum sysfs_type type;
+    const void     *val;
+};
+
+static struct sysfs_attr sysfs_attrs[SYSFS_ATTRS_MAX];
+static size_t            sysfs_nattrs;
+
+/** @name Inode numbers */
+///@{
+#define SYSFS_INO_ROOT       1
+#define SYSFS_INO_ATTR(i)    (2 + (i))                   ///< Counter file
+#define SYSFS_INO_GROUP(i)   (2 + SYSFS_ATTRS_MAX + (i)) ///< By 1st counter
+///@}
+
+/** @name Counter table */
+///@{
+
+/**
+ * Register a counter; use @ref SYSFS_COUNTER
+ *
+ * The strings and the variable must live as long as the kernel.
+ */
+int sysfs_add(
+        const char *group, const char *name, enum sysfs_type type,
+        const void *val
+)
+{
+    int res = sysfs_nattrs < SYSFS_ATTRS_MAX ? 0 : -ENOSPC;
+    debug_result(res, "sysfs: add counter %s/%s\n", group, name);
+    if (res < 0) return res;
+
+    sysfs_attrs[sysfs_nattrs++] = (struct sysfs_attr){
+            .group = group,
+            .name  = name,
+            .type  = type,
+            .val   = val,
+    };
+    return 0;
+}
+
+/** Does the counter belong to a group with this name? */
+static int sysfs_in_group(size_t i, const char *group, size_t len)
+{
+    return strncmp(sysfs_attrs[i].group, group, len) == 0
+           && sysfs_attrs[i].group[len] == '\0';
+}
+
+/** Index of the first counter in a group, or -1 if there is no such group */
+static int sysfs_find_group(const char *group, size_t len)
+{
+    for (size_t i = 0; i < sysfs_nattrs; i++)
+        if (sysfs_in_group(i, group, len)) return i;
+    return -1;
+}
+
+/** Is this counter the first of its group, and so stands for the group? */
+static int sysfs_group_leader(size_t i)
+{
+    const char *group = sysfs_attrs[i].group;
+    return sysfs_find_group(group, strlen(group)) == (int) i;
+}
+
+static int sysfs_format(const struct sysfs_attr *a, char *buf, size_t n)
+{
+    switch (a->type) {
+    case SYSFS_UINT:
+        return snprintf(buf, n, "%u\n", *(const volatile unsigned *) a->val);
+    case SYSFS_ULONG:
+        return snprintf(
+                buf, n, "%lu\n", *(const volatile unsigned long *) a->val
+        );
+    case SYSFS_ULLONG:
+        return snprintf(
+                buf, n, "%llu\n", *(const volatile unsigned long long *) a->val
+        );
+    }
+    return -EINVAL;
+}
+
+///@}
+
+/** @name sysfs Operations */
+///@{
+
+static int sysfs_sb_open(struct superblock *sb)
+{
+    snprintf(sb->s_name, sizeof(sb->s_name), "sysfs");
+    sb->s_root_ino = SYSFS_INO_ROOT;
+    return 0;
+}
+
+/** Look up a path, giving its metadata and counter index (-1 for root) */
+static int sysfs_lookup(const char *path, struct fstat *fstat, int *idx)
+{
+    *fstat = (struct fstat){.f_ino = SYSFS_INO_ROOT, .f_type = DT_DIR};
+    *idx   = -1;
+    if (!*path) return 0;
+
+    /* Group directory. */
+    const char *slash = strchr(path, '/');
+    size_t      glen  = slash ? (size_t) (slash - path) : strlen(path);
+    int         i     = sysfs_find_group(path, glen);
+    if (i < 0) return -ENOENT;
+    fstat->f_ino = SYSFS_INO_GROUP(i);
+    *idx         = i;
+    if (!slash || !slash[1]) return 0;
+
+    /* Counter file. */
+    const char *name = slash + 1;
+    for (size_t j = i; j < sysfs_nattrs; j++) {
+        if (!sysfs_in_group(j, path, glen)) continue;
+        if (strcmp(sysfs_attrs[j].name, name) != 0) continue;
+        fstat->f_ino  = SYSFS_INO_ATTR(j);
+        fstat->f_type = DT_REG;
+        *idx          = j;
+        return 0;
+    }
+    return strchr(name, '/') ? -ENOTDIR : -ENOENT;
+}
+
+static int
+sysfs_stat_path(struct fstat *fstat, struct superblock *sb, const char *path)
+{
+    UNUSED(sb);
+    int idx;
+    return sysfs_lookup(path, fstat, &idx);
+}
+
+static int
+sysfs_open_path(struct file *f, struct superblock *sb, const char *path)
+{
+    UNUSED(sb);
+    int idx;
+    int res = sysfs_lookup(path, &f->f_stat, &idx);
+    if (res < 0) return res;
+    f->f_driver_data = idx < 0 ? NULL : &sysfs_attrs[idx];
+    f->f_pos         = 0;
+    return 0;
+}
+
+static ssize_t
+sysfs_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    if (f->f_stat.f_type != DT_REG) return -EISDIR;
+
+    char buf[SYSFS_VALUE_MAX];
+    int  len = sysfs_format(f->f_driver_data, buf, sizeof(buf));
+    if (len < 0) return len;
+
+    if (*off < 0) *off = 0;
+    if (*off >= len) return 0;
+    count = MIN(count, (size_t) (len - *off));
+    memcpy(dst, buf + *off, count);
+    *off += count;
+    return count;
+}
+
+/**
+ * The index of the next counter to list in a directory, or -1 at the end
+ *
+ * The root lists each group once, by its first counter. A group lists its
+ * counters. The position is the index to continue the scan from.
+ */
+static int sysfs_dir_peek(struct file *f)
+{
+    const struct sysfs_attr *dir = f->f_driver_data;
+    for (size_t i = f->f_pos; i < sysfs_nattrs; i++) {
+        if (dir ? sysfs_in_group(i, dir->group, strlen(dir->group))
+                : sysfs_group_leader(i))
+            return i;
+    }
+    return -1;
+}
+
+static void sysfs_dir_entry(
+        struct file *f, size_t i, ino_t *ino, enum dirtype *type,
+        const char **name
+)
+{
+    if (f->f_driver_data) {
+        *ino  = SYSFS_INO_ATTR(i);
+        *type = DT_REG;
+        *name = sysfs_attrs[i].name;
+    } else {
+        *ino  = SYSFS_INO_GROUP(i);
+        *type = DT_DIR;
+        *name = sysfs_attrs[i].group;
+    }
+}
+
+static int sysfs_readdir(struct file *f, struct dirent *d)
+{
+    if (f->f_stat.f_type != DT_DIR) return -ENOTDIR;
+    int i = sysfs_dir_peek(f);
+    if (i < 0) return 0;
+    f->f_pos = i + 1;
+
+    enum dirtype type;
+    const char  *name;
+    sysfs_dir_entry(f, i, &d->d_ino, &type, &name);
+    d->d_type = type;
+    snprintf(d->d_name, PATH_MAX, "%s", name);
+    return 1;
+}
+
+static ssize_t sysfs_readdir_batch(struct file *f, void *buf, size_t size)
+{
+    if (f->f_stat.f_type != DT_DIR) return -ENOTDIR;
+
+    size_t used = 0;
+    int    i;
+    while ((i = sysfs_dir_peek(f)) >= 0) {
+        ino_t        ino;
+        enum dirtype type;
+        const char  *name;
+        sysfs_dir_entry(f, i, &ino, &type, &name);
+        if (!dirent_rec_put(buf, size, &used, ino, type, name))
+            return used ? (ssize_t) used : -EINVAL;
+        f->f_pos = i + 1;
+    }
+    return used;
+}
+
+static const struct file_operations sysfs_file_ops = {
+        .name      = "sysfs_file",
+        .stat_path = sysfs_stat_path,
+        .open_path = sysfs_open_path,
+        .read      = sysfs_read,
+        .readdir   = sysfs_readdir,
+
+        .readdir_batch = sysfs_readdir_batch,
+};
+
+static const struct fs_operations sysfs_fs_ops = {
+        .name        = "sysfs",
+        .sb_open     = sysfs_sb_open,
+        .fs_file_ops = &sysfs_file_ops,
+};
+
+///@}
+
+/** Register the filesystem, and the counters of the VFS layer itself */
+int init_driver_sysfs(void)
+{
+    SYSFS_COUNTER("pcache", "hits", pcache_stats.hits);
+    SYSFS_COUNTER("pcache", "misses", pcache_stats.misses);
+    SYSFS_COUNTER("pcache", "evictions", pcache_stats.evictions);
+    SYSFS_COUNTER("pcache", "readahead", pcache_stats.readahead);
+    SYSFS_COUNTER("dcache", "hits", dcache_stats.hits);
+    SYSFS_COUNTER("dcache", "neg_hits", dcache_stats.neg_hits);
+    SYSFS_COUNTER("dcache", "misses", dcache_stats.misses);
+    return fs_register(FS_SYS, &sysfs_fs_ops);
+}
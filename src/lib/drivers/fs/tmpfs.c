@@ -0,0 +1,631 @@
+/**
+ * @file
+ * tmpfs: a writable filesystem that lives entirely in memory
+ *
+ * File data is kept in pages taken from a fixed pool when first written.
+ * Each file finds its pages through a radix tree indexed by page number, so
+ * a file's pages never need to be contiguous and any page is reached in
+ * O(log n) steps. Pages that were never written are holes and read as zeros.
+ *
+ * The pools, trees and directories are shared by every task, so they are
+ * only touched with interrupts disabled. Reads and writes disable them one
+ * page at a time.
+ */
+// #define LOG_LEVEL LOG_DEBUG
+
+#include <cpu_interrupt.h>
+#include <cpu_pagemap.h>
+
+#include <drivers/devices.h>
+#include <drivers/log.h>
+#include <drivers/sysfs.h>
+#include <drivers/vfs.h>
+
+#include <core/compiler.h>
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+#include <core/types.h>
+
+#include <stdint.h>
+
+#define TMPFS_NODES_MAX 64  ///< Files and directories, across all mounts
+#define TMPFS_PAGES_MAX 128 ///< Data pages, across all mounts
+#define TMPFS_NAME_MAX  32  ///< Max length of a file name
+
+/** @name Page pool */
+///@{
+
+static ATTR_ALIGNED(PAGESZ) unsigned char tmpfs_pages[TMPFS_PAGES_MAX][PAGESZ];
+static size_t tmpfs_pages_used;      ///< Pages handed out from the pool
+static void  *tmpfs_page_free_list;  ///< Returned pages, linked by 1st word
+static size_t tmpfs_pages_inuse;     ///< Pages holding file data
+
+/** Get a zeroed page, or NULL if the pool is exhausted */
+static void *tmpfs_page_alloc(void)
+{
+    void *page = tmpfs_page_free_list;
+    if (page) tmpfs_page_free_list = *(void **) page;
+    else if (tmpfs_pages_used < TMPFS_PAGES_MAX)
+        page = tmpfs_pages[tmpfs_pages_used++];
+    if (page) memset(page, 0, PAGESZ);
+    if (page) tmpfs_pages_inuse++;
+    return page;
+}
+
+static void tmpfs_page_free(void *page)
+{
+    *(void **) page      = tmpfs_page_free_list;
+    tmpfs_page_free_list = page;
+    tmpfs_pages_inuse--;
+}
+
+///@}
+
+/**
+ * @name Radix tree of pages
+ *
+ * A tree of height h has h levels of nodes above the pages and holds pages
+ * 0 to FANOUT^h - 1. A tree of height 0 is a single page, page 0. The tree
+ * grows taller at the top when a page beyond its reach is written.
+ */
+///@{
+
+#define RADIX_SHIFT     5 ///< Index bits consumed per level
+#define RADIX_FANOUT    (1 << RADIX_SHIFT)
+#define RADIX_NODES_MAX 64 ///< Nodes in the pool, across all files
+
+struct radix_node {
+    void *slots[RADIX_FANOUT]; ///< Child nodes, or pages at the bottom
+};
+
+struct radix_root {
+    unsigned height; ///< Levels of nodes
+    void    *ptr;    ///< Top node, or the only page if height is 0
+};
+
+static struct radix_node radix_nodes[RADIX_NODES_MAX];
+static size_t            radix_nodes_used;
+static void             *radix_node_free_list;
+
+static struct radix_node *radix_node_alloc(void)
+{
+    struct radix_node *node = radix_node_free_list;
+    if (node) radix_node_free_list = node->slots[0];
+    else if (radix_nodes_used < RADIX_NODES_MAX)
+        node = &radix_nodes[radix_nodes_used++];
+    if (node) *node = (struct radix_node){};
+    return node;
+}
+
+static void radix_node_free(struct radix_node *node)
+{
+    node->slots[0]       = radix_node_free_list;
+    radix_node_free_list = node;
+}
+
+/** Highest page index that a tree of a given height can hold */
+static size_t radix_maxindex(unsigned height)
+{
+    if (height * RADIX_SHIFT >= sizeof(size_t) * 8) return SIZE_MAX;
+    return ((size_t) 1 << (height * RADIX_SHIFT)) - 1;
+}
+
+/** Slot number within a node at height h for a page index */
+static unsigned radix_slot(size_t index, unsigned h)
+{
+    return (index >> ((h - 1) * RADIX_SHIFT)) & (RADIX_FANOUT - 1);
+}
+
+/** Find a page, or NULL if it is a hole */
+static void *radix_lookup(const struct radix_root *root, size_t index)
+{
+    if (index > radix_maxindex(root->height)) return NULL;
+    void *ptr = root->ptr;
+    for (unsigned h = root->height; h > 0 && ptr; h--)
+        ptr = ((struct radix_node *) ptr)->slots[radix_slot(index, h)];
+    return ptr;
+}
+
+/** Free a chain of new nodes, each with at most one child, from a slot */
+static void radix_free_chain(void **slot)
+{
+    struct radix_node *node = *slot;
+    *slot                   = NULL;
+    while (node) {
+        struct radix_node *next = NULL;
+        for (unsigned i = 0; i < RADIX_FANOUT && !next; i++)
+            next = node->slots[i];
+        radix_node_free(node);
+        node = next;
+    }
+}
+
+/**
+ * Find a page, allocating it and the nodes above it if needed
+ *
+ * If the pools run out, the nodes added so far are freed again, and the
+ * tree is left as it was.
+ */
+static void *radix_get(struct radix_root *root, size_t index)
+{
+    unsigned height = root->height;
+    void   **fresh  = NULL; ///< Slot of the first node added on the way down
+
+    /* Grow the tree until it reaches index. An empty tree just gets
+     * taller; otherwise the old top moves down into slot 0 of a new top. */
+    while (index > radix_maxindex(root->height)) {
+        if (root->ptr) {
+            struct radix_node *top = radix_node_alloc();
+            if (!top) goto fail;
+            top->slots[0] = root->ptr;
+            root->ptr     = top;
+        }
+        root->height++;
+    }
+
+    void **slot = &root->ptr;
+    for (unsigned h = root->height; h > 0; h--) {
+        if (!*slot) {
+            if (!(*slot = radix_node_alloc())) goto fail;
+            if (!fresh) fresh = slot;
+        }
+        slot = &((struct radix_node *) *slot)->slots[radix_slot(index, h)];
+    }
+    if (!*slot) *slot = tmpfs_page_alloc();
+    if (*slot) return *slot;
+
+fail:
+    if (fresh) radix_free_chain(fresh);
+    for (; root->height > height; root->height--) {
+        struct radix_node *top = root->ptr;
+        if (!top) continue;
+        root->ptr = top->slots[0];
+        radix_node_free(top);
+    }
+    return NULL;
+}
+
+/**
+ * Free the pages from index first onwards in a subtree
+ *
+ * @param slot  Slot that points to the subtree
+ * @param h     Height of the subtree
+ * @param base  Index of the subtree's first page
+ * @param first First page index to free
+ * @returns whether the subtree is now empty (and *slot NULL).
+ */
+static int radix_trim(void **slot, unsigned h, size_t base, size_t first)
+{
+    if (!*slot) return 1;
+    if (h == 0) {
+        if (base < first) return 0;
+        tmpfs_page_free(*slot);
+        *slot = NULL;
+        return 1;
+    }
+
+    struct radix_node *node  = *slot;
+    size_t             span  = radix_maxindex(h - 1) + 1;
+    int                empty = 1;
+    for (unsigned i = 0; i < RADIX_FANOUT; i++) {
+        size_t childbase = base + i * span;
+        if (childbase + span - 1 < first) empty &= !node->slots[i];
+        else empty &= radix_trim(&node->slots[i], h - 1, childbase, first);
+    }
+    if (empty) {
+        radix_node_free(node);
+        *slot = NULL;
+    }
+    return empty;
+}
+
+static void radix_truncate(struct radix_root *root, size_t first)
+{
+    radix_trim(&root->ptr, root->height, 0, first);
+    if (!root->ptr) root->height = 0;
+}
+
+///@}
+
+/** @name Files and directories */
+///@{
+
+struct tmpfs_node {
+    char              name[TMPFS_NAME_MAX];
+    enum dirtype      type; ///< DT_UNKNOWN if the slot is unused
+    loff_t            size; ///< File size in bytes
+    struct radix_root data; ///< File pages
+
+    struct tmpfs_node *parent;
+    struct tmpfs_node *child;   ///< First entry, if a directory
+    struct tmpfs_node *sibling; ///< Next entry in the same directory
+};
+
+static struct tmpfs_node tmpfs_nodes[TMPFS_NODES_MAX];
+
+#define TMPFS_DIR_END (TMPFS_NODES_MAX + 1) ///< readdir position after the end
+
+static ino_t tmpfs_ino(struct tmpfs_node *node) { return node - tmpfs_nodes; }
+
+static struct tmpfs_node *tmpfs_node_alloc(enum dirtype type, const char *name)
+{
+    for (size_t i = 0; i < TMPFS_NODES_MAX; i++) {
+        struct tmpfs_node *node = &tmpfs_nodes[i];
+        if (node->type != DT_UNKNOWN) continue;
+        *node = (struct tmpfs_node){.type = type};
+        snprintf(node->name, TMPFS_NAME_MAX, "%s", name);
+        return node;
+    }
+    return NULL;
+}
+
+/** Free a node, its data and everything below it */
+static void tmpfs_node_free(struct tmpfs_node *node)
+{
+    while (node->child) {
+        struct tmpfs_node *child = node->child;
+        node->child              = child->sibling;
+        tmpfs_node_free(child);
+    }
+    radix_truncate(&node->data, 0);
+    node->type = DT_UNKNOWN;
+}
+
+static void tmpfs_node_stat(struct tmpfs_node *node, struct fstat *fstat)
+{
+    *fstat = (struct fstat){
+            .f_ino  = tmpfs_ino(node),
+            .f_type = node->type,
+            .f_size = node->size,
+    };
+}
+
+static struct tmpfs_node *
+tmpfs_dir_find(struct tmpfs_node *dir, const char *name, size_t len)
+{
+    for (struct tmpfs_node *c = dir->child; c; c = c->sibling)
+        if (strncmp(c->name, name, len) == 0 && !c->name[len]) return c;
+    return NULL;
+}
+
+/**
+ * Follow a path down from the root
+ *
+ * @param root  Root directory of the mount
+ * @param path  Path relative to the mount
+ * @param n     Only look at the first n characters of path
+ */
+static int tmpfs_walk(
+        struct tmpfs_node *root, const char *path, size_t n,
+        struct tmpfs_node **found
+)
+{
+    struct tmpfs_node *node = root;
+    const char        *end  = path + n;
+    while (path < end) {
+        /* Split off the next component, skipping slashes and ".". */
+        while (path < end && *path == '/') path++;
+        size_t len = 0;
+        while (path + len < end && path[len] != '/') len++;
+        if (!len || (len == 1 && *path == '.')) {
+            path += len;
+            continue;
+        }
+
+        if (node->type != DT_DIR) return -ENOTDIR;
+        node = tmpfs_dir_find(node, path, len);
+        if (!node) return -ENOENT;
+        path += len;
+    }
+    *found = node;
+    return 0;
+}
+
+static struct tmpfs_node *tmpfs_file_node(struct file *f)
+{
+    return f->f_inode->i_private;
+}
+
+/** Bring the sizes seen by the file, its inode and lookups up to date */
+static void tmpfs_file_resized(struct file *f)
+{
+    struct tmpfs_node *node = tmpfs_file_node(f);
+    f->f_stat.f_size        = node->size;
+    f->f_inode->i_stat      = f->f_stat;
+    dcache_invalidate_sb(f->f_inode->i_sb);
+}
+
+///@}
+
+/** @name tmpfs Operations */
+///@{
+
+static int tmpfs_sb_open(struct superblock *sb)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    struct tmpfs_node *root = tmpfs_node_alloc(DT_DIR, "");
+    intr_setenabled(intrs_enabled);
+    if (!root) return -ENOSPC;
+
+    snprintf(sb->s_name, sizeof(sb->s_name), "tmpfs%u", tmpfs_ino(root));
+    sb->s_root_ino    = tmpfs_ino(root);
+    sb->s_driver_data = root;
+    return 0;
+}
+
+static int tmpfs_sb_release(struct superblock *sb)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    if (sb->s_driver_data) tmpfs_node_free(sb->s_driver_data);
+    intr_setenabled(intrs_enabled);
+    return 0;
+}
+
+static int
+tmpfs_stat_path(struct fstat *fstat, struct superblock *sb, const char *path)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    struct tmpfs_node *node;
+    int res = tmpfs_walk(sb->s_driver_data, path, strlen(path), &node);
+    if (res >= 0) tmpfs_node_stat(node, fstat);
+    intr_setenabled(intrs_enabled);
+    return res;
+}
+
+static int
+tmpfs_open_path(struct file *f, struct superblock *sb, const char *path)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    struct tmpfs_node *node;
+    int res = tmpfs_walk(sb->s_driver_data, path, strlen(path), &node);
+    if (res < 0) goto exit;
+
+    int           isnew;
+    struct inode *inode = inode_get(sb, tmpfs_ino(node), &isnew);
+    res                 = inode ? 0 : -ENFILE;
+    if (res < 0) goto exit;
+    inode->i_private = node;
+    tmpfs_node_stat(node, &inode->i_stat);
+
+    f->f_inode = inode;
+    f->f_stat  = inode->i_stat;
+
+exit:
+    intr_setenabled(intrs_enabled);
+    return res;
+}
+
+static int
+tmpfs_create_inner(struct superblock *sb, const char *path, enum dirtype type)
+{
+    int res;
+
+    if (type != DT_REG && type != DT_DIR) return -EINVAL;
+
+    /* Split into parent directory and new name. */
+    const char *slash = strrchr(path, '/');
+    const char *name  = slash ? slash + 1 : path;
+    size_t      len   = strlen(name);
+    if (!len || strcmp(name, ".") == 0) return -EEXIST;
+    if (len >= TMPFS_NAME_MAX) return -ENAMETOOLONG;
+
+    struct tmpfs_node *dir;
+    res = tmpfs_walk(sb->s_driver_data, path, name - path, &dir);
+    if (res < 0) return res;
+    if (dir->type != DT_DIR) return -ENOTDIR;
+    if (tmpfs_dir_find(dir, name, len)) return -EEXIST;
+
+    struct tmpfs_node *node = tmpfs_node_alloc(type, name);
+    if (!node) return -ENOSPC;
+
+    /* Add to the end, so that readdir lists entries in creation order. */
+    struct tmpfs_node **link = &dir->child;
+    while (*link) link = &(*link)->sibling;
+    *link        = node;
+    node->parent = dir;
+    return 0;
+}
+
+static int
+tmpfs_create(struct superblock *sb, const char *path, enum dirtype type)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    int res = tmpfs_create_inner(sb, path, type);
+    intr_setenabled(intrs_enabled);
+    return res;
+}
+
+static ssize_t
+tmpfs_read(struct file *f, void *dst, size_t count, loff_t *off)
+{
+    struct tmpfs_node *node = tmpfs_file_node(f);
+    if (node->type != DT_REG) return -EISDIR;
+
+    if (*off < 0) *off = 0;
+
+    /* Check the size for every page, as the file may shrink meanwhile. */
+    char *pos = dst, *end = pos + count;
+    while (pos < end) {
+        int intrs_enabled = intr_isenabled();
+        intr_setenabled(0);
+        size_t pgoff = *off % PAGESZ;
+        size_t chunk = MIN((size_t) (end - pos), PAGESZ - pgoff);
+        if (*off >= node->size) chunk = 0;
+        else chunk = MIN((loff_t) chunk, node->size - *off);
+        const char *page = radix_lookup(&node->data, *off / PAGESZ);
+        if (page) memcpy(pos, page + pgoff, chunk);
+        else memset(pos, 0, chunk); // Hole
+        intr_setenabled(intrs_enabled);
+        if (!chunk) break;
+        pos += chunk;
+        *off += chunk;
+    }
+    return pos - (char *) dst;
+}
+
+/** Point at file data in its page, or at a page of zeros for a hole */
+static ssize_t tmpfs_direct_access(
+        struct file *f, loff_t off, size_t count, const void **addr
+)
+{
+    static const ATTR_ALIGNED(PAGESZ) unsigned char zero_page[PAGESZ];
+
+    struct tmpfs_node *node = tmpfs_file_node(f);
+    if (node->type != DT_REG) return -EISDIR;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    size_t      pgoff = off % PAGESZ;
+    const char *page  = radix_lookup(&node->data, off / PAGESZ);
+    if (!page) page = (const char *) zero_page;
+    *addr = page + pgoff;
+    count = MIN(count, PAGESZ - pgoff);
+    count = off < node->size ? MIN((loff_t) count, node->size - off) : 0;
+    intr_setenabled(intrs_enabled);
+    return count;
+}
+
+static ssize_t
+tmpfs_write(struct file *f, const void *src, size_t count, loff_t *off)
+{
+    struct tmpfs_node *node = tmpfs_file_node(f);
+    if (node->type != DT_REG) return -EISDIR;
+    if (*off < 0) return -EINVAL;
+
+    /* Grow the file a page at a time, so readers never see past the data
+     * written so far. */
+    const char *pos = src, *end = pos + count;
+    while (pos < end) {
+        int intrs_enabled = intr_isenabled();
+        intr_setenabled(0);
+        size_t pgoff = *off % PAGESZ;
+        size_t chunk = MIN((size_t) (end - pos), PAGESZ - pgoff);
+        char  *page  = radix_get(&node->data, *off / PAGESZ);
+        if (page) {
+            memcpy(page + pgoff, pos, chunk);
+            pos += chunk;
+            *off += chunk;
+            if (*off > node->size) {
+                node->size = *off;
+                tmpfs_file_resized(f);
+            }
+        }
+        intr_setenabled(intrs_enabled);
+        if (!page) break;
+    }
+    if (pos == (const char *) src && count) return -ENOSPC;
+    return pos - (const char *) src;
+}
+
+static int tmpfs_truncate(struct file *f, loff_t size)
+{
+    struct tmpfs_node *node = tmpfs_file_node(f);
+    if (node->type != DT_REG) return -EISDIR;
+    if (size < 0) return -EINVAL;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    /* Shrinking: free whole pages past the end, and zero the rest of the
+     * last page so that growing again later reads zeros. */
+    if (size < node->size) {
+        radix_truncate(&node->data, ALIGN_UP(size, PAGESZ) / PAGESZ);
+        char *page = radix_lookup(&node->data, size / PAGESZ);
+        if (page) memset(page + size % PAGESZ, 0, PAGESZ - size % PAGESZ);
+    }
+
+    node->size = size;
+    tmpfs_file_resized(f);
+    intr_setenabled(intrs_enabled);
+    return 0;
+}
+
+/**
+ * The node that a directory read would return next, or NULL at the end
+ *
+ * The position is the next entry as a node index + 1, or 0 before the
+ * first entry.
+ */
+static struct tmpfs_node *tmpfs_dir_peek(struct file *f)
+{
+    if (f->f_pos == TMPFS_DIR_END) return NULL;
+    if (f->f_pos) return &tmpfs_nodes[f->f_pos - 1];
+    return tmpfs_file_node(f)->child;
+}
+
+static void tmpfs_dir_advance(struct file *f, struct tmpfs_node *node)
+{
+    f->f_pos = node->sibling ? tmpfs_ino(node->sibling) + 1 : TMPFS_DIR_END;
+}
+
+static int tmpfs_readdir(struct file *f, struct dirent *d)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    struct tmpfs_node *node = tmpfs_dir_peek(f);
+    if (node) {
+        tmpfs_dir_advance(f, node);
+        d->d_ino  = tmpfs_ino(node);
+        d->d_type = node->type;
+        snprintf(d->d_name, PATH_MAX, "%s", node->name);
+    }
+    intr_setenabled(intrs_enabled);
+    return node ? 1 : 0;
+}
+
+static ssize_t tmpfs_readdir_batch(struct file *f, void *buf, size_t size)
+{
+    size_t             used = 0;
+    ssize_t            res  = 0;
+    struct tmpfs_node *node;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    while ((node = tmpfs_dir_peek(f))) {
+        ino_t ino = tmpfs_ino(node);
+        if (!dirent_rec_put(buf, size, &used, ino, node->type, node->name)) {
+            res = used ? 0 : -EINVAL;
+            break;
+        }
+        tmpfs_dir_advance(f, node);
+    }
+    intr_setenabled(intrs_enabled);
+    return res < 0 ? res : (ssize_t) used;
+}
+
+static const struct file_operations tmpfs_file_ops = {
+        .name      = "tmpfs_file",
+        .stat_path = tmpfs_stat_path,
+        .open_path = tmpfs_open_path,
+        .create    = tmpfs_create,
+        .read      = tmpfs_read,
+        .readdir   = tmpfs_readdir,
+        .write     = tmpfs_write,
+        .truncate  = tmpfs_truncate,
+
+        .readdir_batch = tmpfs_readdir_batch,
+        .direct_access = tmpfs_direct_access,
+};
+
+static const struct fs_operations tmpfs_fs_ops = {
+        .name        = "tmpfs",
+        .sb_open     = tmpfs_sb_open,
+        .sb_release  = tmpfs_sb_release,
+        .fs_file_ops = &tmpfs_file_ops,
+};
+
+int init_driver_tmpfs(void)
+{
+    SYSFS_COUNTER("mem", "tmpfs_pages", tmpfs_pages_inuse);
+    return fs_register(FS_TMP, &tmpfs_fs_ops);
+}
+
+///@}
@@ -0,0 +1,170 @@
+// #define LOG_LEVEL LOG_DEBUG
+
+#include "pagecache.h"
+
+#include <cpu_interrupt.h>
+
+#include <drivers/log.h>
+
+#include <core/compiler.h>
+#include <core/macros.h>
+
+#include <stdint.h>
+
+static ATTR_ALIGNED(PAGESZ) unsigned char pcache_data[PCACHE_PAGES][PAGESZ];
+static struct cpage     pcache_pages[PCACHE_PAGES];
+static struct list_head pcache_hash[PCACHE_HASH];
+static size_t           pcache_hand; ///< CLOCK hand: next page to consider
+
+struct pcache_stats pcache_stats;
+
+static struct list_head *pcache_bucket(const void *owner, size_t index)
+{
+    uintptr_t key = (uintptr_t) owner / sizeof(void *) * 31 + index;
+    return &pcache_hash[key % PCACHE_HASH];
+}
+
+/** Look up a page; call with interrupts disabled */
+static struct cpage *pcache_lookup(const void *owner, size_t index)
+{
+    struct list_head *bucket = pcache_bucket(owner, index);
+    if (list_empty(bucket)) return NULL;
+
+    struct cpage *pg;
+    list_for_each_entry(pg, bucket, hash_link)
+    {
+        if (pg->owner == owner && pg->index == index) return pg;
+    }
+    return NULL;
+}
+
+/**
+ * Pick a page to reuse with the CLOCK algorithm
+ *
+ * The hand sweeps around the pool. Pages used since its last pass get a
+ * second chance; the first unused, unreferenced page is taken. Pages in use
+ * are skipped, so after two full sweeps without finding one, give up.
+ *
+ * Call with interrupts disabled.
+ */
+static struct cpage *pcache_evict(void)
+{
+    for (size_t n = 0; n < 2 * PCACHE_PAGES; n++) {
+        struct cpage *pg = &pcache_pages[pcache_hand];
+        pcache_hand      = (pcache_hand + 1) % PCACHE_PAGES;
+
+        if (pg->users) continue;
+        if (pg->referenced) {
+            pg->referenced = 0;
+            continue;
+        }
+
+        if (pg->owner) {
+            list_del(&pg->hash_link);
+            pcache_stats.evictions++;
+        }
+        return pg;
+    }
+    return NULL;
+}
+
+/**
+ * Get a reference to a cached page, if there is one
+ *
+ * The page may still be being filled; check @ref cpage.uptodate.
+ */
+struct cpage *pcache_find(const void *owner, size_t index)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    struct cpage *pg = pcache_lookup(owner, index);
+    if (pg) {
+        pg->users++;
+        pg->referenced = 1;
+    }
+    intr_setenabled(intrs_enabled);
+    return pg;
+}
+
+/**
+ * Get a reference to a page, making room for it if it is not cached
+ *
+ * A new page is not up to date; the caller fills it.
+ *
+ * @returns the page, or NULL if every page in the pool is in use.
+ */
+struct cpage *pcache_grab(const void *owner, size_t index)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    struct cpage *pg = pcache_lookup(owner, index);
+    if (!pg && (pg = pcache_evict())) {
+        *pg = (struct cpage){
+                .owner = owner,
+                .index = index,
+                .data  = pcache_data[pg - pcache_pages],
+        };
+        list_add(&pg->hash_link, pcache_bucket(owner, index));
+    }
+    if (pg) {
+        pg->users++;
+        pg->referenced = 1;
+    }
+
+    intr_setenabled(intrs_enabled);
+    return pg;
+}
+
+/** Drop a reference to a page */
+void pcache_put(struct cpage *pg)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    if (pg->users) pg->users--;
+    intr_setenabled(intrs_enabled);
+}
+
+/**
+ * Forget cached data for a range of pages, e.g. after the owner is written
+ *
+ * Pages in use stay in the cache but are no longer up to date, so they will
+ * be filled again. A fill already under way is marked stale, and its data
+ * is thrown away when it completes.
+ */
+void pcache_invalidate(const void *owner, size_t first, size_t last)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    for (size_t i = 0; i < PCACHE_PAGES; i++) {
+        struct cpage *pg = &pcache_pages[i];
+        if (pg->owner != owner || pg->index < first || pg->index > last)
+            continue;
+        if (pg->users) {
+            pg->uptodate = 0;
+            pg->gen++;
+            continue;
+        }
+        list_del(&pg->hash_link);
+        *pg = (struct cpage){};
+    }
+    intr_setenabled(intrs_enabled);
+}
+
+/**
+ * Update readahead state for an access, and size the window to fill
+ *
+ * Each access that continues where the last one left off doubles the
+ * window, up to @ref RA_PAGES_MAX. Any other access resets it, so random
+ * access only ever reads the page it needs.
+ *
+ * @returns number of pages to fill, starting at index.
+ */
+size_t ra_window(struct ra_state *ra, size_t index)
+{
+    if (index == ra->next)
+        ra->pages = MIN(MAX(2 * ra->pages, RA_PAGES_INIT), RA_PAGES_MAX);
+    else ra->pages = 0;
+    ra->next = index + 1;
+    return MAX(ra->pages, 1);
+}
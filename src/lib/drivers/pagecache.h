@@ -0,0 +1,74 @@
+/**
+ * @file
+ * Page cache: recently used file and device data, one page at a time
+ *
+ * Pages are identified by an owner (a block device, or later an inode) and
+ * a page index within it. The cache has a fixed pool of pages; when it is
+ * full, the CLOCK algorithm picks a page that has not been used recently and
+ * reuses it.
+ */
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <cpu_pagemap.h>
+
+#include <drivers/blkdev.h>
+
+#include <core/list.h>
+
+#include <stddef.h>
+
+#define PCACHE_PAGES 64 ///< Pages in the pool
+#define PCACHE_HASH  64 ///< Hash buckets for lookup; power of two
+
+/** @name Readahead window, in pages */
+///@{
+#define RA_PAGES_INIT 4  ///< Window once sequential access is detected
+#define RA_PAGES_MAX  32 ///< Largest window; keep well below PCACHE_PAGES
+///@}
+
+/**
+ * A page of cached data
+ *
+ * Pages are keyed by owner and index. Only block devices own pages so far:
+ * file data is cached through the device it lives on, and caching by inode
+ * is still missing.
+ */
+struct cpage {
+    const void *owner; ///< What the data belongs to, or NULL if unused
+    size_t      index; ///< Page number within owner
+    void       *data;  ///< PAGESZ bytes of data
+
+    int      uptodate;   ///< Data is valid
+    int      filling;    ///< Data is being read in; wait on rq
+    unsigned gen;        ///< Bumped when invalidated
+    unsigned fill_gen;   ///< gen when the fill started; stale if different
+    int      err;        ///< Error from filling the page, if not uptodate
+    unsigned users;      ///< References; pages in use are never evicted
+    int      referenced; ///< Used since the clock hand last passed
+
+    struct list_head   hash_link; ///< Place in hash bucket
+    struct blk_request rq;        ///< Request used to fill the page
+};
+
+/** Counters for the cache as a whole */
+struct pcache_stats {
+    unsigned hits;      ///< Lookups that found an up-to-date page
+    unsigned misses;    ///< Lookups that had to fill a page
+    unsigned evictions; ///< Pages reused for other data
+    unsigned readahead; ///< Pages filled ahead of use
+};
+
+extern struct pcache_stats pcache_stats;
+
+struct cpage *pcache_find(const void *owner, size_t index);
+struct cpage *pcache_grab(const void *owner, size_t index);
+void          pcache_put(struct cpage *pg);
+void          pcache_invalidate(const void *owner, size_t first, size_t last);
+
+size_t ra_window(struct ra_state *ra, size_t index);
+
+struct cpage *
+blkdev_get_page(struct blkdev *bd, struct ra_state *ra, size_t index);
+
+#endif /* PAGECACHE_H */
@@ -0,0 +1,36 @@
+/**
+ * @file
+ * sysfs: kernel counters as read-only files
+ *
+ * Each counter appears as /sys/GROUP/NAME and reads as its current value in
+ * decimal, formatted at the time of the read. Counters are registered once,
+ * usually from a subsystem's init function, with @ref SYSFS_COUNTER.
+ */
+#ifndef SYSFS_H
+#define SYSFS_H
+
+#define SYSFS_ATTRS_MAX 48 ///< Max counters, across all groups
+
+enum sysfs_type {
+    SYSFS_UINT,   ///< unsigned int
+    SYSFS_ULONG,  ///< unsigned long
+    SYSFS_ULLONG, ///< unsigned long long
+};
+
+/** The @ref sysfs_type of a counter variable */
+#define SYSFS_TYPE(var) \
+    _Generic((var), \
+            unsigned: SYSFS_UINT, \
+            unsigned long: SYSFS_ULONG, \
+            unsigned long long: SYSFS_ULLONG)
+
+/** Expose an unsigned counter variable as /sys/GROUP/NAME */
+#define SYSFS_COUNTER(group, name, var) \
+    sysfs_add(group, name, SYSFS_TYPE(var), (const void *) &(var))
+
+int sysfs_add(
+        const char *group, const char *name, enum sysfs_type type,
+        const void *val
+);
+
+#endif /* SYSFS_H */
@@ -5,6 +5,9 @@
 #include <core/list.h>
 #include <core/types.h>
 
+#include <sys/dirent.h>
+#include <sys/uio.h>
+
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -21,6 +24,7 @@ enum dirtype {
     DT_CHR,         ///< Character device
     DT_DIR,         ///< Directory
     DT_REG,         ///< Regular file
+    DT_FIFO,        ///< Pipe
 };
 
 /** Entry in a directory listing */
@@ -59,6 +63,29 @@ struct fstat {
     loff_t       f_size;
 };
 
+/**
+ * In-memory inode, shared by every open file for the same filesystem object
+ *
+ * Inodes are cached by (superblock, inode number) and reference counted.
+ * Unreferenced inodes stay cached until their slot is needed.
+ */
+struct inode {
+    struct superblock *i_sb;      ///< Filesystem, or NULL if slot unused
+    ino_t              i_ino;     ///< Inode number within filesystem
+    struct fstat       i_stat;    ///< Metadata, filled in by the driver
+    unsigned           i_count;   ///< References from open files
+    void              *i_private; ///< Driver data
+
+    struct list_head i_hash_link; ///< Place in hash bucket
+    struct list_head i_lru_link;  ///< Place in unused list, if unreferenced
+};
+
+/** Readahead state, kept per open file; see pagecache.h */
+struct ra_state {
+    size_t   next;  ///< Page expected next if access is sequential
+    unsigned pages; ///< Current window size, 0 if access looks random
+};
+
 struct file {
     /** @name Metadata from disk (inode data) */
     ///@{
@@ -67,8 +94,9 @@ struct file {
 
     /** @name Live data for a file in use */
     ///@{
-    struct inode *f_inode; ///< Link to owning inode (may be null for chrdev)
-    loff_t        f_pos;   ///< Current read/write position
+    struct inode   *f_inode; ///< Link to owning inode (may be null for chrdev)
+    loff_t          f_pos;   ///< Current read/write position
+    struct ra_state f_ra;    ///< Readahead state for cached reads
     ///@}
 
     /** @name Driver polymorphism */
@@ -78,11 +106,57 @@ struct file {
     ///@}
 };
 
+enum file_aio_op {
+    AIO_READ,
+    AIO_WRITE,
+};
+
+struct file_aio;
+struct aio_cq;
+
+/** Called once an asynchronous read or write is done */
+typedef void (*file_aio_done_fn)(struct file_aio *io);
+
+/**
+ * An asynchronous read or write, submitted with aio_submit (kernel/aio.h)
+ *
+ * The request must stay in place until it is marked complete or taken off
+ * its completion queue; the callback runs before either. Drivers that can
+ * start a transfer without waiting for it implement
+ * file_operations.aio_submit and call @ref file_aio_complete when it is done.
+ */
+struct file_aio {
+    /** @name Set by the caller */
+    ///@{
+    enum file_aio_op op;
+    struct file     *file;
+    void            *buf;
+    size_t           count;
+    loff_t           off;     ///< File offset; f_pos is neither used nor moved
+    file_aio_done_fn done;    ///< Optional callback, run before completion
+    struct aio_cq   *cq;      ///< Optional queue to post the request to
+    void            *private; ///< For the caller's use
+    ///@}
+
+    /** @name Result */
+    ///@{
+    int     complete; ///< Set last; the request may then be freed
+    ssize_t res;      ///< Bytes transferred, or a negative error code
+    ///@}
+
+    /** @name Internals */
+    ///@{
+    struct list_head link; ///< Place in the worker queue or completion queue
+    void (*complete_fn)(struct file_aio *io, ssize_t res); ///< By submitter
+    ///@}
+};
+
 struct fs_operations {
     const char *name;
     int (*sb_open)(struct superblock *sb);
     int (*sb_release)(struct superblock *sb);
     const struct file_operations *fs_file_ops;
+    int no_dcache; ///< Contents change by themselves; never cache lookups
 };
 
 struct file_operations {
@@ -93,18 +167,56 @@ struct file_operations {
     )(struct fstat *fstat, struct superblock *sb, const char *relpath);
     int (*open_path
     )(struct file *f, struct superblock *sb, const char *relpath);
+    int (*create
+    )(struct superblock *sb, const char *relpath, enum dirtype type);
 
     int (*release)(struct file *f);
+    int (*dup)(struct file *f);
 
     int (*debugstr)(char *descbuf, size_t n, struct file *f);
     ssize_t (*read)(struct file *f, void *dst, size_t count, loff_t *off);
     int (*readdir)(struct file *f, struct dirent *d);
 
+    /**
+     * Optional: fill buf with as many @ref dirent_rec as fit
+     *
+     * Resumes where the last read left off, like readdir; the cursor is
+     * kept in f_pos and means whatever the driver likes. Add records with
+     * @ref dirent_rec_put, which says when the buffer is full.
+     *
+     * @returns bytes filled, 0 at the end of the directory, -EINVAL if the
+     *          next entry does not fit in the buffer at all, or another
+     *          negative error code.
+     */
+    ssize_t (*readdir_batch)(struct file *f, void *buf, size_t size);
+
+    /** Optional: point straight at file data that is already in memory */
+    ssize_t (*direct_access
+    )(struct file *f, loff_t off, size_t count, const void **addr);
+
     ssize_t (*write
     )(struct file *f, const void *src, size_t count, loff_t *off);
     loff_t (*lseek)(struct file *f, loff_t off, int whence);
+    int (*truncate)(struct file *f, loff_t size);
+
+    /** Optional: read into up to @ref IOV_MAX buffers as one operation */
+    ssize_t (*readv
+    )(struct file *f, const struct iovec *iov, int iovcnt, loff_t *off);
+    /** Optional: write up to @ref IOV_MAX buffers as one operation */
+    ssize_t (*writev
+    )(struct file *f, const struct iovec *iov, int iovcnt, loff_t *off);
 
     int (*ioctl)(struct file *f, unsigned cmd, uintptr_t arg);
+
+    /**
+     * Optional: start a read or write without waiting for it
+     *
+     * Call @ref file_aio_complete when the transfer is done, either before
+     * returning or later, e.g. from an interrupt. Return -ENOTSUP for
+     * requests the driver cannot start this way; they are then done by a
+     * worker task with the ordinary read and write methods.
+     */
+    int (*aio_submit)(struct file *f, struct file_aio *io);
 };
 
 extern struct list_head vfs_mount_list;
@@ -114,21 +226,70 @@ int fs_mountdev(dev_t blockdev, unsigned fstypeid, const char *mpath);
 
 int chrdev_register(unsigned maj, const struct file_operations *fops);
 
+/** @name Inode cache */
+///@{
+#define INODE_MAX 32 ///< Cached inodes
+
+struct inode *inode_get(struct superblock *sb, ino_t ino, int *isnew);
+void          inode_hold(struct inode *inode);
+void          inode_put(struct inode *inode);
+size_t        inode_index(const struct inode *inode);
+///@}
+
+/** @name Dentry cache */
+///@{
+struct dcache_stats {
+    unsigned hits;     ///< Lookups answered with a found entry
+    unsigned neg_hits; ///< Lookups answered with a not-found entry
+    unsigned misses;   ///< Lookups that had to ask the filesystem
+};
+
+extern struct dcache_stats dcache_stats;
+
+int dcache_lookup(
+        const char *abspath, struct superblock **sb, struct fstat *fstat
+);
+void dcache_add(
+        const char *abspath, struct superblock *sb, const struct fstat *fstat
+);
+void dcache_invalidate_sb(struct superblock *sb);
+void dcache_invalidate_all(void);
+///@}
+
 int     file_stat(struct fstat *fstat, const char *cwd, const char *path);
 int     file_open_dev(struct file *file, dev_t rdev);
 int     file_open_path(struct file *file, const char *cwd, const char *path);
+int     file_create(const char *cwd, const char *path, enum dirtype type);
 int     file_close(struct file *file);
+int     file_dup(struct file *dst, struct file *src);
 ssize_t file_read(struct file *f, void *dst, size_t count);
 ssize_t file_pread(struct file *f, void *dst, size_t count, loff_t off);
+ssize_t file_direct_access(
+        struct file *f, loff_t off, size_t count, const void **addr
+);
 int     file_readdir(struct file *f, struct dirent *d);
+ssize_t file_readdir_batch(struct file *f, void *buf, size_t size);
 int     file_debugstr(char *descbuf, size_t n, struct file *f);
 ssize_t file_write(struct file *f, const void *src, size_t count);
 ssize_t file_pwrite(struct file *f, const void *src, size_t count, loff_t off);
+ssize_t file_readv(struct file *f, const struct iovec *iov, int iovcnt);
+ssize_t file_writev(struct file *f, const struct iovec *iov, int iovcnt);
+ssize_t file_splice(
+        struct file *dst, struct file *src, size_t len, loff_t *off
+);
 loff_t  file_lseek(struct file *f, loff_t off, int whence);
+int     file_truncate(struct file *f, loff_t size);
 int     file_ioctl(struct file *f, unsigned cmd, uintptr_t arg);
 
 int file_readstr(struct file *f, char *dst, size_t n);
 
+void file_aio_complete(struct file_aio *io, ssize_t res);
+
+int dirent_rec_put(
+        void *buf, size_t size, size_t *used, ino_t ino, enum dirtype type,
+        const char *name
+);
+
 ATTR_PRINTFLIKE(2, 3)
 int file_printf(struct file *f, const char *fmt, ...);
 int file_vprintf(struct file *f, const char *fmt, va_list va);
@@ -0,0 +1,169 @@
+/**
+ * @file
+ * Dentry cache: results of recent path lookups
+ *
+ * Maps absolute paths to the superblock and metadata found for them, and
+ * also remembers paths that were not found ("negative" entries), so that
+ * repeated lookups, including misses along a search path, never reach the
+ * filesystem driver. Entries are hashed by path and the least recently used
+ * one is reused when the cache is full.
+ *
+ * Filesystems whose contents can change must call
+ * @ref dcache_invalidate_sb when they do. Those whose contents change with
+ * no call into the driver, like procfs, set fs_operations.no_dcache instead.
+ */
+// #define LOG_LEVEL LOG_DEBUG
+
+#include "vfs.h"
+
+#include <cpu_interrupt.h>
+
+#include <drivers/log.h>
+
+#include <core/errno.h>
+#include <core/list.h>
+#include <core/string.h>
+
+#include <stdint.h>
+
+#define DCACHE_SIZE 32 ///< Cached lookups
+#define DCACHE_HASH 64 ///< Hash buckets; power of two
+
+struct dentry {
+    char               d_path[PATH_MAX]; ///< Absolute path, or "" if unused
+    uint32_t           d_hash;           ///< Hash of path
+    struct superblock *d_sb;             ///< Filesystem the path belongs to
+    int                d_negative;       ///< Path was not found
+    struct fstat       d_stat;           ///< Metadata if found
+
+    struct list_head d_hash_link; ///< Place in hash bucket
+    struct list_head d_lru_link;  ///< Place in LRU list, most recent first
+};
+
+static struct dentry    dentries[DCACHE_SIZE];
+static struct list_head dcache_hash[DCACHE_HASH];
+static LIST_HEAD(dcache_lru);
+
+struct dcache_stats dcache_stats;
+
+/** FNV-1a string hash */
+static uint32_t dcache_hashstr(const char *s)
+{
+    uint32_t hash = 2166136261u;
+    for (; *s; s++) hash = (hash ^ (unsigned char) *s) * 16777619u;
+    return hash;
+}
+
+/** Take an entry out of the hash table; call with interrupts disabled */
+static void dentry_unhash(struct dentry *d)
+{
+    if (d->d_path[0]) list_del(&d->d_hash_link);
+    d->d_path[0] = '\0';
+}
+
+/** Find an entry and mark it most recently used */
+static struct dentry *dcache_find(const char *abspath, uint32_t hash)
+{
+    struct list_head *bucket = &dcache_hash[hash % DCACHE_HASH];
+    if (list_empty(bucket)) return NULL;
+
+    struct dentry *d;
+    list_for_each_entry(d, bucket, d_hash_link)
+    {
+        if (d->d_hash != hash || strcmp(d->d_path, abspath) != 0) continue;
+        list_del(&d->d_lru_link);
+        list_add(&d->d_lru_link, &dcache_lru);
+        return d;
+    }
+    return NULL;
+}
+
+/**
+ * Look up a path in the cache
+ *
+ * @returns 1 if the path is cached as found, with sb and fstat filled in;
+ * -ENOENT if it is cached as not found; or 0 if it is not cached.
+ */
+int dcache_lookup(
+        const char *abspath, struct superblock **sb, struct fstat *fstat
+)
+{
+    int res = 0;
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    struct dentry *d = dcache_find(abspath, dcache_hashstr(abspath));
+    if (d && d->d_negative) {
+        dcache_stats.neg_hits++;
+        res = -ENOENT;
+    } else if (d) {
+        dcache_stats.hits++;
+        if (sb) *sb = d->d_sb;
+        if (fstat) *fstat = d->d_stat;
+        res = 1;
+    } else {
+        dcache_stats.misses++;
+    }
+    intr_setenabled(intrs_enabled);
+    return res;
+}
+
+/**
+ * Remember the result of a lookup
+ *
+ * @param abspath   Absolute path that was looked up
+ * @param sb        Filesystem that the path belongs to
+ * @param fstat     Metadata found, or NULL if the path was not found
+ */
+void dcache_add(
+        const char *abspath, struct superblock *sb, const struct fstat *fstat
+)
+{
+    if (strlen(abspath) >= PATH_MAX || sb->s_op->no_dcache) return;
+    uint32_t hash = dcache_hashstr(abspath);
+
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    /* Reuse the existing entry, or else the least recently used one. */
+    struct dentry *d = dcache_find(abspath, hash);
+    if (!d) {
+        if (list_empty(&dcache_lru)) {
+            for (size_t i = 0; i < DCACHE_SIZE; i++)
+                list_add_tail(&dentries[i].d_lru_link, &dcache_lru);
+        }
+        d = list_last_entry(&dcache_lru, struct dentry, d_lru_link);
+        dentry_unhash(d);
+        list_del(&d->d_lru_link);
+        list_add(&d->d_lru_link, &dcache_lru);
+
+        memcpy(d->d_path, abspath, strlen(abspath) + 1);
+        d->d_hash = hash;
+        list_add(&d->d_hash_link, &dcache_hash[hash % DCACHE_HASH]);
+    }
+
+    d->d_sb       = sb;
+    d->d_negative = !fstat;
+    if (fstat) d->d_stat = *fstat;
+
+    intr_setenabled(intrs_enabled);
+}
+
+/** Forget everything cached for a filesystem; call when it changes */
+void dcache_invalidate_sb(struct superblock *sb)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    for (size_t i = 0; i < DCACHE_SIZE; i++)
+        if (dentries[i].d_sb == sb) dentry_unhash(&dentries[i]);
+    intr_setenabled(intrs_enabled);
+}
+
+/** Forget every cached lookup, e.g. when the mount table changes */
+void dcache_invalidate_all(void)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    for (size_t i = 0; i < DCACHE_SIZE; i++) dentry_unhash(&dentries[i]);
+    intr_setenabled(intrs_enabled);
+}
@@ -5,6 +5,7 @@
 #include <drivers/log.h>
 
 #include <core/errno.h>
+#include <core/macros.h>
 #include <core/sprintf.h>
 
 #include <stdarg.h>
@@ -56,9 +57,31 @@ int file_open_dev(struct file *file, dev_t rdev)
 
 int file_close(struct file *file)
 {
+    int res = 0;
     if (file && file->f_op && file->f_op->release)
-        return file->f_op->release(file);
-    else return 0;
+        res = file->f_op->release(file);
+    if (file && file->f_inode) {
+        inode_put(file->f_inode);
+        file->f_inode = NULL;
+    }
+    return res;
+}
+
+/**
+ * Make another reference to an open file
+ *
+ * Both copies must be closed. The driver's dup method is told about the new
+ * reference. Files with a release method but no dup method keep per-open
+ * state that cannot be shared, so they are refused.
+ */
+int file_dup(struct file *dst, struct file *src)
+{
+    if (!src || !src->f_op) return -EBADF;
+    if (src->f_op->release && !src->f_op->dup) return -ENOTSUP;
+    *dst = *src;
+    if (dst->f_inode) inode_hold(dst->f_inode);
+    if (dst->f_op->dup) return dst->f_op->dup(dst);
+    return 0;
 }
 
 int file_debugstr(char *descbuf, size_t n, struct file *f)
@@ -103,6 +126,149 @@ ssize_t file_pread(struct file *f, void *dst, size_t count, loff_t off)
     return f->f_op->read(f, dst, count, &off);
 }
 
+/** @name Vectored I/O */
+///@{
+
+static int iov_ok(const struct iovec *iov, int iovcnt)
+{
+    return (iov || !iovcnt) && 0 <= iovcnt && iovcnt <= IOV_MAX;
+}
+
+/** Read one buffer at a time, for drivers without readv */
+static ssize_t
+file_readv_slow(struct file *f, const struct iovec *iov, int iovcnt)
+{
+    size_t  done = 0;
+    ssize_t res  = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        res = file_read(f, iov[i].iov_base, iov[i].iov_len);
+        if (res < 0) break;
+        done += res;
+        if ((size_t) res < iov[i].iov_len) break;
+    }
+    return done || res >= 0 ? (ssize_t) done : res;
+}
+
+/** Write one buffer at a time, for drivers without writev */
+static ssize_t
+file_writev_slow(struct file *f, const struct iovec *iov, int iovcnt)
+{
+    size_t  done = 0;
+    ssize_t res  = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        res = file_write(f, iov[i].iov_base, iov[i].iov_len);
+        if (res < 0) break;
+        done += res;
+        if ((size_t) res < iov[i].iov_len) break;
+    }
+    return done || res >= 0 ? (ssize_t) done : res;
+}
+
+/**
+ * Read into several buffers in order, as one operation where possible
+ *
+ * @returns the total bytes read, which may stop short in any buffer, or a
+ * negative error code if nothing was read.
+ */
+ssize_t file_readv(struct file *f, const struct iovec *iov, int iovcnt)
+{
+    if (!f || !f->f_op || !iov_ok(iov, iovcnt)) return -EINVAL;
+    if (f->f_op->readv) return f->f_op->readv(f, iov, iovcnt, &f->f_pos);
+    if (!f->f_op->read) return -EINVAL;
+    return file_readv_slow(f, iov, iovcnt);
+}
+
+/** Write several buffers in order, as one operation where possible */
+ssize_t file_writev(struct file *f, const struct iovec *iov, int iovcnt)
+{
+    if (!f || !f->f_op || !iov_ok(iov, iovcnt)) return -EINVAL;
+    if (f->f_op->writev) return f->f_op->writev(f, iov, iovcnt, &f->f_pos);
+    if (!f->f_op->write) return -EINVAL;
+    return file_writev_slow(f, iov, iovcnt);
+}
+
+///@}
+
+/**
+ * Get a pointer to file data in memory, without copying it
+ *
+ * @param f     File to access
+ * @param off   Offset of the first byte wanted
+ * @param count Number of bytes wanted
+ * @param addr  Set to the address of the byte at off
+ *
+ * @returns the number of bytes that can be used at *addr, which may be less
+ * than count; 0 at end of file; -ENOTSUP if the driver keeps no data in
+ * memory, in which case use @ref file_pread instead; or another negative
+ * error code.
+ */
+ssize_t file_direct_access(
+        struct file *f, loff_t off, size_t count, const void **addr
+)
+{
+    if (!f || !f->f_op || !addr) return -EINVAL;
+    if (!f->f_op->direct_access) return -ENOTSUP;
+    if (off < 0) return -EINVAL;
+    return f->f_op->direct_access(f, off, count, addr);
+}
+
+#define SPLICE_BUFSZ 4096 ///< Bounce buffer for sources not in memory
+
+/**
+ * Copy data from one file to another, without a caller buffer
+ *
+ * When the source keeps its data in memory (@ref file_direct_access), its
+ * pages are handed straight to the destination's write method, so the data
+ * is copied only once. Other sources are read through a page-sized buffer
+ * on the kernel stack, so large transfers still go in large chunks.
+ *
+ * @param dst   Written at its current position, which is advanced
+ * @param src   File to read from
+ * @param len   Max bytes to copy; the copy also stops at end of file
+ * @param off   Source offset, which is advanced; NULL to use and advance
+ *              the source's own position
+ *
+ * @returns the number of bytes copied, which is less than len only at end
+ * of file or if the destination is full, or a negative error code if
+ * nothing could be copied.
+ */
+ssize_t
+file_splice(struct file *dst, struct file *src, size_t len, loff_t *off)
+{
+    if (!dst || !dst->f_op || !dst->f_op->write) return -EINVAL;
+    if (!src || !src->f_op || !src->f_op->read) return -EINVAL;
+    if (!off) off = &src->f_pos;
+
+    size_t  done = 0;
+    ssize_t res  = 0;
+    while (done < len) {
+        size_t      want = len - done;
+        const void *addr;
+        res = file_direct_access(src, *off, want, &addr);
+        if (res == -ENOTSUP) {
+            /* Not in memory: bounce through a buffer. */
+            char buf[SPLICE_BUFSZ];
+            res = file_pread(src, buf, MIN(want, sizeof(buf)), *off);
+            if (res <= 0) break;
+            addr = buf;
+            res  = file_write(dst, addr, res);
+        } else if (res > 0) {
+            res = file_write(dst, addr, res);
+        }
+        if (res <= 0) break;
+
+        *off += res;
+        done += res;
+    }
+    return done || res >= 0 ? (ssize_t) done : res;
+}
+
+/** Finish an asynchronous read or write; for drivers */
+void file_aio_complete(struct file_aio *io, ssize_t res)
+{
+    io->complete_fn(io, res);
+}
+
 loff_t file_lseek(struct file *f, loff_t off, int whence)
 {
     int res = 0;
@@ -120,6 +286,14 @@ loff_t file_lseek(struct file *f, loff_t off, int whence)
     };
 }
 
+/** Cut a file down, or extend it with zeros, to a given size */
+int file_truncate(struct file *f, loff_t size)
+{
+    if (!f || !f->f_op) return -EINVAL;
+    if (!f->f_op->truncate) return -ENOTSUP;
+    return f->f_op->truncate(f, size);
+}
+
 int file_ioctl(struct file *f, unsigned cmd, uintptr_t arg)
 {
     if (!f || !f->f_op || !f->f_op->ioctl) return -EINVAL;
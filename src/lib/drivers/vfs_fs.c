@@ -103,6 +103,96 @@ static void vfs_mount_list_add(struct superblock *sb)
     list_add_tail(&sb->s_mount_list, &vfs_mount_list);
 }
 
+/**
+ * @name Mount trie
+ *
+ * Mount points form a tree with one node per path component. Finding the
+ * filesystem for a path walks down the tree along the path's components and
+ * takes the deepest mount passed on the way: the longest matching prefix,
+ * matched on whole components only.
+ */
+///@{
+
+#define MOUNT_NODES_MAX 16 ///< Max nodes in the trie, including the root
+#define MOUNT_NAME_MAX  32 ///< Max length of a mount path component
+
+struct mount_node {
+    char               name[MOUNT_NAME_MAX]; ///< Path component
+    struct superblock *sb;      ///< Filesystem mounted here, if any
+    struct mount_node *child;   ///< First child
+    struct mount_node *sibling; ///< Next child of the same parent
+};
+
+static struct mount_node mount_nodes[MOUNT_NODES_MAX]; ///< [0] is "/"
+static size_t            mount_nnodes = 1;
+
+/** Split off the next component of a path, skipping slashes */
+static const char *path_next(const char *path, size_t *len)
+{
+    while (*path == '/') path++;
+    *len = 0;
+    while (path[*len] && path[*len] != '/') ++*len;
+    return path;
+}
+
+static struct mount_node *
+mount_node_child(struct mount_node *node, const char *name, size_t len)
+{
+    for (struct mount_node *c = node->child; c; c = c->sibling)
+        if (strncmp(c->name, name, len) == 0 && !c->name[len]) return c;
+    return NULL;
+}
+
+/** Add a superblock to the trie at its mount path */
+static int mount_trie_add(struct superblock *sb)
+{
+    struct mount_node *node = &mount_nodes[0];
+    size_t             len;
+    for (const char *comp = path_next(sb->s_mountpath, &len); len;
+         comp             = path_next(comp + len, &len)) {
+        struct mount_node *child = mount_node_child(node, comp, len);
+        if (!child) {
+            if (len >= MOUNT_NAME_MAX) return -ENAMETOOLONG;
+            if (mount_nnodes >= MOUNT_NODES_MAX) return -ENOMEM;
+            child = &mount_nodes[mount_nnodes++];
+            snprintf(child->name, MOUNT_NAME_MAX, "%.*s", (int) len, comp);
+            child->sibling = node->child;
+            node->child    = child;
+        }
+        node = child;
+    }
+    node->sb = sb; // A newer mount hides an older one at the same path.
+    return 0;
+}
+
+static struct superblock *find_mount_for_path(const char *abspath)
+{
+    struct mount_node *node = &mount_nodes[0];
+    struct superblock *sb   = node->sb;
+    size_t             len;
+    for (const char *comp = path_next(abspath, &len); len && node;
+         comp             = path_next(comp + len, &len)) {
+        node = mount_node_child(node, comp, len);
+        if (node && node->sb) sb = node->sb;
+    }
+    return sb;
+}
+
+/** Get the part of a path below the mount point of its filesystem */
+static const char *mount_relpath(struct superblock *sb, const char *abspath)
+{
+    size_t      mlen, len;
+    const char *m = path_next(sb->s_mountpath, &mlen);
+    const char *p = path_next(abspath, &len);
+    while (mlen) {
+        m = path_next(m + mlen, &mlen);
+        p = path_next(p + len, &len);
+    }
+    return p;
+}
+
+///@}
+
 int fs_mountdev(dev_t blockdev, unsigned fstypeid, const char *mpath)
 {
     int                res;
@@ -122,8 +212,11 @@ int fs_mountdev(dev_t blockdev, unsigned fstypeid, const char *mpath)
     /* Copy mount path. */
     snprintf(sb->s_mountpath, sizeof(sb->s_mountpath), "%s", mpath);
 
-    /* Add to mount list. */
+    /* Add to mount trie and list. The new mount may hide cached paths. */
+    res = mount_trie_add(sb);
+    if (res < 0) goto exit;
     vfs_mount_list_add(sb);
+    dcache_invalidate_all();
 
     res = 0;
 exit:
@@ -135,16 +228,6 @@ exit:
     return res;
 }
 
-static struct superblock *find_mount_for_path(const char *abspath)
-{
-    struct superblock *sb;
-    list_for_each_entry_prev(sb, &vfs_mount_list, s_mount_list)
-    {
-        if (strstr(abspath, sb->s_mountpath) == abspath) return sb;
-    }
-    return NULL;
-}
-
 static int file_open_sb_path(
         struct file *file, struct superblock *sb, const char *relpath
 )
@@ -177,14 +260,35 @@ exit:
     return res;
 }
 
+/** Remember the result of a lookup in the dentry cache */
+static void dcache_note(
+        const char *abspath, struct superblock *sb, int res, struct fstat *fs
+)
+{
+    if (res >= 0) dcache_add(abspath, sb, fs);
+    else if (res == -ENOENT) dcache_add(abspath, sb, NULL);
+}
+
+/** Find the filesystem for a path, or -ENOENT if it is known not to exist */
+static int lookup_mount(const char *abspath, struct superblock **sb)
+{
+    int res = dcache_lookup(abspath, sb, NULL);
+    if (res < 0) return res;
+    if (!res) *sb = find_mount_for_path(abspath);
+    return *sb ? 0 : -ENOENT;
+}
+
 static int file_open_path_abs(struct file *file, const char *abspath)
 {
-    struct superblock *sb = find_mount_for_path(abspath);
-    if (!sb) return -ENOENT;
+    struct superblock *sb;
+    int                res = lookup_mount(abspath, &sb);
+    if (res < 0) return res;
     if (!sb->s_op->fs_file_ops->open_path) return -ENOTSUP;
 
-    const char *relpath = path_strip_prefix(abspath, sb->s_mountpath);
-    return file_open_sb_path(file, sb, relpath);
+    const char *relpath = mount_relpath(sb, abspath);
+    res                 = file_open_sb_path(file, sb, relpath);
+    dcache_note(abspath, sb, res, &file->f_stat);
+    return res;
 }
 
 int file_open_path(struct file *file, const char *cwd, const char *path)
@@ -195,10 +299,58 @@ int file_open_path(struct file *file, const char *cwd, const char *path)
     return file_open_path_abs(file, absbuf);
 }
 
+/** Create a new, empty file or directory */
+int file_create(const char *cwd, const char *path, enum dirtype type)
+{
+    int  n = PATH_MAX;
+    char absbuf[n];
+    path_join(absbuf, n, cwd, path);
+
+    struct superblock *sb = find_mount_for_path(absbuf);
+    if (!sb) return -ENOENT;
+
+    const struct file_operations *f_op = sb->s_op->fs_file_ops;
+    if (!f_op || !f_op->create) return -ENOTSUP;
+
+    int res = f_op->create(sb, mount_relpath(sb, absbuf), type);
+    if (res >= 0) dcache_invalidate_sb(sb); // Forget it did not exist.
+    debug_result(res, "create %s\n", absbuf);
+    return res;
+}
+
+static int
+file_stat_sb(struct fstat *fstat, struct superblock *sb, const char *abspath)
+{
+    const struct file_operations *f_op = sb->s_op->fs_file_ops;
+    if (!f_op || !f_op->stat_path) return -ENOTSUP;
+
+    const char *relpath = mount_relpath(sb, abspath);
+    return f_op->stat_path(fstat, sb, relpath);
+}
+
 int file_stat(struct fstat *fstat, const char *cwd, const char *path)
 {
+    int  n = PATH_MAX;
+    char absbuf[n];
+    path_join(absbuf, n, cwd, path);
+
+    /* Answer from the dentry cache if the path was looked up before. */
+    struct superblock *sb;
+    int                res = dcache_lookup(absbuf, &sb, fstat);
+    if (res) return res < 0 ? res : 0;
+
+    sb = find_mount_for_path(absbuf);
+    if (!sb) return -ENOENT;
+
+    /* Ask the filesystem directly if it can, without opening the file. */
+    res = file_stat_sb(fstat, sb, absbuf);
+    if (res != -ENOTSUP) {
+        dcache_note(absbuf, sb, res, fstat);
+        return res;
+    }
+
     struct file f;
-    int         res = file_open_path(&f, cwd, path);
+    res = file_open_path_abs(&f, absbuf);
     if (res < 0) return res;
     *fstat = f.f_stat;
     file_close(&f);
@@ -213,4 +365,67 @@ int file_readdir(struct file *f, struct dirent *d)
     return f->f_op->readdir(f, d);
 }
 
+/**
+ * Append a packed directory entry to a batch, if it fits
+ *
+ * @param used  Bytes of buf already filled; updated
+ * @returns 1 if the entry was added, or 0 if there is no room for it.
+ */
+int dirent_rec_put(
+        void *buf, size_t size, size_t *used, ino_t ino, enum dirtype type,
+        const char *name
+)
+{
+    size_t namelen = strlen(name);
+    size_t reclen  = DIRENT_REC_LEN(namelen);
+    if (reclen > size - *used) return 0;
+
+    struct dirent_rec *rec = (struct dirent_rec *) ((char *) buf + *used);
+    rec->d_ino             = ino;
+    rec->d_reclen          = reclen;
+    rec->d_type            = type;
+    memcpy(rec->d_name, name, namelen + 1);
+    *used += reclen;
+    return 1;
+}
+
+/** Batch up entries one readdir call at a time, for drivers without batch */
+static ssize_t
+file_readdir_batch_slow(struct file *f, void *buf, size_t size)
+{
+    size_t        used = 0;
+    struct dirent d;
+    for (;;) {
+        loff_t pos = f->f_pos;
+        int    res = f->f_op->readdir(f, &d);
+        if (res < 0) return used ? (ssize_t) used : res;
+        if (res == 0) break;
+        if (!dirent_rec_put(buf, size, &used, d.d_ino, d.d_type, d.d_name)) {
+            f->f_pos = pos; // Give it back for the next batch.
+            return used ? (ssize_t) used : -EINVAL;
+        }
+    }
+    return used;
+}
+
+/**
+ * Read as many directory entries as fit in a buffer
+ *
+ * The buffer is filled with @ref dirent_rec records. Call again to carry on
+ * where this call stopped.
+ *
+ * @returns bytes filled, 0 at the end of the directory, -EINVAL if the next
+ *          entry does not fit in an empty buffer, or another negative error
+ *          code.
+ */
+ssize_t file_readdir_batch(struct file *f, void *buf, size_t size)
+{
+    if (!f || !f->f_op || !f->f_op->readdir) return -EINVAL;
+    if (!buf) return -EINVAL;
+    if (f->f_stat.f_type != DT_DIR) return -ENOTDIR;
+
+    if (f->f_op->readdir_batch) return f->f_op->readdir_batch(f, buf, size);
+    return file_readdir_batch_slow(f, buf, size);
+}
+
 ///@}
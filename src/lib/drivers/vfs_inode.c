@@ -0,0 +1,115 @@
+/**
+ * @file
+ * Inode cache: one shared, reference-counted inode per filesystem object
+ *
+ * Filesystem drivers look inodes up with @ref inode_get when files are
+ * opened and fill in new ones. Open files point at the shared inode through
+ * @ref file.f_inode, and @ref file_close drops the reference. When the cache
+ * is full, the least recently released inode is reused.
+ */
+// #define LOG_LEVEL LOG_DEBUG
+
+#include "vfs.h"
+
+#include <cpu_interrupt.h>
+
+#include <drivers/log.h>
+
+#include <core/list.h>
+
+#include <stdint.h>
+
+#define INODE_HASH 32 ///< Hash buckets
+
+static struct inode     inodes[INODE_MAX];
+static struct list_head inode_hash[INODE_HASH];
+static LIST_HEAD(inode_unused); ///< Unreferenced, least recently used first
+static int inode_unused_ready;  ///< All inodes have been put on the list
+
+static struct list_head *inode_bucket(struct superblock *sb, ino_t ino)
+{
+    uintptr_t key = (uintptr_t) sb / sizeof(void *) * 31 + ino;
+    return &inode_hash[key % INODE_HASH];
+}
+
+/**
+ * Get a reference to the inode for a filesystem object
+ *
+ * @param sb    Filesystem
+ * @param ino   Inode number within the filesystem
+ * @param isnew Set to 1 if the inode was not cached; the caller must then
+ *              fill in @ref inode.i_stat and @ref inode.i_private
+ *
+ * @returns the inode, or NULL if every cached inode is in use.
+ */
+struct inode *inode_get(struct superblock *sb, ino_t ino, int *isnew)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+
+    /* Look for the inode in the cache. */
+    struct inode     *inode  = NULL, *pos;
+    struct list_head *bucket = inode_bucket(sb, ino);
+    if (!list_empty(bucket)) {
+        list_for_each_entry(pos, bucket, i_hash_link)
+        {
+            if (pos->i_sb == sb && pos->i_ino == ino) {
+                inode = pos;
+                break;
+            }
+        }
+    }
+    *isnew = !inode;
+
+    if (inode) {
+        /* Cached: take it off the unused list if nobody else holds it. */
+        if (!inode->i_count++) list_del(&inode->i_lru_link);
+    } else {
+        /* Not cached: reuse the least recently used free inode. */
+        if (!inode_unused_ready) {
+            for (size_t i = 0; i < INODE_MAX; i++)
+                list_add_tail(&inodes[i].i_lru_link, &inode_unused);
+            inode_unused_ready = 1;
+        }
+        if (!list_empty(&inode_unused)) {
+            inode = list_shift_entry(&inode_unused, struct inode, i_lru_link);
+            if (inode->i_sb) list_del(&inode->i_hash_link);
+            *inode = (struct inode){.i_sb = sb, .i_ino = ino, .i_count = 1};
+            list_add(&inode->i_hash_link, bucket);
+        }
+    }
+
+    intr_setenabled(intrs_enabled);
+    pr_debug(
+            "inode_get %s #%u: %s\n", sb->s_name, ino,
+            !inode ? "cache full" : *isnew ? "new" : "cached"
+    );
+    return inode;
+}
+
+/**
+ * Get an inode's slot in the cache, from 0 to INODE_MAX - 1
+ *
+ * Drivers whose per-inode data is too big for @ref inode.i_private can keep
+ * it in an array of their own, indexed by slot.
+ */
+size_t inode_index(const struct inode *inode) { return inode - inodes; }
+
+/** Take another reference to an inode that is already held */
+void inode_hold(struct inode *inode)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    inode->i_count++;
+    intr_setenabled(intrs_enabled);
+}
+
+/** Drop a reference; the inode stays cached until its slot is needed */
+void inode_put(struct inode *inode)
+{
+    int intrs_enabled = intr_isenabled();
+    intr_setenabled(0);
+    if (inode->i_count && !--inode->i_count)
+        list_add_tail(&inode->i_lru_link, &inode_unused);
+    intr_setenabled(intrs_enabled);
+}
@@ -0,0 +1,21 @@
+#include "spawn.h"
+
+/**
+ * Load and start a program as a child of this process
+ *
+ * There is no fork: the child is built directly from the program file.
+ * Child descriptor i is a copy of our descriptor fdmap[i], or closed if
+ * fdmap[i] is negative. Pass a NULL fdmap to share stdin, stdout and stderr.
+ *
+ * @returns the child's PID, or a negative error code.
+ */
+pid_t spawn(const char *path, char *const argv[], const int fdmap[], int nfd)
+{
+    return syscall(SYS_spawn, path, argv, fdmap, nfd);
+}
+
+/** Wait for a child to exit and free it; see @ref WNOHANG */
+pid_t waitpid(pid_t pid, int *status, int options)
+{
+    return syscall(SYS_wait, pid, status, options);
+}
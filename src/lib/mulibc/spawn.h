@@ -0,0 +1,13 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/syscall.h>
+
+#include <core/types.h>
+
+pid_t spawn(
+        const char *path, char *const argv[], const int fdmap[], int nfd
+);
+pid_t waitpid(pid_t pid, int *status, int options);
+
+#endif /* SPAWN_H */
@@ -0,0 +1,21 @@
+#include "time.h"
+
+#include <sys/syscall.h>
+
+#if __munix__
+#include <sys/clockpage.h>
+#endif
+
+int clock_gettime(clockid_t clk, struct timespec *ts)
+{
+#if __munix__
+    /* Fast path: read the kernel's clock page without trapping. */
+    uint64_t                ns;
+    const struct clockpage *cp = (const void *) CLOCKPAGE_ADDR;
+    if (clk == CLOCK_MONOTONIC && ts && clockpage_read_ns(cp, &ns)) {
+        *ts = ns_to_timespec(ns);
+        return 0;
+    }
+#endif
+    return syscall(SYS_clock_gettime, clk, ts);
+}
@@ -0,0 +1,8 @@
+#ifndef TIME_H
+#define TIME_H
+
+#include <core/time.h>
+
+int clock_gettime(clockid_t clk, struct timespec *ts);
+
+#endif /* TIME_H */
@@ -19,8 +19,33 @@ _Noreturn void _exit(int status)
         ;
 }
 
+ssize_t read(int fd, void *dst, size_t count)
+{
+    return syscall(SYS_read, fd, dst, count);
+}
+
 ssize_t write(int fd, const void *src, size_t count)
 {
     return syscall(SYS_write, fd, src, count);
 }
 
+/** Open a file or directory for reading; O_RDONLY is the only flag */
+int open(const char *path, int flags)
+{
+    return syscall(SYS_open, path, flags);
+}
+
+int close(int fd)
+{
+    return syscall(SYS_close, fd);
+}
+
+/**
+ * Read a batch of directory entries as packed @ref dirent_rec records
+ *
+ * @returns bytes of records, 0 at the end of the directory, or an error
+ */
+ssize_t getdents(int fd, void *buf, size_t size)
+{
+    return syscall(SYS_getdents, fd, buf, size);
+}
@@ -2,8 +2,14 @@
 #define UNISTD_H
 
 #include <core/types.h>
+#include <sys/dirent.h>
+#include <sys/syscall.h>
 
 _Noreturn void _exit(int status);
+ssize_t        read(int fd, void *dst, size_t count);
 ssize_t        write(int fd, const void *src, size_t count);
+int            open(const char *path, int flags);
+int            close(int fd);
+ssize_t        getdents(int fd, void *buf, size_t size);
 
 #endif /* UNISTD_H */
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * Shared clock page: time without a syscall
+ *
+ * The kernel fills in a read-only page with the parameters needed to turn a
+ * raw Time-Stamp Counter value into nanoseconds since boot. Processes can
+ * then read the clock by executing RDTSC and doing a multiply and a shift,
+ * without trapping into the kernel. This is the same idea as Linux's vDSO
+ * clock data.
+ *
+ * @see
+ * - <https://man7.org/linux/man-pages/man7/vdso.7.html>
+ */
+#ifndef SYS_CLOCKPAGE_H
+#define SYS_CLOCKPAGE_H
+
+#include <cpu.h>
+
+#include <stdint.h>
+
+/**
+ * Fixed address of the clock page
+ *
+ * The page sits just below the process load address (see the configure
+ * script), in memory that neither the kernel image nor processes use.
+ */
+#define CLOCKPAGE_ADDR 0x4ff000
+
+/**
+ * Clock parameters published by the kernel
+ *
+ * The fields are protected by a sequence counter: the kernel makes
+ * @ref seq odd while it updates the other fields and even again when it is
+ * done. A reader retries if it sees an odd count, or if the count changed
+ * while it was reading.
+ */
+struct clockpage {
+    volatile uint32_t seq;      ///< Update sequence counter
+    uint32_t          valid;    ///< Non-zero if the TSC clock is usable
+    uint32_t          mult;     ///< TSC-to-ns multiplier
+    uint32_t          shift;    ///< TSC-to-ns shift
+    uint64_t          tsc_base; ///< TSC value at @ref ns_base
+    uint64_t          ns_base;  ///< Nanoseconds since boot at @ref tsc_base
+};
+
+/**
+ * Convert a TSC delta to nanoseconds: `(cycles * mult) >> shift`
+ *
+ * The multiply is split at 32 bits so that the intermediate product does not
+ * overflow 64 bits, no matter how long the system has been up.
+ */
+static inline uint64_t
+clock_cyc2ns(uint64_t cycles, uint32_t mult, uint32_t shift)
+{
+    uint64_t hi = (cycles >> 32) * mult;
+    uint64_t lo = (cycles & 0xffffffff) * mult;
+    return (hi << (32 - shift)) + (lo >> shift);
+}
+
+/**
+ * Read monotonic nanoseconds from a clock page
+ *
+ * @returns 1 and sets `*ns` on success, or 0 if the page is not valid.
+ */
+static inline int clockpage_read_ns(const struct clockpage *cp, uint64_t *ns)
+{
+    uint32_t seq, mult, shift, valid;
+    uint64_t tsc_base, ns_base, tsc;
+    do {
+        seq = cp->seq;
+        asm volatile("" ::: "memory");
+        valid = cp->valid;
+
+        /* Without a usable TSC the page never becomes valid, and RDTSC
+         * may not even exist on this CPU. */
+        if (!valid) return 0;
+        mult     = cp->mult;
+        shift    = cp->shift;
+        tsc_base = cp->tsc_base;
+        ns_base  = cp->ns_base;
+        tsc      = rdtsc();
+        asm volatile("" ::: "memory");
+    } while ((seq & 1) || seq != cp->seq);
+
+    *ns = ns_base + clock_cyc2ns(tsc - tsc_base, mult, shift);
+    return 1;
+}
+
+#endif /* SYS_CLOCKPAGE_H */
@@ -0,0 +1,29 @@
+/**
+ * @file
+ * Packed directory entries, as returned by a batched directory read
+ *
+ * A batch is a buffer of records laid end to end. Each record takes only
+ * the room its name needs, so a buffer holds many more entries than the
+ * same space of fixed-size `struct dirent`. Walk a batch with d_reclen.
+ */
+#ifndef SYS_DIRENT_H
+#define SYS_DIRENT_H
+
+#include <core/macros.h>
+#include <core/types.h>
+
+#include <stddef.h>
+
+struct dirent_rec {
+    ino_t          d_ino;
+    unsigned short d_reclen; ///< Bytes from this record to the next
+    unsigned char  d_type;   ///< A @ref dirtype value
+    char           d_name[]; ///< NUL-terminated name
+};
+
+/** Record size for a name of a given length, keeping records aligned */
+#define DIRENT_REC_LEN(NAMELEN) \
+    ALIGN_UP(offsetof(struct dirent_rec, d_name) + (NAMELEN) + 1, \
+             _Alignof(struct dirent_rec))
+
+#endif /* SYS_DIRENT_H */
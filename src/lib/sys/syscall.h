@@ -11,8 +11,21 @@ enum syscall_nr {
     SYS_NULL = 0,
     SYS_exit,
     SYS_write,
+    SYS_clock_gettime,
+    SYS_read,
+    SYS_spawn,
+    SYS_wait,
+    SYS_getdents,
+    SYS_open,
+    SYS_close,
     SYS_MAX
 };
+
+/** @ref SYS_wait option: return 0 instead of blocking if still running */
+#define WNOHANG 1
+
+/** @ref SYS_open flags: files are only opened for reading so far */
+#define O_RDONLY 0
 #endif /* __munix__ */
 
 long syscall(long number, ...);
@@ -0,0 +1,17 @@
+/**
+ * @file
+ * Vectored I/O: one read or write spread over several buffers
+ */
+#ifndef SYS_UIO_H
+#define SYS_UIO_H
+
+#include <stddef.h>
+
+#define IOV_MAX 16 ///< Max buffers in one vectored read or write
+
+struct iovec {
+    void  *iov_base;
+    size_t iov_len;
+};
+
+#endif /* SYS_UIO_H */
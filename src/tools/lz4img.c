@@ -0,0 +1,196 @@
+/**
+ * @file
+ * lz4img: pack a disk image into the block-compressed format of lz4img.h
+ *
+ * Usage: lz4img [-b BLOCKSIZE] INPUT OUTPUT
+ *
+ * This is a host tool, built and run on the build machine. Each block is
+ * compressed on its own with a simple greedy LZ4 compressor, so that the
+ * kernel can decompress any block without reading the others.
+ */
+#include <drivers/fileformat/lz4img.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LZ4_MIN_MATCH    4     ///< Shortest match
+#define LZ4_LAST_LITS    5     ///< A block always ends with this many literals
+#define LZ4_MF_LIMIT     12    ///< No match starts this close to the end
+#define LZ4_MAX_OFFSET   65535 ///< Matches must be this close
+#define LZ4_HASH_BITS    12
+#define LZ4IMG_BLOCK_DEF 16384 ///< Default block size
+
+static const char *prog = "lz4img";
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned hash32(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+/** Write a length that did not fit in its token nibble */
+static uint8_t *put_len(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+/** Write one sequence: literals, then a match unless this is the last */
+static uint8_t *put_seq(
+        uint8_t *op, const uint8_t *lits, size_t nlits, size_t offset,
+        size_t mlen
+)
+{
+    uint8_t *token = op++;
+    *token         = (nlits >= 15 ? 15 : nlits) << 4;
+    if (nlits >= 15) op = put_len(op, nlits - 15);
+    memcpy(op, lits, nlits);
+    op += nlits;
+
+    if (!mlen) return op;
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    mlen -= LZ4_MIN_MATCH;
+    *token |= mlen >= 15 ? 15 : mlen;
+    if (mlen >= 15) op = put_len(op, mlen - 15);
+    return op;
+}
+
+/**
+ * Compress one block in the LZ4 block format
+ *
+ * dst must have room for n + n / 255 + 16 bytes, the worst case.
+ *
+ * @returns compressed size
+ */
+static size_t lz4_compress(const uint8_t *src, size_t n, uint8_t *dst)
+{
+    uint32_t table[1 << LZ4_HASH_BITS] = {0}; // Position + 1, or 0
+    uint8_t *op                        = dst;
+    size_t   anchor = 0, i = 0;
+
+    while (n > LZ4_MF_LIMIT && i < n - LZ4_MF_LIMIT) {
+        uint32_t seq  = read32(src + i);
+        unsigned h    = hash32(seq);
+        size_t   cand = table[h];
+        table[h]      = i + 1;
+        if (!cand || i - (cand - 1) > LZ4_MAX_OFFSET
+            || read32(src + cand - 1) != seq) {
+            i++;
+            continue;
+        }
+
+        size_t m = cand - 1, len = LZ4_MIN_MATCH;
+        while (i + len < n - LZ4_LAST_LITS && src[m + len] == src[i + len])
+            len++;
+
+        op     = put_seq(op, src + anchor, i - anchor, i - m, len);
+        i      += len;
+        anchor = i;
+    }
+
+    return put_seq(op, src + anchor, n - anchor, 0, 0) - dst;
+}
+
+static void die(const char *what, const char *path)
+{
+    fprintf(stderr, "%s: %s: %s\n", prog, path, what ? what : strerror(errno));
+    exit(1);
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) die(NULL, path);
+
+    size_t   cap = 1 << 20, len = 0, n;
+    uint8_t *buf = malloc(cap);
+    while (buf && (n = fread(buf + len, 1, cap - len, f)) > 0) {
+        len += n;
+        if (len == cap) buf = realloc(buf, cap *= 2);
+    }
+    if (!buf) die("out of memory", path);
+    if (ferror(f)) die(NULL, path);
+    fclose(f);
+
+    *size = len;
+    return buf;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long bs = LZ4IMG_BLOCK_DEF;
+    int           opt;
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        switch (opt) {
+        case 'b': bs = strtoul(optarg, NULL, 0); break;
+        default: goto usage;
+        }
+    }
+    if (argc - optind != 2) goto usage;
+    if (bs < LZ4IMG_BLOCK_MIN || bs > LZ4IMG_BLOCK_MAX || (bs & (bs - 1))) {
+        fprintf(stderr, "%s: block size must be a power of two, %u to %u\n",
+                prog, LZ4IMG_BLOCK_MIN, LZ4IMG_BLOCK_MAX);
+        return 1;
+    }
+
+    const char *inpath = argv[optind], *outpath = argv[optind + 1];
+    size_t      size;
+    uint8_t    *in = read_file(inpath, &size);
+    if (size > UINT32_MAX) die("too large", inpath);
+
+    struct lz4img_header hdr = {
+            .magic      = LZ4IMG_MAGIC,
+            .block_size = bs,
+            .nblocks    = (size + bs - 1) / bs,
+            .size       = size,
+    };
+
+    /* Compress every block, then write header, offsets and data. */
+    uint32_t *offsets = calloc(hdr.nblocks + 1, sizeof(*offsets));
+    uint8_t  *out     = malloc(size + size / 255 + 16 * (hdr.nblocks + 1));
+    if (!offsets || !out) die("out of memory", inpath);
+
+    size_t pos = sizeof(hdr) + (hdr.nblocks + 1) * sizeof(*offsets);
+    size_t len = 0;
+    for (uint32_t b = 0; b < hdr.nblocks; b++) {
+        size_t ulen = size - b * bs < bs ? size - b * bs : bs;
+        size_t clen = lz4_compress(in + b * bs, ulen, out + len);
+
+        /* Blocks that do not shrink are stored as they are. */
+        if (clen >= ulen) {
+            memcpy(out + len, in + b * bs, ulen);
+            clen = ulen;
+        }
+        offsets[b] = pos + len;
+        len += clen;
+    }
+    offsets[hdr.nblocks] = pos + len;
+    if (pos + len > UINT32_MAX) die("too large", outpath);
+
+    FILE *f = fopen(outpath, "wb");
+    if (!f) die(NULL, outpath);
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fwrite(offsets, sizeof(*offsets), hdr.nblocks + 1, f);
+    fwrite(out, 1, len, f);
+    if (fclose(f) != 0) die(NULL, outpath);
+
+    fprintf(stderr, "%s: %zu -> %zu bytes in %u blocks of %lu\n", outpath,
+            size, pos + len, hdr.nblocks, bs);
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: %s [-b BLOCKSIZE] INPUT OUTPUT\n", prog);
+    return 1;
+}
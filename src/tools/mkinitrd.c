@@ -0,0 +1,195 @@
+/**
+ * @file
+ * mkinitrd: pack a directory into an indexed CPIO archive, see cpioidx.h
+ *
+ * Usage: mkinitrd DIR OUTPUT
+ *
+ * This is a host tool, built and run on the build machine. Entries are
+ * written in sorted order with paths relative to DIR, like
+ * `find . | sort | cpio -o --format=newc`, but with page-aligned file data
+ * and a path index at the end. Timestamps and owners are zeroed so that
+ * the same tree always gives the same image.
+ */
+#define _XOPEN_SOURCE 700
+
+#include <drivers/fileformat/cpioidx.h>
+
+#include <errno.h>
+#include <ftw.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define NEWC_HDR_SIZE 110 ///< "070701" and 13 eight-digit hex fields
+
+struct entry {
+    char       *path; ///< Relative to DIR, "." for DIR itself
+    char       *src;  ///< Path on the host
+    struct stat st;
+};
+
+static const char   *prog = "mkinitrd";
+static struct entry *entries;
+static size_t        nentries, entries_cap;
+static size_t        rootlen;
+
+static void die(const char *what, const char *path)
+{
+    fprintf(stderr, "%s: %s: %s\n", prog, path, what ? what : strerror(errno));
+    exit(1);
+}
+
+static int
+collect(const char *src, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void) type, (void) ftw;
+
+    /* The kernel knows regular files, directories and devices. */
+    if (!S_ISREG(st->st_mode) && !S_ISDIR(st->st_mode)
+        && !S_ISCHR(st->st_mode) && !S_ISBLK(st->st_mode)) {
+        fprintf(stderr, "%s: %s: unsupported file type, skipped\n", prog, src);
+        return 0;
+    }
+
+    if (nentries == entries_cap) {
+        entries_cap = entries_cap ? 2 * entries_cap : 64;
+        entries     = realloc(entries, entries_cap * sizeof(*entries));
+        if (!entries) die("out of memory", src);
+    }
+
+    const char *rel = src[rootlen] ? src + rootlen + 1 : ".";
+    entries[nentries++] = (struct entry){
+            .path = strdup(rel),
+            .src  = strdup(src),
+            .st   = *st,
+    };
+    return 0;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    return strcmp(((const struct entry *) a)->path,
+                  ((const struct entry *) b)->path);
+}
+
+static void pad(FILE *out, long *pos, long align)
+{
+    while (*pos % align) {
+        fputc(0, out);
+        (*pos)++;
+    }
+}
+
+/** Write a header and path name, padded so that file data starts aligned */
+static void write_header(
+        FILE *out, long *pos, unsigned ino, const char *path,
+        const struct stat *st, long data_align
+)
+{
+    uint32_t size = S_ISREG(st->st_mode) ? st->st_size : 0;
+    long     name = strlen(path) + 1;
+    long     end  = *pos + NEWC_HDR_SIZE + name;
+    if (size) end = (end + data_align - 1) / data_align * data_align;
+    else end = (end + 3) / 4 * 4;
+
+    /* The name size includes the padding NULs before the data. */
+    long namesize = end - *pos - NEWC_HDR_SIZE;
+    if (size) name = namesize;
+
+    fprintf(out, "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+            ino, st->st_mode, 0, 0, S_ISDIR(st->st_mode) ? 2 : 1, 0, size, 0,
+            0, major(st->st_rdev), minor(st->st_rdev), (unsigned) name, 0);
+    fputs(path, out);
+    *pos += NEWC_HDR_SIZE + strlen(path);
+
+    /* The name's NUL terminator, then padding. */
+    while (*pos < end) {
+        fputc(0, out);
+        (*pos)++;
+    }
+}
+
+static void copy_data(FILE *out, long *pos, const struct entry *e)
+{
+    FILE *in = fopen(e->src, "rb");
+    if (!in) die(NULL, e->src);
+
+    char   buf[65536];
+    size_t n, total = 0;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        fwrite(buf, 1, n, out);
+        total += n;
+    }
+    if (ferror(in)) die(NULL, e->src);
+    fclose(in);
+    if (total != (size_t) e->st.st_size) die("changed while reading", e->src);
+
+    *pos += total;
+    pad(out, pos, 4);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s DIR OUTPUT\n", prog);
+        return 1;
+    }
+    const char *dir = argv[1], *outpath = argv[2];
+
+    rootlen = strlen(dir);
+    while (rootlen > 1 && dir[rootlen - 1] == '/') rootlen--;
+    if (nftw(dir, collect, 16, FTW_PHYS) != 0) die(NULL, dir);
+    qsort(entries, nentries, sizeof(*entries), cmp_entry);
+
+    FILE *out = fopen(outpath, "wb");
+    if (!out) die(NULL, outpath);
+
+    /* The archive itself. */
+    long      pos = 0;
+    uint32_t *data_offs = calloc(nentries, sizeof(*data_offs));
+    if (!data_offs) die("out of memory", outpath);
+    for (size_t i = 0; i < nentries; i++) {
+        struct entry *e = &entries[i];
+        write_header(out, &pos, i + 1, e->path, &e->st, CPIOIDX_ALIGN);
+        data_offs[i] = pos;
+        if (S_ISREG(e->st.st_mode) && e->st.st_size) copy_data(out, &pos, e);
+    }
+    struct stat trailer = {.st_nlink = 1};
+    write_header(out, &pos, 0, "TRAILER!!!", &trailer, 4);
+
+    /* The index: entries sorted by path, then the paths. */
+    struct cpioidx_footer foot = {
+            .magic       = CPIOIDX_MAGIC,
+            .nentries    = nentries,
+            .entries_off = pos,
+    };
+    uint32_t name_off = 0;
+    for (size_t i = 0; i < nentries; i++) {
+        struct entry        *e  = &entries[i];
+        struct cpioidx_entry ie = {
+                .name_off   = name_off,
+                .data_off   = data_offs[i],
+                .size       = S_ISREG(e->st.st_mode) ? e->st.st_size : 0,
+                .mode       = e->st.st_mode,
+                .rdev_major = major(e->st.st_rdev),
+                .rdev_minor = minor(e->st.st_rdev),
+        };
+        fwrite(&ie, sizeof(ie), 1, out);
+        name_off += strlen(e->path) + 1;
+    }
+    pos += nentries * sizeof(struct cpioidx_entry);
+    foot.names_off  = pos;
+    foot.names_size = name_off;
+    for (size_t i = 0; i < nentries; i++)
+        fwrite(entries[i].path, 1, strlen(entries[i].path) + 1, out);
+    pos += name_off;
+    fwrite(&foot, sizeof(foot), 1, out);
+    pos += sizeof(foot);
+
+    if (fclose(out) != 0) die(NULL, outpath);
+    fprintf(stderr, "%s: %zu entries, %ld bytes\n", outpath, nentries, pos);
+    return 0;
+}